@@ -7,10 +7,112 @@ FFI.cdef([[
         uint8_t *data;
     } mssn_data_t;
 
+    typedef struct {
+        int offset; // offset in buffer of last mssn_process, -1 for copied into session
+        int length; // span length
+    } mssn_span_t;
+
+    /// known header names, interned while parsing
+    typedef enum {
+        MSSN_H_UNKNOWN = 0,
+        MSSN_H_A_IM,                             // A-IM
+        MSSN_H_ACCEPT,                           // Accept
+        MSSN_H_ACCEPT_CHARSET,                   // Accept-Charset
+        MSSN_H_ACCEPT_DATETIME,                  // Accept-Datetime
+        MSSN_H_ACCEPT_ENCODING,                  // Accept-Encoding
+        MSSN_H_ACCEPT_LANGUAGE,                  // Accept-Language
+        MSSN_H_ACCEPT_PATCH,                     // Accept-Patch
+        MSSN_H_ACCEPT_RANGES,                    // Accept-Ranges
+        MSSN_H_ACCESS_CONTROL_ALLOW_CREDENTIALS, // Access-Control-Allow-Credentials
+        MSSN_H_ACCESS_CONTROL_ALLOW_HEADERS,     // Access-Control-Allow-Headers
+        MSSN_H_ACCESS_CONTROL_ALLOW_METHODS,     // Access-Control-Allow-Methods
+        MSSN_H_ACCESS_CONTROL_ALLOW_ORIGIN,      // Access-Control-Allow-Origin
+        MSSN_H_ACCESS_CONTROL_EXPOSE_HEADERS,    // Access-Control-Expose-Headers
+        MSSN_H_ACCESS_CONTROL_MAX_AGE,           // Access-Control-Max-Age
+        MSSN_H_ACCESS_CONTROL_REQUEST_HEADERS,   // Access-Control-Request-Headers
+        MSSN_H_ACCESS_CONTROL_REQUEST_METHOD,    // Access-Control-Request-Method
+        MSSN_H_AGE,                              // Age
+        MSSN_H_ALLOW,                            // Allow
+        MSSN_H_ALT_SVC,                          // Alt-Svc
+        MSSN_H_AUTHORIZATION,                    // Authorization
+        MSSN_H_CACHE_CONTROL,                    // Cache-Control
+        MSSN_H_CONNECTION,                       // Connection
+        MSSN_H_CONTENT_DISPOSITION,              // Content-Disposition
+        MSSN_H_CONTENT_ENCODING,                 // Content-Encoding
+        MSSN_H_CONTENT_LANGUAGE,                 // Content-Language
+        MSSN_H_CONTENT_LENGTH,                   // Content-Length
+        MSSN_H_CONTENT_LOCATION,                 // Content-Location
+        MSSN_H_CONTENT_RANGE,                    // Content-Range
+        MSSN_H_CONTENT_SECURITY_POLICY,          // Content-Security-Policy
+        MSSN_H_CONTENT_TYPE,                     // Content-Type
+        MSSN_H_COOKIE,                           // Cookie
+        MSSN_H_DATE,                             // Date
+        MSSN_H_DNT,                              // DNT
+        MSSN_H_ETAG,                             // ETag
+        MSSN_H_EXPECT,                           // Expect
+        MSSN_H_EXPIRES,                          // Expires
+        MSSN_H_FORWARDED,                        // Forwarded
+        MSSN_H_FROM,                             // From
+        MSSN_H_HOST,                             // Host
+        MSSN_H_IF_MATCH,                         // If-Match
+        MSSN_H_IF_MODIFIED_SINCE,                // If-Modified-Since
+        MSSN_H_IF_NONE_MATCH,                    // If-None-Match
+        MSSN_H_IF_RANGE,                         // If-Range
+        MSSN_H_IF_UNMODIFIED_SINCE,              // If-Unmodified-Since
+        MSSN_H_KEEP_ALIVE,                       // Keep-Alive
+        MSSN_H_LAST_MODIFIED,                    // Last-Modified
+        MSSN_H_LINK,                             // Link
+        MSSN_H_LOCATION,                         // Location
+        MSSN_H_MAX_FORWARDS,                     // Max-Forwards
+        MSSN_H_ORIGIN,                           // Origin
+        MSSN_H_PRAGMA,                           // Pragma
+        MSSN_H_PROXY_AUTHENTICATE,               // Proxy-Authenticate
+        MSSN_H_PROXY_AUTHORIZATION,              // Proxy-Authorization
+        MSSN_H_PROXY_CONNECTION,                 // Proxy-Connection
+        MSSN_H_RANGE,                            // Range
+        MSSN_H_REFERER,                          // Referer
+        MSSN_H_REFRESH,                          // Refresh
+        MSSN_H_RETRY_AFTER,                      // Retry-After
+        MSSN_H_SEC_FETCH_DEST,                   // Sec-Fetch-Dest
+        MSSN_H_SEC_FETCH_MODE,                   // Sec-Fetch-Mode
+        MSSN_H_SEC_FETCH_SITE,                   // Sec-Fetch-Site
+        MSSN_H_SEC_FETCH_USER,                   // Sec-Fetch-User
+        MSSN_H_SEC_WEBSOCKET_ACCEPT,             // Sec-WebSocket-Accept
+        MSSN_H_SEC_WEBSOCKET_EXTENSIONS,         // Sec-WebSocket-Extensions
+        MSSN_H_SEC_WEBSOCKET_KEY,                // Sec-WebSocket-Key
+        MSSN_H_SEC_WEBSOCKET_PROTOCOL,           // Sec-WebSocket-Protocol
+        MSSN_H_SEC_WEBSOCKET_VERSION,            // Sec-WebSocket-Version
+        MSSN_H_SERVER,                           // Server
+        MSSN_H_SET_COOKIE,                       // Set-Cookie
+        MSSN_H_STRICT_TRANSPORT_SECURITY,        // Strict-Transport-Security
+        MSSN_H_TE,                               // TE
+        MSSN_H_TRAILER,                          // Trailer
+        MSSN_H_TRANSFER_ENCODING,                // Transfer-Encoding
+        MSSN_H_UPGRADE,                          // Upgrade
+        MSSN_H_UPGRADE_INSECURE_REQUESTS,        // Upgrade-Insecure-Requests
+        MSSN_H_USER_AGENT,                       // User-Agent
+        MSSN_H_VARY,                             // Vary
+        MSSN_H_VIA,                              // Via
+        MSSN_H_WARNING,                          // Warning
+        MSSN_H_WWW_AUTHENTICATE,                 // WWW-Authenticate
+        MSSN_H_X_CONTENT_TYPE_OPTIONS,           // X-Content-Type-Options
+        MSSN_H_X_FORWARDED_FOR,                  // X-Forwarded-For
+        MSSN_H_X_FORWARDED_HOST,                 // X-Forwarded-Host
+        MSSN_H_X_FORWARDED_PROTO,                // X-Forwarded-Proto
+        MSSN_H_X_FRAME_OPTIONS,                  // X-Frame-Options
+        MSSN_H_X_REAL_IP,                        // X-Real-IP
+        MSSN_H_X_REQUESTED_WITH,                 // X-Requested-With
+        MSSN_H_MAX
+    } mssn_header_id;
+
     typedef struct s_mssn_header {
         const char *key;
         const char *value;
         struct s_mssn_header *next;
+        mssn_span_t key_span;      // key span
+        mssn_span_t value_span;    // value span
+        int id;                    // mssn_header_id of key, MSSN_H_UNKNOWN for others
+        struct s_mssn_header *dup; // next header of same name
     } mssn_header_t;
 
     typedef enum {
@@ -27,6 +129,8 @@ FFI.cdef([[
         mssn_data_t *data;          // frame data
         mssn_data_t *data_last;     // frame data last
         struct s_mssn_frame *next;  // next frame
+        uint64_t offset;            // payload offset in message, with MSSN_OPT_WS_STREAM
+        int fin;                    // last part of message
     } mssn_frame_t;
 
     typedef enum {
@@ -42,31 +146,124 @@ FFI.cdef([[
         mssn_state_t state;     // state for last processing
         const char *method;     // method
         const char *path;       // path
+        mssn_span_t path_span;  // path span
         int status;             // http status code
         int upgrade;            // upgrade to websocket
         mssn_header_t *headers; // header
-        mssn_frame_t *frames;   // frames for last processing
+        mssn_frame_t *frames;   // frames since last reclaim
         char *error_msg;        // error message
         void *opaque;           // internal use
     } mssn_t;
 
+    typedef enum {
+        MSSN_OPT_ZERO_COPY = 1,              // non-zero for headers, path referencing buffer of mssn_process
+        MSSN_OPT_WS_STREAM = 2,              // non-zero for delivering partial websocket message
+        MSSN_OPT_WS_INFLATE = 3,             // non-zero for inflating permessage-deflate message
+        MSSN_OPT_WS_WINDOW_BITS = 4,         // permessage-deflate max window bits, 9 ~ 15, default 15
+        MSSN_OPT_WS_MEM_LEVEL = 5,           // deflate memLevel, 1 ~ 9, default 8
+        MSSN_OPT_WS_NO_CONTEXT_TAKEOVER = 6, // non-zero for requiring no context takeover both sides
+        MSSN_OPT_WS_DEFLATE_MIN = 7,         // min message bytes for MSSN_BUILD_DEFLATE, default 64
+        MSSN_OPT_WS_DEFLATE_PROBE = 8,       // non-zero for probing incompressible message, default 1
+        MSSN_OPT_BODY_ZERO_COPY = 9,         // non-zero for HTTP body data referencing buffer of mssn_process
+        MSSN_OPT_WS_INFLATE_MAX = 10,        // max inflated message bytes, 0 for unlimited, default 16 MB
+    } mssn_option_t;
+
+    typedef enum {
+        MSSN_BUILD_DEFLATE = 0x100, // with rsv bits, compress text/binary message with permessage-deflate
+    } mssn_build_flag_t;
+
+    typedef struct {
+        void *(*alloc)(void *ud, size_t size);          // allocate size bytes
+        void (*free)(void *ud, void *ptr, size_t size); // free ptr with size from alloc
+        void *ud;                                       // user data for callbacks
+    } mssn_allocator_t;
+
+    typedef struct {
+        size_t chunk_size;    // bytes per data chunk
+        size_t high_water;    // max chunks cached in global list
+        size_t cached;        // chunks cached in global list
+        size_t thread_cached; // chunks cached by threads
+        size_t allocated;     // chunks from libc, including cached
+        size_t hits;          // allocation served from cache
+        size_t misses;        // allocation served from libc
+        size_t released;      // chunks returned to libc over high-water
+    } mssn_chunk_stats_t;
+
+    typedef struct {
+        void *iov_base; // layout of struct iovec on POSIX
+        size_t iov_len;
+    } mssn_iovec_t;
+
+    typedef struct {
+        uint64_t compressed;     // messages deflated
+        uint64_t compressed_in;  // payload bytes before deflate
+        uint64_t compressed_out; // payload bytes after deflate
+        uint64_t skipped;        // messages sent uncompressed by size, probe, or no gain
+        uint64_t skipped_bytes;  // payload bytes sent uncompressed
+    } mssn_deflate_stats_t;
+
+    typedef struct {
+        size_t refs;             // live references
+        size_t shared_bytes;     // frame bytes held once, plain and deflated
+        uint64_t sends;          // frames handed out by mssn_bcast_frames
+        uint64_t sends_deflated; // sends with deflated frames
+        uint64_t dup_bytes;      // bytes that per-context building would have duplicated
+    } mssn_bcast_stats_t;
+
+    typedef struct s_mssn_pool mssn_pool_t;
+
+    typedef struct s_mssn_zpool mssn_zpool_t;
+
+    typedef struct s_mssn_bcast mssn_bcast_t;
+
     /// @brief create context
     /// @return context
     mssn_t* mssn_create(int);
 
+    /// @brief create context with allocator, NULL for libc
+    mssn_t *mssn_create_ex(int server, const mssn_allocator_t *allocator);
+
     /// @brief close context
     void mssn_close(mssn_t *ctx);
 
+    /// @brief reset context to initial HTTP state, keep options and allocated buffers
+    void mssn_reset(mssn_t *ctx);
+
+    /// @brief create session pool with pre-initialized contexts, not thread-safe
+    mssn_pool_t *mssn_pool_create(int server, int capacity, const mssn_allocator_t *allocator);
+
+    /// @brief close idle contexts and destroy pool
+    void mssn_pool_destroy(mssn_pool_t *pool);
+
+    /// @brief get idle context from pool, or create new one when empty
+    mssn_t *mssn_pool_get(mssn_pool_t *pool);
+
+    /// @brief reset context and return it to pool, close it when pool is full
+    void mssn_pool_put(mssn_pool_t *pool, mssn_t *ctx);
+
+    /// @brief create worker zlib stream pool for contexts without context takeover, not thread-safe
+    mssn_zpool_t *mssn_zpool_create(int window_bits, int mem_level, int capacity, const mssn_allocator_t *allocator);
+
+    /// @brief destroy pool after every attached context was closed or detached
+    void mssn_zpool_destroy(mssn_zpool_t *zpool);
+
+    /// @brief attach context to zlib pool, NULL for detach
+    int mssn_zpool_attach(mssn_t *ctx, mssn_zpool_t *zpool);
+
+    /// @brief set context option before processing
+    /// @return 0 for success, -1 for invalid option
+    int mssn_setopt(mssn_t *ctx, mssn_option_t opt, int value);
+
     /// @brief return data consumed
     // - return < 0, encounter underlying connection error
-    // - return = 0, need more data
-    // - return > 0, has consume data bytes, and complete frames in context
+    // - return >= 0, has consume data bytes, and complete frames in context,
+    //   incomplete data kept in context
     int mssn_process(mssn_t *, const uint8_t *data, int data_length);
 
     /// @brief build websocket binary frame data, data will be fragment but control frame
     /// @param ctx context
     /// @param ftype websocket frame type
-    /// @param rsv_bits rsv 3 bits
+    /// @param rsv_bits rsv 3 bits, with MSSN_BUILD_DEFLATE for deflating text/binary message
     /// @param frame_size max frame size including websocket header
     /// @param buf data to be send
     /// @param buf_len data length
@@ -78,11 +275,101 @@ FFI.cdef([[
                             const uint8_t *buf,
                             size_t buf_len);
 
+    /// @brief negotiate permessage-deflate with Sec-WebSocket-Extensions value
+    /// - server: value from request offers, return response value, NULL for no acceptable offer
+    /// - client: value from server response, return accepted value, NULL for invalid
+    const char *mssn_ws_negotiate(mssn_t *ctx, const char *value, int value_len);
+
+    /// @brief build websocket frames contiguously into out without allocation, like snprintf
+    /// @return bytes written, or bytes needed when larger than out_cap, -1 for error
+    int64_t mssn_build_into(mssn_t *ctx,
+                            mssn_frame_type ftype,
+                            int rsv_bits,
+                            size_t frame_size,
+                            const uint8_t *buf,
+                            size_t buf_len,
+                            uint8_t *out,
+                            size_t out_cap);
+
+    /// @brief build websocket frames as iovec for writev/sendmsg in server, payload not copied
+    /// @return iovec count, -1 for error or client context
+    int mssn_build_iov(mssn_t *ctx,
+                       mssn_frame_type ftype,
+                       int rsv_bits,
+                       size_t frame_size,
+                       const uint8_t *buf,
+                       size_t buf_len,
+                       mssn_iovec_t **iov);
+
+    /// @brief release iovec from mssn_build_iov
+    void mssn_reclaim_iov(mssn_t *ctx, mssn_iovec_t *iov);
+
+    /// @brief deflate counters of mssn_build since create or reset
+    void mssn_deflate_stats(mssn_t *ctx, mssn_deflate_stats_t *st);
+
+    /// @brief begin message built incrementally, first frame, continuation frames, then FIN frame
+    int mssn_build_begin(mssn_t *ctx, mssn_frame_type ftype, int rsv_bits, size_t frame_size);
+
+    /// @brief append payload, output complete frames, release with mssn_reclaim
+    int mssn_build_append(mssn_t *ctx, const uint8_t *buf, size_t buf_len, mssn_data_t **data);
+
+    /// @brief finish message, output rest frames ending with FIN frame, release with mssn_reclaim
+    int mssn_build_finish(mssn_t *ctx, mssn_data_t **data);
+
+    /// @brief encode broadcast message once into unmasked frames shared by server contexts, refcounted
+    mssn_bcast_t *mssn_bcast_create(mssn_frame_type ftype,
+                                    int rsv_bits,
+                                    size_t frame_size,
+                                    const uint8_t *buf,
+                                    size_t buf_len,
+                                    int window_bits,
+                                    const mssn_allocator_t *allocator);
+
+    mssn_bcast_t *mssn_bcast_ref(mssn_bcast_t *b);
+
+    void mssn_bcast_unref(mssn_bcast_t *b);
+
+    /// @brief frames for server context, deflated when its negotiation allows
+    const uint8_t *mssn_bcast_frames(mssn_t *ctx, mssn_bcast_t *b, size_t *len);
+
+    /// @brief bytes shared by broadcast versus duplicated by building per context
+    void mssn_bcast_stats(mssn_bcast_t *b, mssn_bcast_stats_t *st);
+
+    /// @brief queue bytes for send, copied into shared pages
+    int mssn_send_queue(mssn_t *ctx, const uint8_t *buf, size_t buf_len);
+
+    /// @brief queue frames from mssn_build, taking ownership, small frames coalesced
+    int mssn_send_data(mssn_t *ctx, mssn_data_t *data);
+
+    /// @brief queue broadcast frames for server context
+    int mssn_send_bcast(mssn_t *ctx, mssn_bcast_t *b);
+
+    /// @brief iovec view of queued bytes in order
+    int mssn_send_iov(mssn_t *ctx, mssn_iovec_t *iov, int iov_max);
+
+    /// @brief release bytes written
+    void mssn_send_consume(mssn_t *ctx, size_t nbytes);
+
+    /// @brief bytes queued not written, for backpressure
+    size_t mssn_send_pending(mssn_t *ctx);
+
+    /// @brief first header of known name in last process, repeated ones chained by dup
+    mssn_header_t *mssn_header_get(mssn_t *ctx, int id);
+
+    /// @brief first header of name in last process, case-insensitive, repeated ones chained by dup
+    mssn_header_t *mssn_header_find(mssn_t *ctx, const char *name, int len);
+
     /// @brief reclaim frames, headers, datas if needed
     /// @param ctx context
     /// @param data_build data from mssn_build
     void mssn_reclaim(mssn_t *ctx, mssn_data_t *data_build);
 
+    /// @brief set high-water mark of process-wide data chunk pool, default 1024 chunks
+    void mssn_chunk_pool_config(size_t high_water);
+
+    /// @brief data chunk pool stats
+    void mssn_chunk_pool_stats(mssn_chunk_stats_t *st);
+
     void mssn_sha1(const uint8_t *data, int data_len, uint8_t *digest);
 ]])
 local ret, mlib = nil, nil
@@ -100,15 +387,26 @@ do
 end
 local type = type
 local pairs = pairs
+local ipairs = ipairs
 local assert = assert
 local tonumber = tonumber
 local setmetatable = setmetatable
 local tbl_insert = table.insert
+local tbl_concat = table.concat
 local sfmt = string.format
 local math_min = math.min
 local ffi_str = FFI.string
 local ffi_copy = FFI.copy
+local ffi_gc = FFI.gc
 local sha1_buf = FFI.new("uint8_t[?]", 20)
+local zst_buf = FFI.new("mssn_deflate_stats_t")
+local bst_buf = FFI.new("mssn_bcast_stats_t")
+local blen_buf = FFI.new("size_t[1]")
+local dptr_buf = FFI.new("mssn_data_t *[1]")
+local iov_cap = 64
+local iov_buf = FFI.new("mssn_iovec_t[?]", iov_cap)
+local build_cap = 64 * 1024
+local build_buf = FFI.new("uint8_t[?]", build_cap)
 local Http1Session = { __tn = 'Http1Session', __tk = 'class', __st = nil }
 do
 	local __st = nil
@@ -124,17 +422,36 @@ do
 	__ct.STATE_ERROR = 5
 	function __ct:init(server, compress)
 		self._lib = mlib.mssn_create(server and 1 or 0)
-		self._data = ""
 		self._tbl = {  }
+		self._reclaim_next = false
+		self._hkept = nil
 		self._upgrade = false
 		self._state = Http1Session.STATE_INIT
+		self._compress = compress and true or false
+		mlib.mssn_setopt(self._lib, mlib.MSSN_OPT_BODY_ZERO_COPY, 1)
 		if compress then
-			self._zstream = ZlibStream()
-		else 
-			self._zstream = nil
+			mlib.mssn_setopt(self._lib, mlib.MSSN_OPT_WS_INFLATE, 1)
 		end
+		self._zstream = nil
+		self._ws_ext = nil
 		self._sec_key_raw = ""
 	end
+	function __ct:setDeflatePolicy(window_bits, mem_level, no_context_takeover, inflate_max)
+		if not (self._lib ~= nil) then
+			return false
+		end
+		if window_bits then
+			mlib.mssn_setopt(self._lib, mlib.MSSN_OPT_WS_WINDOW_BITS, window_bits)
+		end
+		if mem_level then
+			mlib.mssn_setopt(self._lib, mlib.MSSN_OPT_WS_MEM_LEVEL, mem_level)
+		end
+		mlib.mssn_setopt(self._lib, mlib.MSSN_OPT_WS_NO_CONTEXT_TAKEOVER, no_context_takeover and 1 or 0)
+		if inflate_max then
+			mlib.mssn_setopt(self._lib, mlib.MSSN_OPT_WS_INFLATE_MAX, inflate_max)
+		end
+		return true
+	end
 	function __ct:deinit()
 		self:closeSession()
 	end
@@ -161,8 +478,8 @@ do
 			return 
 		end
 		local http_resp = "HTTP/1.1 101 Web Socket Protocol Handshake" .. "\r\n"
-		if self._zstream ~= nil then
-			http_resp = http_resp .. "Sec-Websocket-Extensions: permessage-deflate; client_max_window_bits=15" .. "\r\n"
+		if self._ws_ext ~= nil then
+			http_resp = http_resp .. "Sec-Websocket-Extensions: " .. tostring(self._ws_ext) .. "\r\n"
 		end
 		http_resp = http_resp .. "Sec-Websocket-Accept: " .. tostring(base64_sec_key) .. "\r\n" .. "Upgrade: websocket" .. "\r\n" .. "Connection: Upgrade" .. "\r\n"
 		return http_resp
@@ -172,39 +489,38 @@ do
 			return -1, "[HSSN] Invalid params"
 		end
 		local _lib = self._lib
-		local nread, ret = 0, 0
-		data = self._data .. data
-		repeat
-			ret = tonumber(mlib.mssn_process(_lib, data, data:len()))
-			if ret > 0 then
-				nread = nread + ret
-				data = (data:len() > ret) and data:sub(ret + 1) or ""
+		if self._reclaim_next then
+			self._reclaim_next = false
+			if self._tbl.upgrade == 0 and _lib.state < Http1Session.STATE_FINISH then
+				self:_keepHeaders()
+			else 
+				self._hkept = nil
 			end
-		until (ret <= 0) or (data:len() <= 0)
-		self._data = data
+			mlib.mssn_reclaim(_lib, nil)
+		end
+		local nread = tonumber(mlib.mssn_process(_lib, data, data:len()))
+		if nread < 0 then
+			self._state = self.STATE_ERROR
+			return -1, "[HSSN] " .. ffi_str(_lib.error_msg)
+		end
+		local rest = nil
+		if nread < data:len() then
+			rest = data:sub(nread + 1)
+		end
 		local _tbl = self._tbl
-		if _lib.state >= self.STATE_HEADER and _tbl.headers == nil then
+		if _lib.state >= self.STATE_HEADER and _tbl.upgrade == nil then
 			if _lib.method == nil and _lib.path == nil then
 				_tbl.method = nil
 				_tbl.path = nil
 				_tbl.status = tonumber(_lib.status)
 			else 
 				_tbl.method = ffi_str(_lib.method)
-				_tbl.path = ffi_str(_lib.path)
+				_tbl.path = ffi_str(_lib.path, _lib.path_span.length)
 				_tbl.status = 0
 			end
 			_tbl.upgrade = tonumber(_lib.upgrade)
-			if _lib.headers ~= nil then
-				_tbl.headers = {  }
-				local hnode = _lib.headers
-				repeat
-					local hnext = hnode.next
-					_tbl.headers[ffi_str(hnode.key)] = ffi_str(hnode.value)
-					hnode = hnext
-				until hnode == nil
-			else 
-				_tbl.headers = nil
-			end
+			_tbl.headers = nil
+			self._hkept = nil
 		end
 		if not self._upgrade and _tbl.upgrade then
 			self._upgrade = true
@@ -216,11 +532,18 @@ do
 			repeat
 				local f = { ftype = self:_ftypeNumberToString(fnode.ftype), data = "" }
 				local dnode = fnode.data
-				repeat
-					f.data = f.data .. ffi_str(dnode.data, dnode.length)
-					dnode = dnode.next
-				until dnode == nil
-				if self._zstream ~= nil and f.data:len() > 0 then
+				if dnode ~= nil and dnode.next == nil then
+					f.data = ffi_str(dnode.data, dnode.length)
+				elseif dnode ~= nil then
+					local parts = {  }
+					repeat
+						tbl_insert(parts, ffi_str(dnode.data, dnode.length))
+						dnode = dnode.next
+					until dnode == nil
+					f.data = tbl_concat(parts)
+				end
+				if self._compress and not self._upgrade and f.data:len() > 0 then
+					self._zstream = self._zstream or ZlibStream()
 					local zret, zdata = self._zstream:inflate(f.data)
 					if zret then
 						f.data = zdata
@@ -235,36 +558,168 @@ do
 		else 
 			_tbl.frames = nil
 		end
+		self._state = _lib.state
 		if _lib.frames ~= nil then
-			mlib.mssn_reclaim(self._lib, nil)
+			self._reclaim_next = true
+			if _tbl.upgrade == 0 then
+				self._state = Http1Session.STATE_INIT
+			end
 		end
-		self._state = _lib.state
-		return nread, _tbl
+		return nread, _tbl, rest
+	end
+	function __ct:setDeflateBypass(min_size, probe)
+		if not (self._lib ~= nil) then
+			return false
+		end
+		if min_size then
+			mlib.mssn_setopt(self._lib, mlib.MSSN_OPT_WS_DEFLATE_MIN, min_size)
+		end
+		mlib.mssn_setopt(self._lib, mlib.MSSN_OPT_WS_DEFLATE_PROBE, probe and 1 or 0)
+		return true
+	end
+	function __ct:deflateStats()
+		if not (self._lib ~= nil) then
+			return 
+		end
+		mlib.mssn_deflate_stats(self._lib, zst_buf)
+		return { compressed = tonumber(zst_buf.compressed), compressed_in = tonumber(zst_buf.compressed_in), compressed_out = tonumber(zst_buf.compressed_out), skipped = tonumber(zst_buf.skipped), skipped_bytes = tonumber(zst_buf.skipped_bytes) }
+	end
+	function __ct:createZlibPool(window_bits, mem_level, capacity)
+		return mlib.mssn_zpool_create(window_bits or 15, mem_level or 8, capacity or 16, nil)
+	end
+	function __ct:destroyZlibPool(zpool)
+		if zpool ~= nil then
+			mlib.mssn_zpool_destroy(zpool)
+		end
+	end
+	function __ct:attachZlibPool(zpool)
+		if not (self._lib ~= nil) then
+			return false
+		end
+		self._zpool = zpool
+		return mlib.mssn_zpool_attach(self._lib, zpool) == 0
+	end
+	function __ct:createBroadcast(ftype, fsize, data, compress, window_bits)
+		ftype = self:_ftypeStringToNumber(ftype)
+		if not (ftype and type(fsize) == "number" and type(data) == "string") then
+			return nil
+		end
+		local rsv_bits = compress and mlib.MSSN_BUILD_DEFLATE or 0
+		local bcast = mlib.mssn_bcast_create(ftype, rsv_bits, fsize, data, data:len(), window_bits or 15, nil)
+		if not (bcast ~= nil) then
+			return nil
+		end
+		return ffi_gc(bcast, mlib.mssn_bcast_unref)
+	end
+	function __ct:broadcastFrames(bcast)
+		if not (self._lib ~= nil and bcast ~= nil) then
+			return false, "[HSSN] Invalid params"
+		end
+		local ptr = mlib.mssn_bcast_frames(self._lib, bcast, blen_buf)
+		if not (ptr ~= nil) then
+			return false, "[HSSN] " .. ffi_str(self._lib.error_msg)
+		end
+		return ffi_str(ptr, blen_buf[0])
+	end
+	function __ct:broadcastStats(bcast)
+		if not (bcast ~= nil) then
+			return 
+		end
+		mlib.mssn_bcast_stats(bcast, bst_buf)
+		return { refs = tonumber(bst_buf.refs), shared_bytes = tonumber(bst_buf.shared_bytes), sends = tonumber(bst_buf.sends), sends_deflated = tonumber(bst_buf.sends_deflated), dup_bytes = tonumber(bst_buf.dup_bytes) }
+	end
+	function __ct:headers()
+		local _tbl = self._tbl
+		if _tbl.headers == nil and self._lib ~= nil and self._lib.headers ~= nil then
+			_tbl.headers = {  }
+			local hnode = self._lib.headers
+			repeat
+				_tbl.headers[ffi_str(hnode.key, hnode.key_span.length)] = ffi_str(hnode.value, hnode.value_span.length)
+				hnode = hnode.next
+			until hnode == nil
+		end
+		return _tbl.headers
+	end
+	function __ct:headerValue(name)
+		local h = self:_headerNode(name)
+		if h ~= nil then
+			return ffi_str(h.value, h.value_span.length)
+		end
+		if self._hkept ~= nil then
+			return self:_keptValues(name)[1]
+		end
+	end
+	function __ct:headerValues(name)
+		if self._hkept ~= nil then
+			return self:_keptValues(name)
+		end
+		local out = {  }
+		local h = self:_headerNode(name)
+		while h ~= nil do
+			tbl_insert(out, ffi_str(h.value, h.value_span.length))
+			h = h.dup
+		end
+		return out
 	end
 	function __ct:secWebSocketKeyRaw()
 		return self._sec_key_raw
 	end
-	function __ct:_lowerValue(htbl, key)
-		local value = htbl.headers[key]
+	function __ct:_headerNode(name)
+		if not (self._lib ~= nil) then
+			return nil
+		end
+		if type(name) == "number" then
+			return mlib.mssn_header_get(self._lib, name)
+		elseif type(name) == "string" then
+			return mlib.mssn_header_find(self._lib, name, name:len())
+		end
+	end
+	function __ct:_keepHeaders()
+		if not (self._lib.headers ~= nil) then
+			return 
+		end
+		self:headers()
+		local kept = {  }
+		local hnode = self._lib.headers
+		repeat
+			tbl_insert(kept, { id = tonumber(hnode.id), key = ffi_str(hnode.key, hnode.key_span.length):lower(), value = ffi_str(hnode.value, hnode.value_span.length) })
+			hnode = hnode.next
+		until hnode == nil
+		self._hkept = kept
+	end
+	function __ct:_keptValues(name)
+		local out = {  }
+		local key = type(name) == "string" and name:lower() or nil
+		for _, h in ipairs(self._hkept) do
+			if (key and h.key == key) or (type(name) == "number" and name > 0 and h.id == name) then
+				tbl_insert(out, h.value)
+			end
+		end
+		return out
+	end
+	function __ct:_lowerValue(key)
+		local value = self:headerValue(key)
 		if type(value) == "string" then
 			return value:lower()
 		end
 		return ""
 	end
 	function __ct:_initWebSocket(htbl)
-		if not (self:_lowerValue(htbl, "Connection") == "upgrade" and self:_lowerValue(htbl, "Upgrade") == "websocket") then
+		if not (self:_lowerValue(mlib.MSSN_H_CONNECTION) == "upgrade" and self:_lowerValue(mlib.MSSN_H_UPGRADE) == "websocket") then
 			return 
 		end
 		if self._sec_key_raw:len() <= 0 then
-			local skey = htbl.headers['Sec-WebSocket-Key']
+			local skey = self:headerValue(mlib.MSSN_H_SEC_WEBSOCKET_KEY)
 			if type(skey) == "string" then
 				self._sec_key_raw = self:sha1(skey .. "258EAFA5-E914-47DA-95CA-C5AB0DC85B11")
 			end
 		end
-		if self._zstream == nil then
-			local encoding = self:_lowerValue(htbl, "Accept-Encoding")
-			if encoding:find("deflate") ~= nil or encoding:find("gzip") ~= nil then
-				self._zstream = ZlibStream()
+		local ext = self:headerValue(mlib.MSSN_H_SEC_WEBSOCKET_EXTENSIONS)
+		if type(ext) == "string" then
+			local ret = mlib.mssn_ws_negotiate(self._lib, ext, ext:len())
+			if ret ~= nil then
+				self._ws_ext = ffi_str(ret)
+				self._compress = true
 			end
 		end
 	end
@@ -313,36 +768,125 @@ do
 		if not (ftype) then
 			return false, "[HSSN] Invalid frame type"
 		end
-		if self._zstream ~= nil and data:len() > 0 then
-			local zret, zdata = self._zstream:deflate(data)
-			if zret then
-				data = zdata
-				rsv_bits = rsv_bits + 4
+		if self._compress and data:len() > 0 then
+			rsv_bits = rsv_bits + mlib.MSSN_BUILD_DEFLATE
+		end
+		local n = tonumber(mlib.mssn_build_into(self._lib, ftype, rsv_bits, fsize, data, data:len(), build_buf, build_cap))
+		if n > build_cap then
+			local head = mlib.mssn_build(self._lib, ftype, rsv_bits, fsize, data, data:len())
+			if not (head ~= nil) then
+				return false, ffi_str(self._lib.error_msg)
 			end
+			return true, self:_takeData(head)
 		end
-		local head = mlib.mssn_build(self._lib, ftype, rsv_bits, fsize, data, data:len())
-		if not (head ~= nil) then
+		if not (n >= 0) then
 			return false, ffi_str(self._lib.error_msg)
 		end
-		local ftbl = {  }
-		local it = head
-		repeat
-			local nit = it.next
-			tbl_insert(ftbl, ffi_str(it.data, it.length))
-			it = nit
-		until it == nil
-		mlib.mssn_reclaim(self._lib, head)
-		return true, ftbl
+		return true, { ffi_str(build_buf, n) }
+	end
+	function __ct:buildBegin(ftype, fsize, rsv_bits)
+		ftype = self:_ftypeStringToNumber(ftype)
+		if not (self._lib ~= nil and ftype and type(fsize) == "number") then
+			return false, "[HSSN] Invalid params"
+		end
+		rsv_bits = rsv_bits or 0
+		if self._compress then
+			rsv_bits = rsv_bits + mlib.MSSN_BUILD_DEFLATE
+		end
+		if not (mlib.mssn_build_begin(self._lib, ftype, rsv_bits, fsize) == 0) then
+			return false, ffi_str(self._lib.error_msg)
+		end
+		return true
+	end
+	function __ct:buildAppend(data)
+		if not (self._lib ~= nil and type(data) == "string") then
+			return false, "[HSSN] Invalid params"
+		end
+		if not (mlib.mssn_build_append(self._lib, data, data:len(), dptr_buf) == 0) then
+			return false, ffi_str(self._lib.error_msg)
+		end
+		return true, self:_takeData(dptr_buf[0])
+	end
+	function __ct:buildFinish()
+		if not (self._lib ~= nil) then
+			return false, "[HSSN] Invalid params"
+		end
+		if not (mlib.mssn_build_finish(self._lib, dptr_buf) == 0) then
+			return false, ffi_str(self._lib.error_msg)
+		end
+		return true, self:_takeData(dptr_buf[0])
+	end
+	function __ct:_takeData(dt)
+		local frames = {  }
+		local dnode = dt
+		while dnode ~= nil do
+			tbl_insert(frames, ffi_str(dnode.data, dnode.length))
+			dnode = dnode.next
+		end
+		if dt ~= nil then
+			mlib.mssn_reclaim(self._lib, dt)
+		end
+		return frames
+	end
+	function __ct:queueSend(data)
+		if not (self._lib ~= nil) then
+			return false
+		end
+		if type(data) == "table" then
+			for _, v in ipairs(data) do
+				if not (mlib.mssn_send_queue(self._lib, v, v:len()) == 0) then
+					return false
+				end
+			end
+			return true
+		end
+		return type(data) == "string" and mlib.mssn_send_queue(self._lib, data, data:len()) == 0
+	end
+	function __ct:queueBroadcast(bcast)
+		if not (self._lib ~= nil and bcast ~= nil) then
+			return false
+		end
+		return mlib.mssn_send_bcast(self._lib, bcast) == 0
+	end
+	function __ct:pendingBytes()
+		if not (self._lib ~= nil) then
+			return 0
+		end
+		return tonumber(mlib.mssn_send_pending(self._lib))
+	end
+	function __ct:flushSend()
+		if not (self._lib ~= nil) then
+			return ""
+		end
+		local out = {  }
+		while true do
+			local cnt = mlib.mssn_send_iov(self._lib, iov_buf, iov_cap)
+			if cnt <= 0 then
+				break
+			end
+			local nbytes = 0
+			for i = 0, cnt - 1 do
+				tbl_insert(out, ffi_str(iov_buf[i].iov_base, iov_buf[i].iov_len))
+				nbytes = nbytes + tonumber(iov_buf[i].iov_len)
+			end
+			mlib.mssn_send_consume(self._lib, nbytes)
+		end
+		return tbl_concat(out)
 	end
 	function __ct:reclaim(force)
 		if force or self._tbl.upgrade == 0 then
 			self._tbl.status = 0
 			self._tbl.method = nil
 			self._tbl.path = nil
+			self._tbl.upgrade = nil
 			self._tbl.headers = nil
+			self._hkept = nil
 		end
 		self._tbl.frames = nil
-		self._data = ""
+		if self._reclaim_next and self._lib ~= nil then
+			self._reclaim_next = false
+			mlib.mssn_reclaim(self._lib, nil)
+		end
 	end
 	function __ct:sha1(data)
 		mlib.mssn_sha1(data, data:len(), sha1_buf)
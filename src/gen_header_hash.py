@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2024 lalawue
+#
+# This library is free software; you can redistribute it and/or modify it
+# under the terms of the MIT license. See LICENSE for details.
+#
+# regenerate known header names and perfect hash tables in http1_session.c from
+# mssn_header_id in http1_session.h, run after adding names to the enum:
+#
+#   $ python3 src/gen_header_hash.py
+#
+# hash must match _hdr_hash: lowercase name in 8 bytes little-endian words,
+# tail zero padded, slot of name is (h >> 8) + disp[h & 15] * ((h >> 16) | 1)
+
+import os
+import re
+import sys
+
+DIR = os.path.dirname(os.path.abspath(__file__))
+HEADER = os.path.join(DIR, 'http1_session.h')
+SOURCE = os.path.join(DIR, 'http1_session.c')
+
+NBUCKET = 16
+NSLOT = 256
+M64 = (1 << 64) - 1
+
+
+def name_hash(name):
+    b = name.encode().lower()
+    h = (len(b) * 0x9e3779b97f4a7c15) & M64
+    for i in range(0, len(b), 8):
+        w = int.from_bytes(b[i:i + 8].ljust(8, b'\0'), 'little')
+        h = ((h ^ w) * 0xff51afd7ed558ccd) & M64
+        h ^= h >> 32
+    return h & 0xffffffff
+
+
+def slot_of(h, d):
+    return ((h >> 8) + d * ((h >> 16) | 1)) & (NSLOT - 1)
+
+
+def search(names):
+    """displacement per bucket, larger buckets placed first"""
+    buckets = {}
+    for n in names:
+        buckets.setdefault(name_hash(n) & (NBUCKET - 1), []).append(n)
+    disp = [0] * NBUCKET
+    used = set()
+    for g in sorted(buckets, key=lambda g: -len(buckets[g])):
+        for d in range(256):
+            slots = [slot_of(name_hash(n), d) for n in buckets[g]]
+            if len(set(slots)) == len(slots) and not (set(slots) & used):
+                disp[g] = d
+                used |= set(slots)
+                break
+        else:
+            return None
+    return disp
+
+
+def wrap(items, indent, width):
+    lines = []
+    cur = ''
+    for it in items:
+        if cur and len(indent) + len(cur) + 1 + len(it) > width:
+            lines.append(indent + cur)
+            cur = it
+        else:
+            cur = (cur + ' ' + it) if cur else it
+    lines.append(indent + cur)
+    return '\n'.join(lines)
+
+
+def render(names, disp):
+    slot = [0] * NSLOT
+    for i, n in enumerate(names):
+        s = slot_of(name_hash(n), disp[name_hash(n) & (NBUCKET - 1)])
+        assert slot[s] == 0
+        slot[s] = i + 1
+    lens = [0] + [len(n) for n in names]
+    out = ['/// names of mssn_header_id, perfect hash below generated from this list by gen_header_hash.py',
+           'static const char *const _hdr_names[MSSN_H_MAX] = {',
+           '    NULL,',
+           wrap(['"%s",' % n for n in names], '    ', 100),
+           '};',
+           '',
+           'static const uint8_t _hdr_disp[%d] = {%s};' % (NBUCKET, ', '.join(map(str, disp))),
+           '',
+           'static const uint8_t _hdr_slot[%d] = {' % NSLOT]
+    for r in range(0, NSLOT, 16):
+        out.append('    ' + ', '.join('%2d' % v for v in slot[r:r + 16]) + ',')
+    out += ['};', '', 'static const uint8_t _hdr_lens[MSSN_H_MAX] = {']
+    for r in range(0, len(lens), 16):
+        out.append('    ' + ', '.join('%2d' % v for v in lens[r:r + 16]) + ',')
+    out.append('};')
+    return '\n'.join(out) + '\n'
+
+
+def main():
+    names = re.findall(r'^\s+MSSN_H_\w+,\s*// (\S+)', open(HEADER).read(), re.M)
+    if len(names) >= 255:
+        sys.exit('too many names for uint8_t tables')
+    disp = search(names)
+    if disp is None:
+        sys.exit('no displacement found, change hash constants')
+    src = open(SOURCE).read()
+    begin = src.index('/// names of mssn_header_id')
+    end = src.index('};\n', src.index('static const uint8_t _hdr_lens')) + 3
+    open(SOURCE, 'w').write(src[:begin] + render(names, disp) + src[end:])
+    print('%d names, disp %s' % (len(names), disp))
+
+
+if __name__ == '__main__':
+    main()
@@ -9,14 +9,18 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <zlib.h>
 #include "http_parser.h"
 #include "m_prng.h"
+#include "m_simd.h"
 #include "http1_session.h"
 #include "WjCryptLib_Sha1.h"
 
 #if defined(__linux__) || defined(__FreeBSD__) || defined(__APPLE__)
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <sched.h>
+#include <strings.h>
 #endif
 
 /* For Mingw build */
@@ -25,6 +29,9 @@
 #endif
 
 const uint32_t _Z_DATA_LEN = 4 * 1024;
+const uint32_t _Z_ARENA_LEN = 4 * 1024;
+const int _Z_FRAME_CACHE = 16;
+const size_t _Z_INFLATE_MAX = 16 * 1024 * 1024;
 
 enum _opcode
 {
@@ -63,8 +70,40 @@ typedef struct
     uint8_t masking_key[4];
     uint64_t fr_pread; // frame payload readed
     int fr_stage;      // frame reading state, 0: head, 1: payload
+    uint8_t hbuf[14];  // header bytes splited by mssn_process calls
+    int hread;         // header bytes in hbuf
 } ws_t;
 
+typedef struct
+{
+    mssn_data_t dt;
+    int pooled;          // chunk from chunk pool
+    int cap;             // data capacity, 0 for data referencing outside
+    mssn_bcast_t *bcast; // reference held, data points into broadcast frames
+} zdata_t;
+
+typedef struct s_zarena_block
+{
+    struct s_zarena_block *next;
+    size_t size; // block capacity
+    size_t used; // bytes used
+    uint8_t data[];
+} zarena_block_t;
+
+typedef struct
+{
+    zarena_block_t *head; // first block, blocks were kept after reset
+    zarena_block_t *cur;  // block for allocating
+} zarena_t;
+
+/// open addressing slot of header index, by lowercase name hash
+typedef struct
+{
+    uint32_t hash;       // name hash
+    mssn_header_t *head; // first header of name, NULL for empty slot
+    mssn_header_t *tail; // last header of name, for chaining dup
+} hidx_slot_t;
+
 typedef enum
 {
     SESSION_STAGE_INIT = 0,
@@ -72,18 +111,81 @@ typedef enum
     SESSION_STAGE_WS = 2
 } session_stage_t;
 
+typedef enum
+{
+    HP_TOKEN_NONE = 0,
+    HP_TOKEN_URL,
+    HP_TOKEN_FIELD,
+    HP_TOKEN_VALUE
+} hp_token_t;
+
+/// permessage-deflate parameters
+typedef struct
+{
+    int in_bits;   // inflate window bits
+    int out_bits;  // max deflate window bits
+    int in_reset;  // peer no context takeover
+    int out_reset; // own no context takeover
+} zparam_t;
+
 typedef struct
 {
     int server;
+    int zero_copy;         // headers, path referencing input buffer
+    int body_zero_copy;    // HTTP body referencing input buffer
+    int ws_stream;         // output partial websocket message
+    int ws_inflate;        // inflate permessage-deflate message, from option
+    int ws_deflate;        // permessage-deflate negotiated, until reset
+    int ws_wbits;          // max window bits policy
+    int ws_memlevel;       // deflate memLevel policy
+    int ws_no_takeover;    // no context takeover policy
+    int ws_deflate_min;    // min message size for deflate
+    int ws_deflate_probe;  // probe incompressible message before deflate
+    size_t ws_inflate_max; // max inflated message bytes, 0 for unlimited
+    int za_custom;         // allocator from mssn_create_ex
+    mssn_allocator_t za;   // allocator
     prng_t rng;
     session_stage_t stage;
     http_parser hp;
     struct http_parser_settings hp_settings;
     ws_t ws;
+    zarena_t arena;              // per message headers, path
+    const char *hp_buf;          // buffer of current http_parser_execute
+    hp_token_t hp_token;         // last token callback, for appending splited token
     mssn_header_t *header_rlast; // last header for read, for append header value
     mssn_frame_t *frame_rlast;   // last frame for read, conjoin continuation frames
-    mssn_data_t *data_read;      // data for read, last data node
-    mssn_data_t *data_send;      // data for send
+    mssn_frame_t *frame_cread;   // frame for current payload, frame_rlast or control frame
+    mssn_frame_t *frame_wlast;   // last frame in mctx->frames
+    uint64_t msg_offset;         // payload output of frame_rlast, with ws_stream
+    int msg_deflate;             // frame_rlast was compressed with rsv1
+    const char *fail_msg;        // first error, process refused until reset
+    z_stream *zin;               // inflate stream
+    z_stream *zout;              // deflate stream
+    zparam_t zp;                 // negotiated permessage-deflate
+    mssn_deflate_stats_t zst;    // deflate counters
+    mssn_zpool_t *zpool;         // borrow streams without context takeover
+    int zin_pooled;              // zin from zpool
+    int zout_pooled;             // zout from zpool
+    char ext[160];               // negotiated extension value
+    mssn_frame_type out_ftype;   // message under mssn_build_begin, 0 for none
+    int out_rsv;                 // rsv bits of message
+    int out_deflate;             // message deflated incrementally
+    int out_nframe;              // frames emitted of message
+    size_t out_pcap;             // max payload per frame of message
+    uint64_t out_in;             // payload bytes appended
+    uint64_t out_zlen;           // deflated payload bytes emitted
+    mssn_data_t *out_pending;    // payload not emitted, after header room
+    mssn_data_t *data_send;      // outbound queue
+    mssn_data_t *send_last;      // last node of data_send
+    size_t send_off;             // bytes of data_send head written
+    size_t send_bytes;           // bytes queued not written
+    mssn_frame_t *frame_free;    // frame nodes for reusing
+    int frame_nfree;             // count of frame_free
+
+    hidx_slot_t *hidx;                    // header index in arena, power of 2 slots
+    int hidx_cap;                         // slots of hidx
+    int hidx_count;                       // distinct names in hidx
+    mssn_header_t *hdr_index[MSSN_H_MAX]; // first header of known id in headers
 } session_t;
 
 static inline uint64_t
@@ -116,24 +218,17 @@ _mctx(http_parser *hp)
 static unsigned int z_count = 0;
 
 static void *
-_zalloc(unsigned items, unsigned size)
+_zlibc_alloc(void *ud, size_t size)
 {
-    void *p = calloc(1, items * size + sizeof(int));
-    unsigned int *u = (unsigned int *)p;
-    z_count += items * size;
-    *u = items * size;
-    return (void *)(u + 1);
+    z_count += size;
+    return malloc(size);
 }
 
 static void
-_zfree(void *address)
+_zlibc_free(void *ud, void *address, size_t size)
 {
-    if (address)
-    {
-        unsigned int *u = ((unsigned int *)address - 1);
-        z_count -= *u;
-        free((void *)u);
-    }
+    z_count -= size;
+    free(address);
 }
 
 #define _Z_REPORT(TAG)                                   \
@@ -149,25 +244,45 @@ _zfree(void *address)
         printf("\n");                                        \
     } while (0)
 #else
+static void *
+_zlibc_alloc(void *ud, size_t size)
+{
+    return malloc(size);
+}
+
+static void
+_zlibc_free(void *ud, void *address, size_t size)
+{
+    free(address);
+}
+
+#define _Z_REPORT(TAG)
+#define _Z_DEBUG(FMT, ARGS...)
+#endif // _HTTP_1_SESSION_DEBUG_MEM_
+
+static const mssn_allocator_t _zlibc = {_zlibc_alloc, _zlibc_free, NULL};
+
+/// zero filled memory from session allocator
 static inline void *
-_zalloc(unsigned items, unsigned size)
+_zalloc(session_t *sctx, size_t size)
 {
-    return calloc(items, size);
+    void *p = sctx->za.alloc(sctx->za.ud, size);
+    if (p != NULL)
+    {
+        memset(p, 0, size);
+    }
+    return p;
 }
 
 static inline void
-_zfree(void *address)
+_zfree(session_t *sctx, void *address, size_t size)
 {
     if (address)
     {
-        free(address);
+        sctx->za.free(sctx->za.ud, address, size);
     }
 }
 
-#define _Z_REPORT(TAG)
-#define _Z_DEBUG(FMT, ARGS...)
-#endif // _HTTP_1_SESSION_DEBUG_MEM_
-
 static inline size_t
 _zmin(size_t x, size_t y)
 {
@@ -182,22 +297,324 @@ _zswap64(uint64_t x)
     return (u << 32) | l;
 }
 
+// MARK: - Chunk Pool
+
+/* process-wide pool for _Z_DATA_LEN data chunks, every thread keeps a small
+ * cache in front of the global list, the global list caches chunks up to
+ * high-water mark and returns the others to libc
+ */
+
+typedef struct s_zchunk
+{
+    struct s_zchunk *next;
+} zchunk_t;
+
+#define _Z_TCACHE_MAX 64 // chunks cached by one thread
+#define _Z_TCACHE_BATCH 32 // chunks moved between thread cache and global list
+
+static struct
+{
+    int lock;
+    zchunk_t *head;
+    size_t cached;
+    size_t high_water;
+    size_t allocated;
+    size_t thread_cached;
+    size_t hits;
+    size_t misses;
+    size_t released;
+} _zpool = {0, NULL, 0, 1024, 0, 0, 0, 0, 0};
+
+/* counters are size_t, uint64_t or int; gcc, clang and Mingw use the __atomic
+ * builtins, MSVC uses Interlocked functions with full barrier
+ */
+#if defined(_MSC_VER) && !defined(__clang__)
+#define _Z_ATOMIC_XADD(V, N)                                                     \
+    ((sizeof(V) == 8)                                                            \
+         ? (uint64_t)InterlockedExchangeAdd64((volatile LONG64 *)&(V), (LONG64)(N)) \
+         : (uint64_t)(uint32_t)InterlockedExchangeAdd((volatile LONG *)&(V), (LONG)(N)))
+#define _Z_ATOMIC_ADD(V, N) (_Z_ATOMIC_XADD(V, N) + (N))
+#define _Z_ATOMIC_SUB(V, N) (_Z_ATOMIC_XADD(V, 0 - (N)) - (N))
+#define _Z_ATOMIC_UNREF(V) (InterlockedDecrement((volatile LONG *)&(V)))
+#define _Z_ATOMIC_LOAD(V) _Z_ATOMIC_XADD(V, 0)
+#define _Z_ATOMIC_XCHG(V, N) InterlockedExchange((volatile LONG *)&(V), (N))
+#define _Z_ATOMIC_RELEASE(V) InterlockedExchange((volatile LONG *)&(V), 0)
+#else
+#define _Z_ATOMIC_ADD(V, N) __atomic_add_fetch(&(V), (N), __ATOMIC_RELAXED)
+#define _Z_ATOMIC_SUB(V, N) __atomic_sub_fetch(&(V), (N), __ATOMIC_RELAXED)
+#define _Z_ATOMIC_UNREF(V) __atomic_sub_fetch(&(V), 1, __ATOMIC_ACQ_REL)
+#define _Z_ATOMIC_LOAD(V) __atomic_load_n(&(V), __ATOMIC_RELAXED)
+#define _Z_ATOMIC_XCHG(V, N) __atomic_exchange_n(&(V), (N), __ATOMIC_ACQUIRE)
+#define _Z_ATOMIC_RELEASE(V) __atomic_store_n(&(V), 0, __ATOMIC_RELEASE)
+#endif
+
+/* spin with cpu pause hint, yield time slice when holder is descheduled */
+#if defined(_MSC_VER) && !defined(__clang__)
+#define _Z_CPU_PAUSE() YieldProcessor()
+#elif defined(__i386__) || defined(__x86_64__)
+#define _Z_CPU_PAUSE() __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define _Z_CPU_PAUSE() __asm__ __volatile__("yield")
+#else
+#define _Z_CPU_PAUSE() ((void)0)
+#endif
+
+#if defined(_WIN32) || defined(_WIN64)
+#define _Z_CPU_YIELD() SwitchToThread()
+#else
+#define _Z_CPU_YIELD() sched_yield()
+#endif
+
+#define _Z_SPIN_MAX 64
+
+static inline void
+_zpool_lock(void)
+{
+    int spin = 1;
+    while (_Z_ATOMIC_XCHG(_zpool.lock, 1))
+    {
+        while (_Z_ATOMIC_LOAD(_zpool.lock))
+        {
+            if (spin <= _Z_SPIN_MAX)
+            {
+                for (int i = 0; i < spin; i++)
+                {
+                    _Z_CPU_PAUSE();
+                }
+                spin <<= 1;
+            }
+            else
+            {
+                _Z_CPU_YIELD();
+            }
+        }
+    }
+}
+
+static inline void
+_zpool_unlock(void)
+{
+    _Z_ATOMIC_RELEASE(_zpool.lock);
+}
+
+static inline size_t
+_zchunk_size(void)
+{
+    return sizeof(zdata_t) + _Z_DATA_LEN;
+}
+
+/// push list into global list, release to libc over high-water
+static void
+_zpool_put_list(zchunk_t *head, size_t count)
+{
+    _zpool_lock();
+    while ((head != NULL) && (_zpool.cached < _zpool.high_water))
+    {
+        zchunk_t *tmp = head->next;
+        head->next = _zpool.head;
+        _zpool.head = head;
+        _zpool.cached += 1;
+        count -= 1;
+        head = tmp;
+    }
+    _zpool_unlock();
+
+    if (head != NULL)
+    {
+        _Z_ATOMIC_ADD(_zpool.released, count);
+        _Z_ATOMIC_SUB(_zpool.allocated, count);
+        while (head != NULL)
+        {
+            zchunk_t *tmp = head->next;
+            free(head);
+            head = tmp;
+        }
+    }
+}
+
+/// pop at most count chunks from global list
+static zchunk_t *
+_zpool_get_list(size_t count, size_t *out_count)
+{
+    zchunk_t *head = NULL;
+    size_t n = 0;
+    _zpool_lock();
+    while ((_zpool.head != NULL) && (n < count))
+    {
+        zchunk_t *tmp = _zpool.head->next;
+        _zpool.head->next = head;
+        head = _zpool.head;
+        _zpool.head = tmp;
+        n += 1;
+    }
+    _zpool.cached -= n;
+    _zpool_unlock();
+    *out_count = n;
+    return head;
+}
+
+#if defined(__linux__) || defined(__FreeBSD__) || defined(__APPLE__)
+#include <pthread.h>
+#define _Z_TCACHE 1
+
+static __thread zchunk_t *_tc_head = NULL;
+static __thread size_t _tc_count = 0;
+static __thread int _tc_registered = 0;
+static pthread_key_t _tc_key;
+static pthread_once_t _tc_once = PTHREAD_ONCE_INIT;
+
+/// flush thread cache when thread exit
+static void
+_tc_flush(void *unused)
+{
+    _tc_registered = 0;
+    if (_tc_head != NULL)
+    {
+        _Z_ATOMIC_SUB(_zpool.thread_cached, _tc_count);
+        _zpool_put_list(_tc_head, _tc_count);
+        _tc_head = NULL;
+        _tc_count = 0;
+    }
+}
+
+static void
+_tc_key_init(void)
+{
+    pthread_key_create(&_tc_key, _tc_flush);
+}
+
+static inline void
+_tc_register(void)
+{
+    if (!_tc_registered)
+    {
+        pthread_once(&_tc_once, _tc_key_init);
+        pthread_setspecific(_tc_key, &_tc_head);
+        _tc_registered = 1;
+    }
+}
+#else
+/* Windows and others without pthread keys: chunks go to the global list */
+#endif // thread cache
+
+static mssn_data_t *
+_zchunk_alloc(session_t *sctx)
+{
+    if (sctx->za_custom)
+    {
+        // bypass process-wide pool
+        zdata_t *zd = (zdata_t *)sctx->za.alloc(sctx->za.ud, _zchunk_size());
+        if (zd == NULL)
+        {
+            return NULL;
+        }
+        memset(zd, 0, sizeof(zdata_t));
+        zd->dt.data = (uint8_t *)(zd + 1);
+        zd->cap = _Z_DATA_LEN;
+        return &zd->dt;
+    }
+
+    zchunk_t *c = NULL;
+#ifdef _Z_TCACHE
+    if (_tc_head == NULL)
+    {
+        size_t n = 0;
+        _tc_head = _zpool_get_list(_Z_TCACHE_BATCH, &n);
+        _tc_count = n;
+        _Z_ATOMIC_ADD(_zpool.thread_cached, n);
+        _tc_register();
+    }
+    if (_tc_head != NULL)
+    {
+        c = _tc_head;
+        _tc_head = c->next;
+        _tc_count -= 1;
+        _Z_ATOMIC_SUB(_zpool.thread_cached, 1);
+    }
+#else
+    size_t n = 0;
+    c = _zpool_get_list(1, &n);
+#endif
+
+    if (c != NULL)
+    {
+        _Z_ATOMIC_ADD(_zpool.hits, 1);
+    }
+    else
+    {
+        c = (zchunk_t *)malloc(_zchunk_size());
+        if (c == NULL)
+        {
+            return NULL;
+        }
+        _Z_ATOMIC_ADD(_zpool.misses, 1);
+        _Z_ATOMIC_ADD(_zpool.allocated, 1);
+    }
+
+    zdata_t *zd = (zdata_t *)c;
+    zd->dt.length = 0;
+    zd->dt.next = NULL;
+    zd->dt.data = (uint8_t *)(zd + 1);
+    zd->pooled = 1;
+    zd->cap = _Z_DATA_LEN;
+    zd->bcast = NULL;
+    return &zd->dt;
+}
+
+static void
+_zchunk_free(mssn_data_t *dt)
+{
+    zchunk_t *c = (zchunk_t *)dt;
+#ifdef _Z_TCACHE
+    c->next = _tc_head;
+    _tc_head = c;
+    _tc_count += 1;
+    _Z_ATOMIC_ADD(_zpool.thread_cached, 1);
+    if (_tc_count > _Z_TCACHE_MAX)
+    {
+        // move batch to global list
+        zchunk_t *head = _tc_head;
+        zchunk_t *last = head;
+        for (int i = 1; i < _Z_TCACHE_BATCH; i++)
+        {
+            last = last->next;
+        }
+        _tc_head = last->next;
+        last->next = NULL;
+        _tc_count -= _Z_TCACHE_BATCH;
+        _Z_ATOMIC_SUB(_zpool.thread_cached, _Z_TCACHE_BATCH);
+        _zpool_put_list(head, _Z_TCACHE_BATCH);
+    }
+    else
+    {
+        _tc_register();
+    }
+#else
+    c->next = NULL;
+    _zpool_put_list(c, 1);
+#endif
+}
+
+// MARK: - Data
+
 static mssn_data_t *
-_zdata_alloc(const uint8_t *data, int data_len)
+_zdata_alloc(session_t *sctx, const uint8_t *data, int data_len)
 {
     if (data_len <= 0)
     {
         return NULL;
     }
 
-    mssn_data_t *dt = (mssn_data_t *)_zalloc(1, sizeof(mssn_data_t) + data_len);
-    if (dt == NULL)
+    zdata_t *zd = (zdata_t *)_zalloc(sctx, sizeof(zdata_t) + data_len);
+    if (zd == NULL)
     {
         return NULL;
     }
+    zd->cap = data_len;
 
+    mssn_data_t *dt = &zd->dt;
     dt->length = data_len;
-    dt->data = ((uint8_t *)dt) + sizeof(mssn_data_t);
+    dt->data = (uint8_t *)(zd + 1);
 
     //_Z_DEBUG("data alloc %p, %p", dt, dt->data);
 
@@ -209,32 +626,187 @@ _zdata_alloc(const uint8_t *data, int data_len)
     return dt;
 }
 
+/// data node referencing input buffer without copy
+static mssn_data_t *
+_zdata_ref(session_t *sctx, const uint8_t *data, int data_len)
+{
+    if (data_len <= 0)
+    {
+        return NULL;
+    }
+    zdata_t *zd = (zdata_t *)_zalloc(sctx, sizeof(zdata_t));
+    if (zd == NULL)
+    {
+        return NULL;
+    }
+    zd->dt.length = data_len;
+    zd->dt.data = (uint8_t *)data;
+    return &zd->dt;
+}
+
 static void
-_zdata_free(mssn_data_t *dt)
+_zdata_free(session_t *sctx, mssn_data_t *dt)
 {
     while (dt != NULL)
     {
         mssn_data_t *tmp = dt->next;
-        _zfree(dt);
+        zdata_t *zd = (zdata_t *)dt;
+        if (zd->bcast != NULL)
+        {
+            mssn_bcast_unref(zd->bcast);
+            _zfree(sctx, zd, sizeof(zdata_t));
+        }
+        else if (zd->pooled)
+        {
+            _zchunk_free(dt);
+        }
+        else
+        {
+            _zfree(sctx, zd, sizeof(zdata_t) + zd->cap);
+        }
         dt = tmp;
     }
 }
 
+static mssn_frame_t *
+_zframe_alloc(session_t *sctx)
+{
+    mssn_frame_t *fr = sctx->frame_free;
+    if (fr != NULL)
+    {
+        sctx->frame_free = fr->next;
+        sctx->frame_nfree -= 1;
+        memset(fr, 0, sizeof(mssn_frame_t));
+        return fr;
+    }
+    return (mssn_frame_t *)_zalloc(sctx, sizeof(mssn_frame_t));
+}
+
+/// free frames data, keep frame nodes for next message
 static void
-_zframe_free(mssn_frame_t *fr)
+_zframe_free(session_t *sctx, mssn_frame_t *fr)
 {
     while (fr != NULL)
     {
         mssn_frame_t *tmp = fr->next;
-        _zdata_free(fr->data_head);
-        _zfree(fr);
+        _zdata_free(sctx, fr->data_head);
+        if (sctx->frame_nfree < _Z_FRAME_CACHE)
+        {
+            fr->next = sctx->frame_free;
+            sctx->frame_free = fr;
+            sctx->frame_nfree += 1;
+        }
+        else
+        {
+            _zfree(sctx, fr, sizeof(mssn_frame_t));
+        }
         fr = tmp;
     }
 }
 
+// MARK: - Arena
+
+static void *
+_zarena_alloc(session_t *sctx, size_t size)
+{
+    zarena_t *za = &sctx->arena;
+    size = (size + 7) & ~((size_t)7);
+
+    zarena_block_t *b = za->cur;
+    while ((b != NULL) && (b->used + size > b->size))
+    {
+        b = b->next;
+        if (b != NULL)
+        {
+            // blocks after cursor were left from last message
+            b->used = 0;
+        }
+    }
+
+    if (b == NULL)
+    {
+        size_t bsize = (size > _Z_ARENA_LEN) ? size : _Z_ARENA_LEN;
+        b = (zarena_block_t *)_zalloc(sctx, sizeof(zarena_block_t) + bsize);
+        if (b == NULL)
+        {
+            return NULL;
+        }
+        b->size = bsize;
+        if (za->head == NULL)
+        {
+            za->head = b;
+        }
+        else
+        {
+            // append after last block
+            zarena_block_t *last = (za->cur != NULL) ? za->cur : za->head;
+            while (last->next != NULL)
+            {
+                last = last->next;
+            }
+            last->next = b;
+        }
+    }
+
+    za->cur = b;
+    void *p = b->data + b->used;
+    b->used += size;
+    memset(p, 0, size);
+    return p;
+}
+
+static char *
+_zarena_strdup(session_t *sctx, const char *at, size_t length)
+{
+    char *str = (char *)_zarena_alloc(sctx, length + 1);
+    if (str != NULL)
+    {
+        memcpy(str, at, length);
+    }
+    return str;
+}
+
+/// reset in O(1), keep blocks for next message
+static void
+_zarena_reset(session_t *sctx)
+{
+    zarena_t *za = &sctx->arena;
+    if (za->head != NULL)
+    {
+        za->head->used = 0;
+    }
+    za->cur = za->head;
+}
+
+static void
+_zarena_free(session_t *sctx)
+{
+    zarena_t *za = &sctx->arena;
+    zarena_block_t *b = za->head;
+    while (b != NULL)
+    {
+        zarena_block_t *tmp = b->next;
+        _zfree(sctx, b, sizeof(zarena_block_t) + b->size);
+        b = tmp;
+    }
+    za->head = NULL;
+    za->cur = NULL;
+}
+
 static void _hp_init(mssn_t *);
+static void _hp_reset(mssn_t *);
 static void _hp_fini(mssn_t *);
+static int _hp_detach(mssn_t *);
 static void _ws_init(mssn_t *);
+static z_stream *_ws_zout(session_t *);
+static void _ws_zparam(session_t *, const zparam_t *);
+static void _ws_zin_release(session_t *);
+static void _ws_zout_release(session_t *);
+static void _ws_zfini(session_t *);
+static void _ws_out_fini(session_t *);
+static void _send_fini(session_t *);
+static int _ws_inflate(mssn_t *, mssn_frame_t *, int);
+static int _ws_process(mssn_t *, const uint8_t *, int);
 static void _ws_fini(mssn_t *);
 static int _ws_opcode(int);
 static int _ws_ftype(int);
@@ -246,14 +818,49 @@ static void _ws_genmask(session_t *sctx, uint8_t *buf);
 mssn_t *
 mssn_create(int server)
 {
-    mssn_t *mctx = (mssn_t *)_zalloc(1, sizeof(mssn_t));
-    session_t *sctx = (session_t *)_zalloc(1, sizeof(session_t));
+    return mssn_create_ex(server, NULL);
+}
+
+mssn_t *
+mssn_create_ex(int server, const mssn_allocator_t *allocator)
+{
+    const mssn_allocator_t *za = allocator ? allocator : &_zlibc;
+    if ((za->alloc == NULL) || (za->free == NULL))
+    {
+        return NULL;
+    }
+
+    mssn_t *mctx = (mssn_t *)za->alloc(za->ud, sizeof(mssn_t));
+    session_t *sctx = (session_t *)za->alloc(za->ud, sizeof(session_t));
+    if ((mctx == NULL) || (sctx == NULL))
+    {
+        if (mctx)
+        {
+            za->free(za->ud, mctx, sizeof(mssn_t));
+        }
+        if (sctx)
+        {
+            za->free(za->ud, sctx, sizeof(session_t));
+        }
+        return NULL;
+    }
+    memset(mctx, 0, sizeof(mssn_t));
+    memset(sctx, 0, sizeof(session_t));
+
+    sctx->za = *za;
+    sctx->za_custom = (allocator != NULL);
     sctx->server = server;
     if (!server)
     {
         prng_init(&sctx->rng);
     }
     sctx->stage = SESSION_STAGE_INIT;
+    sctx->ws_wbits = 15;
+    sctx->ws_memlevel = 8;
+    sctx->ws_deflate_min = 64;
+    sctx->ws_deflate_probe = 1;
+    sctx->ws_inflate_max = _Z_INFLATE_MAX;
+    _ws_zparam(sctx, NULL);
     mctx->opaque = sctx;
     _hp_init(mctx);
     return mctx;
@@ -262,621 +869,3419 @@ mssn_create(int server)
 void mssn_close(mssn_t *mctx)
 {
     session_t *sctx = _sctx(mctx);
-    if (sctx != NULL && sctx->stage != SESSION_STAGE_INIT)
+    if (sctx != NULL)
     {
         sctx->stage = SESSION_STAGE_INIT;
         mssn_reclaim(mctx, NULL);
         _hp_fini(mctx);
         _ws_fini(mctx);
-        _zfree(mctx->opaque);
+        _ws_out_fini(sctx);
+        _send_fini(sctx);
+        _ws_zfini(sctx);
+        _zarena_free(sctx);
+        while (sctx->frame_free != NULL)
+        {
+            mssn_frame_t *fr = sctx->frame_free;
+            sctx->frame_free = fr->next;
+            _zfree(sctx, fr, sizeof(mssn_frame_t));
+        }
+        mssn_allocator_t za = sctx->za;
         mctx->opaque = NULL;
-        _zfree(mctx);
+        za.free(za.ud, sctx, sizeof(session_t));
+        za.free(za.ud, mctx, sizeof(mssn_t));
     }
     _Z_REPORT("mssn_close");
 }
 
-/** Web Socket Header
- 0               1               2               3
- 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
-+-+-+-+-+-------+-+-------------+-------------------------------+
-|F|R|R|R| opcode|M| Payload len |    Extended payload length    |
-|I|S|S|S|  (4)  |A|     (7)     |             (16/64)           |
-|N|V|V|V|       |S|             |   (if payload len==126/127)   |
-| |1|2|3|       |K|             |                               |
-+-+-+-+-+-------+-+-------------+ - - - - - - - - - - - - - - - +
-|     Extended payload length continued, if payload len == 127  |
-+ - - - - - - - - - - - - - - - +-------------------------------+
-|                               |Masking-key, if MASK set to 1  |
-+-------------------------------+-------------------------------+
-| Masking-key (continued)       |          Payload Data         |
-+-------------------------------- - - - - - - - - - - - - - - - +
-:                     Payload Data continued ...                :
-+ - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - +
-|                     Payload Data continued ...                |
-+---------------------------------------------------------------+
-*/
-int mssn_process(mssn_t *mctx, const uint8_t *buf, int buf_len)
+void mssn_reset(mssn_t *mctx)
 {
-    //_Z_DEBUG("enter params %p, %p, %d", mctx, buf, buf_len);
-
     session_t *sctx = _sctx(mctx);
-    if ((sctx == NULL) || (buf == NULL) || (buf_len <= 0))
+    if (sctx == NULL)
     {
-        _Z_DEBUG("invalid param");
-        return -1;
+        return;
+    }
+    // clear headers even in websocket stage
+    sctx->stage = SESSION_STAGE_INIT;
+    mssn_reclaim(mctx, NULL);
+    _ws_fini(mctx);
+    _ws_out_fini(sctx);
+    _send_fini(sctx);
+    memset(&sctx->ws, 0, sizeof(ws_t));
+    memset(&sctx->zst, 0, sizeof(mssn_deflate_stats_t));
+    // negotiated extension belongs to last connection, options were kept
+    sctx->ws_deflate = 0;
+    sctx->ext[0] = '\0';
+    _ws_zparam(sctx, NULL);
+    if (sctx->zin_pooled)
+    {
+        _ws_zin_release(sctx);
+    }
+    else if (sctx->zin != NULL)
+    {
+        inflateReset(sctx->zin);
+    }
+    if (sctx->zout_pooled)
+    {
+        _ws_zout_release(sctx);
+    }
+    else if (sctx->zout != NULL)
+    {
+        deflateReset(sctx->zout);
     }
+    mctx->upgrade = 0;
+    mctx->state = MSSN_STATE_INIT;
+    sctx->fail_msg = NULL;
+    _hp_reset(mctx);
+    _Z_REPORT("mssn_reset");
+}
 
-    int nread = 0;
+// MARK: - Session Pool
 
-    // http stage
+struct s_mssn_pool
+{
+    int server;
+    int za_custom;
+    mssn_allocator_t za;
+    int capacity; // max idle sessions
+    int count;    // idle sessions
+    mssn_t **idle;
+};
 
-    if (sctx->stage == SESSION_STAGE_INIT || sctx->stage == SESSION_STAGE_HTTP)
+mssn_pool_t *
+mssn_pool_create(int server, int capacity, const mssn_allocator_t *allocator)
+{
+    const mssn_allocator_t *za = allocator ? allocator : &_zlibc;
+    if ((capacity <= 0) || (za->alloc == NULL) || (za->free == NULL))
     {
-        nread = http_parser_execute(&sctx->hp, &sctx->hp_settings, (const char *)buf, buf_len);
-        if ((mctx->error_msg == NULL) && (sctx->hp.http_errno == 0))
-        {
-            _Z_DEBUG("http nread %d", nread);
-            return nread;
-        }
-        else
-        {
-            if (mctx->error_msg == NULL)
-            {
-                mctx->error_msg = http_errno_name(sctx->hp.http_errno);
-            }
-            _Z_DEBUG("http err msg: %s", mctx->error_msg);
-            return -1;
-        }
+        return NULL;
     }
 
-    // web socket stage
-
-    ws_t *ws = &sctx->ws;
+    mssn_pool_t *pool = (mssn_pool_t *)za->alloc(za->ud, sizeof(mssn_pool_t));
+    if (pool == NULL)
+    {
+        return NULL;
+    }
+    memset(pool, 0, sizeof(mssn_pool_t));
+    pool->idle = (mssn_t **)za->alloc(za->ud, capacity * sizeof(mssn_t *));
+    if (pool->idle == NULL)
+    {
+        za->free(za->ud, pool, sizeof(mssn_pool_t));
+        return NULL;
+    }
+    pool->server = server;
+    pool->za = *za;
+    pool->za_custom = (allocator != NULL);
+    pool->capacity = capacity;
 
-    // read whole frame header at once
-    if (ws->fr_stage == 0)
+    // pre-initialized sessions
+    while (pool->count < capacity)
     {
-        int hlen = 2;
-        if (buf_len < hlen)
+        mssn_t *mctx = mssn_create_ex(server, pool->za_custom ? &pool->za : NULL);
+        if (mctx == NULL)
         {
-            _Z_DEBUG("buf_len < 2");
-            return 0;
+            break;
         }
+        pool->idle[pool->count++] = mctx;
+    }
+    return pool;
+}
 
-        _Z_DEBUG("head hex 0x%02x 0x%02x", buf[0], buf[1]);
+void mssn_pool_destroy(mssn_pool_t *pool)
+{
+    if (pool == NULL)
+    {
+        return;
+    }
+    while (pool->count > 0)
+    {
+        mssn_close(pool->idle[--pool->count]);
+    }
+    mssn_allocator_t za = pool->za;
+    za.free(za.ud, pool->idle, pool->capacity * sizeof(mssn_t *));
+    za.free(za.ud, pool, sizeof(mssn_pool_t));
+}
 
-        ws->h1.fin = buf[0] >> 7;
-        ws->h1.rsv1 = (0x40 & buf[0]) >> 6;
-        ws->h1.rsv2 = (0x20 & buf[0]) >> 5;
-        ws->h1.rsv3 = (0x10 & buf[0]) >> 4;
-        ws->h1.opcode = 0xF & buf[0];
+mssn_t *
+mssn_pool_get(mssn_pool_t *pool)
+{
+    if (pool == NULL)
+    {
+        return NULL;
+    }
+    if (pool->count > 0)
+    {
+        return pool->idle[--pool->count];
+    }
+    return mssn_create_ex(pool->server, pool->za_custom ? &pool->za : NULL);
+}
 
-        ws->h2.mask = (0x80 & buf[1]) >> 7;
-        ws->h2.plen = 0x7F & buf[1];
+void mssn_pool_put(mssn_pool_t *pool, mssn_t *mctx)
+{
+    if ((pool == NULL) || (mctx == NULL))
+    {
+        return;
+    }
+    if (pool->count >= pool->capacity)
+    {
+        mssn_close(mctx);
+        return;
+    }
+    mssn_reset(mctx);
+    pool->idle[pool->count++] = mctx;
+}
 
-        if (ws->h2.mask == 1)
-        {
-            hlen += 4;
-        }
+int mssn_setopt(mssn_t *mctx, mssn_option_t opt, int value)
+{
+    session_t *sctx = _sctx(mctx);
+    if (sctx == NULL)
+    {
+        return -1;
+    }
 
-        if (ws->h2.plen == 127)
-        {
-            hlen += 8;
-        }
-        else if (ws->h2.plen == 126)
+    switch (opt)
+    {
+    case MSSN_OPT_ZERO_COPY:
+        sctx->zero_copy = !!value;
+        return 0;
+    case MSSN_OPT_WS_STREAM:
+        sctx->ws_stream = !!value;
+        return 0;
+    case MSSN_OPT_WS_INFLATE:
+        sctx->ws_inflate = !!value;
+        return 0;
+    case MSSN_OPT_WS_WINDOW_BITS:
+        if ((value < 9) || (value > 15))
         {
-            hlen += 2;
+            break;
         }
-
-        // read whole header at once
-        if (buf_len < hlen)
+        sctx->ws_wbits = value;
+        return 0;
+    case MSSN_OPT_WS_MEM_LEVEL:
+        if ((value < 1) || (value > 9))
         {
-            _Z_DEBUG("buf_len:%d < hlen:%d", buf_len, hlen);
-            return 0;
+            break;
         }
-
-        if (ws->h2.mask && sctx->server)
+        sctx->ws_memlevel = value;
+        return 0;
+    case MSSN_OPT_WS_NO_CONTEXT_TAKEOVER:
+        sctx->ws_no_takeover = !!value;
+        return 0;
+    case MSSN_OPT_WS_DEFLATE_MIN:
+        if (value < 0)
         {
-            memcpy(ws->masking_key, buf + hlen - 4, 4);
-            _Z_DEBUG("masking 4 bytes 0x%02x 0x%02x 0x%02x 0x%02x", ws->masking_key[0], ws->masking_key[1], ws->masking_key[2], ws->masking_key[3]);
+            break;
         }
-        else if (ws->h2.mask != !!sctx->server)
+        sctx->ws_deflate_min = value;
+        return 0;
+    case MSSN_OPT_WS_DEFLATE_PROBE:
+        sctx->ws_deflate_probe = !!value;
+        return 0;
+    case MSSN_OPT_BODY_ZERO_COPY:
+        sctx->body_zero_copy = !!value;
+        return 0;
+    case MSSN_OPT_WS_INFLATE_MAX:
+        if (value < 0)
         {
-            mctx->error_msg = "masking-key not match";
-            _Z_DEBUG("masking-key not match");
-            return -1;
+            break;
         }
+        sctx->ws_inflate_max = (size_t)value;
+        return 0;
+    }
 
-        if (ws->h2.plen == 127)
-        {
-            ws->u.plen64 = _zswap64(*((uint64_t *)(buf + 2)));
-        }
-        else if (ws->h2.plen == 126)
-        {
-            ws->u.plen64 = ntohs(*((uint16_t *)(buf + 2)));
-        }
+    mctx->error_msg = "invalid option";
+    return -1;
+}
 
-        ws->fr_pread = 0;
-        ws->fr_stage = 1;
+// MARK: - Extension
 
-        nread += hlen;
-        buf_len -= hlen;
+/// permessage-deflate offer or response, bits 0 for absent, -1 for no value
+typedef struct
+{
+    int server_no_takeover;
+    int client_no_takeover;
+    int server_bits;
+    int client_bits;
+} ext_param_t;
 
-        _Z_DEBUG("hlen %d, opcode:%x, fin:%d, plen:%ld", hlen, ws->h1.opcode, ws->h1.fin, _fr_plen(ws));
+static void
+_ext_trim(const char **b, const char **e)
+{
+    while ((*b < *e) && ((**b == ' ') || (**b == '\t')))
+    {
+        (*b)++;
     }
-
-    // read frame payload
-    while (buf_len > 0 || ws->h1.fin)
+    while ((*e > *b) && ((*(*e - 1) == ' ') || (*(*e - 1) == '\t')))
     {
-        if (sctx->frame_rlast == NULL)
-        {
-            mssn_frame_t *fr = _zalloc(1, sizeof(mssn_frame_t));
-            fr->ftype = _ws_ftype(ws->h1.opcode);
-            fr->data_head = _zdata_alloc(NULL, _Z_DATA_LEN);
-            fr->data_head->length = 0;
-
-            sctx->frame_rlast = fr;
-            sctx->data_read = fr->data_head;
-        }
-
-        mssn_data_t *dt = sctx->data_read;
-        if (dt->length == _Z_DATA_LEN)
-        {
-            dt = _zdata_alloc(NULL, _Z_DATA_LEN);
-            dt->length = 0;
-            sctx->data_read->next = dt;
-            sctx->data_read = dt;
-        }
-
-        if (buf_len > 0)
-        {
-
-            size_t mlen = _zmin(_zmin(_Z_DATA_LEN - dt->length, buf_len),
-                                _fr_plen(ws) - ws->fr_pread);
-
-            _Z_DEBUG("before mem copying, mlen %ld, buf_len %d", mlen, buf_len);
-
-            if (ws->h2.mask)
-            {
-                _Z_DEBUG("masking mem copying");
-                for (int i = 0; i < mlen; i++)
-                    dt->data[dt->length + i] = buf[nread + i] ^ ws->masking_key[(ws->fr_pread + i) % 4];
-            }
-            else
-            {
-                _Z_DEBUG("no masking mem copying");
-                memcpy(dt->data + dt->length, buf + nread, mlen);
-            }
-
-            nread += mlen;
-            dt->length += mlen;
-            ws->fr_pread += mlen;
-            buf_len -= mlen;
-        }
+        (*e)--;
+    }
+}
 
-        // if reach playload end
-        if (_fr_plen(ws) == ws->fr_pread)
+/// position of sep outside quoted string, or end
+static const char *
+_ext_next(const char *p, const char *end, char sep)
+{
+    int quoted = 0;
+    for (; p < end; p++)
+    {
+        if (*p == '"')
         {
-            ws->fr_stage = 0;
-            if (ws->h1.fin)
-            {
-                //_dt_dump(sctx->frame_rlast->data_head);
-                _zframe_free(mctx->frames);
-                mctx->frames = sctx->frame_rlast;
-                sctx->frame_rlast = NULL;
-                sctx->data_read = NULL;
-                break;
-            }
+            quoted = !quoted;
         }
-        else if (ws->h1.fin)
+        else if ((*p == sep) && !quoted)
         {
-            // should never reach here
             break;
         }
     }
-
-    return nread;
+    return p;
 }
 
-mssn_data_t *
-mssn_build(mssn_t *mctx,
-           mssn_frame_type ftype,
-           int rsv_bits,
-           size_t frame_size,
-           const uint8_t *buf,
-           size_t buf_len)
+/// window bits value, 8 ~ 15, -1 for no value, 0 for invalid
+static int
+_ext_bits(const char *b, const char *e)
 {
-    session_t *sctx = _sctx(mctx);
-
-    // invalid params
-    if ((sctx == NULL) || (frame_size <= 0))
+    if (b >= e)
     {
-        mctx->error_msg = "invalid params";
-        return NULL;
+        return -1;
     }
-
-    // invalid frame type
-    if ((ftype < WS_FRAME_PING) || (ftype > WS_FRAME_BINARY))
+    if ((e - b >= 2) && (*b == '"') && (*(e - 1) == '"'))
     {
-        mctx->error_msg = "invalid frame type";
-        return NULL;
+        b++;
+        e--;
     }
-
-    if ((ftype == WS_FRAME_TEXT || ftype == WS_FRAME_BINARY) && (buf == NULL || buf_len <= 0))
+    int bits = 0;
+    if ((e - b < 1) || (e - b > 2) || (*b == '0'))
     {
-        mctx->error_msg = "invalid params";
-        return NULL;
+        return 0;
     }
-
-    // only support one control frame at one call, with payload size <= 125
-    if ((ftype >= WS_FRAME_PING) && ((ftype <= WS_FRAME_CLOSE) && (buf_len > 125)))
+    for (; b < e; b++)
     {
-        mctx->error_msg = "control frame require buf_len <= 125";
-        return NULL;
+        if ((*b < '0') || (*b > '9'))
+        {
+            return 0;
+        }
+        bits = bits * 10 + (*b - '0');
     }
+    return ((bits >= 8) && (bits <= 15)) ? bits : 0;
+}
 
-    int masking = !sctx->server;
-    int hlen = 2 + (masking ? 4 : 0);
+/// parse extension element [b, e), return 0 for valid permessage-deflate
+static int
+_ext_parse(const char *b, const char *e, ext_param_t *ep)
+{
+    memset(ep, 0, sizeof(ext_param_t));
 
-    if (_zmin(buf_len, (frame_size - hlen)) <= 125)
-    {
-        // 7 bits payload
-    }
-    else if (_zmin(buf_len, (frame_size - hlen - 2)) <= (1 << 16))
+    const char *n = _ext_next(b, e, ';');
+    const char *ne = n;
+    _ext_trim(&b, &ne);
+    if ((ne - b != 18) || (strncasecmp(b, "permessage-deflate", 18) != 0))
     {
-        hlen += 2; // 16 bits payload
-    }
-    else if (_zmin(buf_len, (frame_size - hlen - 8)) < (1ull << 63))
-    {
-        hlen += 8; // 64 bits payload
-    }
-    else
-    {
-        mctx->error_msg = "invalid payload length";
-        return NULL; // invalid payload length
+        return -1;
     }
 
-    _Z_DEBUG("build ftype:%d, hlen: %d, masking %d", ftype, hlen, masking);
-
-    mssn_data_t *head = NULL;
-    mssn_data_t *last = NULL;
-    int is_ctrl = (ftype == WS_FRAME_PING) || (ftype == WS_FRAME_PONG) || (ftype == WS_FRAME_CLOSE);
-
-    for (int bi = 0; (buf_len > 0) || (is_ctrl); bi++)
+    while (n < e)
     {
-        const size_t plen = _zmin(buf_len, frame_size - hlen);
+        const char *pb = n + 1;
+        n = _ext_next(pb, e, ';');
+        const char *vb = _ext_next(pb, n, '=');
+        const char *pe = vb;
+        const char *ve = n;
+        _ext_trim(&pb, &pe);
+        vb = (vb < n) ? (vb + 1) : n;
+        _ext_trim(&vb, &ve);
 
-        mssn_data_t *dt = _zdata_alloc(NULL, hlen + plen);
-        if (head == NULL)
+        int *flag = NULL;
+        int *bits = NULL;
+        size_t plen = pe - pb;
+        if ((plen == 26) && (strncasecmp(pb, "server_no_context_takeover", 26) == 0))
         {
-            head = dt;
-            last = dt;
+            flag = &ep->server_no_takeover;
         }
-        else
+        else if ((plen == 26) && (strncasecmp(pb, "client_no_context_takeover", 26) == 0))
         {
-            last->next = dt;
-            last = dt;
+            flag = &ep->client_no_takeover;
         }
-
-        const int fin = plen <= buf_len;
-
-        dt->data[0] |= (fin << 7) & 0x80;
-        dt->data[0] |= (rsv_bits & 0x7) << 4;
-        if ((bi == 0) || fin)
+        else if ((plen == 22) && (strncasecmp(pb, "server_max_window_bits", 22) == 0))
         {
-            dt->data[0] |= _ws_opcode(ftype) & 0xF;
+            bits = &ep->server_bits;
         }
-        else
+        else if ((plen == 22) && (strncasecmp(pb, "client_max_window_bits", 22) == 0))
         {
-            dt->data[0] |= _WS_CONTINUATION_FRAME;
+            bits = &ep->client_bits;
         }
-
-        dt->data[1] |= (masking << 7) & 0x80;
-        if (plen <= 125)
+        else
         {
-            dt->data[1] |= plen & 0x7F;
+            return -1; // unknown parameter
         }
-        else if (plen < (1 << 16))
+
+        if (flag != NULL)
         {
-            dt->data[1] |= 126;
-            uint16_t tmp_len = htons((uint16_t)plen);
-            memcpy(dt->data + 2, &tmp_len, 2);
+            if (*flag || (vb < ve))
+            {
+                return -1; // duplicated, or with value
+            }
+            *flag = 1;
         }
         else
         {
-            dt->data[1] |= 127;
-            uint64_t tmp_len = _zswap64(plen);
-            memcpy(dt->data + 2, &tmp_len, 8);
+            int v = _ext_bits(vb, ve);
+            if (*bits || (v == 0))
+            {
+                return -1; // duplicated, or invalid value
+            }
+            *bits = v;
         }
+    }
+    return 0;
+}
+
+static const char *
+_ext_format(session_t *sctx, const ext_param_t *ep)
+{
+    snprintf(sctx->ext,
+             sizeof(sctx->ext),
+             "permessage-deflate%s%s",
+             ep->server_no_takeover ? "; server_no_context_takeover" : "",
+             ep->client_no_takeover ? "; client_no_context_takeover" : "");
+    size_t n = strlen(sctx->ext);
+    if (ep->server_bits > 0)
+    {
+        n += snprintf(sctx->ext + n, sizeof(sctx->ext) - n, "; server_max_window_bits=%d", ep->server_bits);
+    }
+    if (ep->client_bits > 0)
+    {
+        snprintf(sctx->ext + n, sizeof(sctx->ext) - n, "; client_max_window_bits=%d", ep->client_bits);
+    }
+    return sctx->ext;
+}
 
-        if (buf_len <= 0)
+/// server accepts first acceptable offer
+static const char *
+_ext_accept(session_t *sctx, const char *b, const char *e)
+{
+    while (b < e)
+    {
+        const char *n = _ext_next(b, e, ',');
+        ext_param_t of;
+        if (_ext_parse(b, n, &of) < 0)
         {
-            break;
+            b = n + 1;
+            continue;
         }
+        b = n + 1;
 
-        _Z_DEBUG("build index %d: plen %ld, buf_len %ld", bi, plen, buf_len);
+        // offered server_max_window_bits requires value, zlib deflate window >= 9
+        if ((of.server_bits < 0) || ((of.server_bits > 0) && (of.server_bits < 9)))
+        {
+            continue;
+        }
 
-        if (masking)
+        zparam_t zp;
+        zp.out_bits = sctx->ws_wbits;
+        if ((of.server_bits > 0) && (of.server_bits < zp.out_bits))
         {
-            uint8_t maskey[4];
-            _ws_genmask(sctx, maskey);
-            memcpy(dt->data + hlen - 4, maskey, 4);
-            for (int i = 0; i < plen; i++)
-            {
-                dt->data[hlen + i] = buf[i] ^ maskey[i % 4];
-            }
+            zp.out_bits = of.server_bits;
         }
-        else
+        zp.in_bits = 15;
+        if (of.client_bits != 0)
         {
-            memcpy(dt->data + hlen, buf, plen);
+            // client supports client_max_window_bits, limit its window
+            zp.in_bits = sctx->ws_wbits;
+            if ((of.client_bits > 0) && (of.client_bits < zp.in_bits))
+            {
+                zp.in_bits = of.client_bits;
+            }
         }
+        zp.out_reset = of.server_no_takeover || sctx->ws_no_takeover;
+        zp.in_reset = of.client_no_takeover || sctx->ws_no_takeover;
 
-        buf += plen;
-        buf_len -= plen;
-    }
+        ext_param_t rp;
+        rp.server_no_takeover = zp.out_reset;
+        rp.client_no_takeover = zp.in_reset;
+        rp.server_bits = (of.server_bits > 0) ? zp.out_bits : 0;
+        rp.client_bits = (zp.in_bits < 15) ? zp.in_bits : 0;
 
-    return head;
+        _ws_zparam(sctx, &zp);
+        sctx->ws_deflate = 1;
+        return _ext_format(sctx, &rp);
+    }
+    return NULL;
 }
 
-void mssn_reclaim(mssn_t *mctx, mssn_data_t *data_build)
+/// client applies server response
+static const char *
+_ext_apply(mssn_t *mctx, const char *b, const char *e)
 {
     session_t *sctx = _sctx(mctx);
-    mctx->opaque = sctx;
-    mctx->error_msg = NULL;
-
-    if (data_build)
+    ext_param_t rp;
+    if ((_ext_next(b, e, ',') != e) || (_ext_parse(b, e, &rp) < 0) ||
+        (rp.server_bits < 0) || (rp.client_bits < 0) || ((rp.client_bits > 0) && (rp.client_bits < 9)))
     {
-        _zdata_free(data_build);
-        return;
+        mctx->error_msg = "invalid extension response";
+        return NULL;
     }
 
-    // clear frames
-    _zframe_free(mctx->frames);
-    _zframe_free(sctx->frame_rlast);
-    mctx->frames = NULL;
+    zparam_t zp;
+    zp.in_bits = (rp.server_bits > 0) ? rp.server_bits : 15;
+    zp.out_bits = (rp.client_bits > 0) ? rp.client_bits : 15;
+    zp.in_reset = rp.server_no_takeover;
+    zp.out_reset = rp.client_no_takeover || sctx->ws_no_takeover;
+
+    _ws_zparam(sctx, &zp);
+    sctx->ws_deflate = 1;
+    return _ext_format(sctx, &rp);
+}
+
+void mssn_deflate_stats(mssn_t *mctx, mssn_deflate_stats_t *st)
+{
+    session_t *sctx = _sctx(mctx);
+    if ((sctx != NULL) && (st != NULL))
+    {
+        *st = sctx->zst;
+    }
+}
+
+const char *
+mssn_ws_negotiate(mssn_t *mctx, const char *value, int value_len)
+{
+    session_t *sctx = _sctx(mctx);
+    if ((sctx == NULL) || (value == NULL) || (value_len <= 0))
+    {
+        if (mctx)
+        {
+            mctx->error_msg = "invalid params";
+        }
+        return NULL;
+    }
+    if (sctx->server)
+    {
+        return _ext_accept(sctx, value, value + value_len);
+    }
+    return _ext_apply(mctx, value, value + value_len);
+}
+
+/** Web Socket Header
+ 0               1               2               3
+ 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
++-+-+-+-+-------+-+-------------+-------------------------------+
+|F|R|R|R| opcode|M| Payload len |    Extended payload length    |
+|I|S|S|S|  (4)  |A|     (7)     |             (16/64)           |
+|N|V|V|V|       |S|             |   (if payload len==126/127)   |
+| |1|2|3|       |K|             |                               |
++-+-+-+-+-------+-+-------------+ - - - - - - - - - - - - - - - +
+|     Extended payload length continued, if payload len == 127  |
++ - - - - - - - - - - - - - - - +-------------------------------+
+|                               |Masking-key, if MASK set to 1  |
++-------------------------------+-------------------------------+
+| Masking-key (continued)       |          Payload Data         |
++-------------------------------- - - - - - - - - - - - - - - - +
+:                     Payload Data continued ...                :
++ - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - +
+|                     Payload Data continued ...                |
++---------------------------------------------------------------+
+*/
+/// enter error state, drop frames under reading, return -1
+static int
+_process_fail(mssn_t *mctx)
+{
+    session_t *sctx = _sctx(mctx);
+    if (sctx->frame_cread != sctx->frame_rlast)
+    {
+        _zframe_free(sctx, sctx->frame_cread);
+    }
+    _zframe_free(sctx, sctx->frame_rlast);
     sctx->frame_rlast = NULL;
+    sctx->frame_cread = NULL;
+    sctx->msg_offset = 0;
+    sctx->ws.fr_stage = 0;
+    sctx->ws.hread = 0;
+    sctx->fail_msg = mctx->error_msg;
+    mctx->state = MSSN_STATE_ERROR;
+    return -1;
+}
 
-    _zdata_free(sctx->data_send);
-    sctx->data_send = NULL;
-    sctx->data_read = NULL; // free in sctx->frame_rlast
+int mssn_process(mssn_t *mctx, const uint8_t *buf, int buf_len)
+{
+    //_Z_DEBUG("enter params %p, %p, %d", mctx, buf, buf_len);
+
+    session_t *sctx = _sctx(mctx);
+    if ((sctx == NULL) || (buf == NULL) || (buf_len <= 0))
+    {
+        _Z_DEBUG("invalid param");
+        return -1;
+    }
+
+    if (mctx->state == MSSN_STATE_ERROR)
+    {
+        // stream position lost, never resume parsing
+        mctx->error_msg = sctx->fail_msg;
+        return -1;
+    }
+    // left by setopt or build
+    mctx->error_msg = NULL;
+
+    int nread = 0;
+
+    // http stage
+
+    if (sctx->stage == SESSION_STAGE_INIT || sctx->stage == SESSION_STAGE_HTTP)
+    {
+        sctx->hp_buf = (const char *)buf;
+        nread = http_parser_execute(&sctx->hp, &sctx->hp_settings, (const char *)buf, buf_len);
+        if (sctx->zero_copy && (mctx->state < MSSN_STATE_HEADER) && (_hp_detach(mctx) < 0) &&
+            (mctx->error_msg == NULL))
+        {
+            // buffer will be gone before headers complete
+            mctx->error_msg = "alloc header failed";
+        }
+        if ((mctx->error_msg != NULL) || (sctx->hp.http_errno != 0))
+        {
+            if (mctx->error_msg == NULL)
+            {
+                mctx->error_msg = http_errno_name(sctx->hp.http_errno);
+            }
+            _Z_DEBUG("http err msg: %s", mctx->error_msg);
+            return _process_fail(mctx);
+        }
+
+        _Z_DEBUG("http nread %d", nread);
+        if ((sctx->stage != SESSION_STAGE_WS) || (nread >= buf_len))
+        {
+            return nread;
+        }
+        // upgraded, following data were websocket frames
+    }
+
+    // web socket stage
+
+    int ret = _ws_process(mctx, buf + nread, buf_len - nread);
+    return (ret < 0) ? _process_fail(mctx) : (nread + ret);
+}
+
+/// websocket header length for payload length
+static int
+_ws_build_hlen(size_t plen, int masking)
+{
+    int hlen = 2 + (masking ? 4 : 0);
+    if (plen > 125)
+    {
+        hlen += (plen < (1 << 16)) ? 2 : 8;
+    }
+    return hlen;
+}
+
+/// encode websocket header without masking key, return header length
+static int
+_ws_encode_header(uint8_t *p, size_t plen, int fin, int rsv_bits, int opcode, int masking)
+{
+    p[0] = ((fin << 7) & 0x80) | ((rsv_bits & 0x7) << 4) | (opcode & 0xF);
+    p[1] = (masking << 7) & 0x80;
+    if (plen <= 125)
+    {
+        p[1] |= plen & 0x7F;
+    }
+    else if (plen < (1 << 16))
+    {
+        p[1] |= 126;
+        uint16_t tmp_len = htons((uint16_t)plen);
+        memcpy(p + 2, &tmp_len, 2);
+    }
+    else
+    {
+        p[1] |= 127;
+        uint64_t tmp_len = _zswap64(plen);
+        memcpy(p + 2, &tmp_len, 8);
+    }
+    return _ws_build_hlen(plen, masking);
+}
+
+/// write websocket header right before payload, then mask payload in place, NULL sctx for unmasked
+static void
+_ws_write_header(session_t *sctx, uint8_t *payload, size_t plen, int fin, int rsv_bits, int opcode)
+{
+    int masking = (sctx != NULL) && !sctx->server;
+    _ws_encode_header(payload - _ws_build_hlen(plen, masking), plen, fin, rsv_bits, opcode, masking);
+
+    if (masking)
+    {
+        uint8_t maskey[4];
+        _ws_genmask(sctx, maskey);
+        memcpy(payload - 4, maskey, 4);
+        simd_mask(payload, payload, plen, maskey, 0);
+    }
+}
+
+/// build frames without compression
+static mssn_data_t *
+_ws_build_plain(mssn_t *mctx,
+                mssn_frame_type ftype,
+                int rsv_bits,
+                size_t pcap,
+                const uint8_t *buf,
+                size_t buf_len)
+{
+    session_t *sctx = _sctx(mctx);
+    int masking = !sctx->server;
+    int is_ctrl = (ftype == WS_FRAME_PING) || (ftype == WS_FRAME_PONG) || (ftype == WS_FRAME_CLOSE);
+
+    mssn_data_t *head = NULL;
+    mssn_data_t *last = NULL;
+
+    for (int bi = 0; (buf_len > 0) || (is_ctrl); bi++)
+    {
+        const size_t plen = _zmin(buf_len, pcap);
+        const int hlen = _ws_build_hlen(plen, masking);
+
+        mssn_data_t *dt = _zdata_alloc(sctx, NULL, hlen + plen);
+        if (dt == NULL)
+        {
+            _zdata_free(sctx, head);
+            mctx->error_msg = "alloc frame data failed";
+            return NULL;
+        }
+        if (head == NULL)
+        {
+            head = dt;
+            last = dt;
+        }
+        else
+        {
+            last->next = dt;
+            last = dt;
+        }
+
+        if (plen > 0)
+        {
+            memcpy(dt->data + hlen, buf, plen);
+        }
+
+        _Z_DEBUG("build index %d: plen %ld, buf_len %ld", bi, plen, buf_len);
+
+        const int fin = plen >= buf_len;
+        _ws_write_header(sctx,
+                         dt->data + hlen,
+                         plen,
+                         fin,
+                         rsv_bits,
+                         (bi == 0) ? _ws_opcode(ftype) : _WS_CONTINUATION_FRAME);
+
+        if (fin)
+        {
+            break;
+        }
+
+        buf += plen;
+        buf_len -= plen;
+    }
+
+    return head;
+}
+
+/// probe sampled bytes, high distinct byte count hints compressed or random data
+static int
+_ws_compressible(const uint8_t *buf, size_t buf_len)
+{
+    const size_t span = 64;
+    uint32_t seen[8] = {0};
+    size_t n = 0;
+    int distinct = 0;
+    if (buf_len < span)
+    {
+        return 1; // too few samples, left to MSSN_OPT_WS_DEFLATE_MIN
+    }
+
+    // whole buffer, or 4 spans evenly spaced
+    const size_t step = (buf_len <= 4 * span) ? span : (buf_len - span) / 3;
+    for (size_t off = 0; (off < buf_len) && (n < 4 * span); off += step)
+    {
+        const size_t end = _zmin(off + span, buf_len);
+        for (size_t i = off; i < end; i++, n++)
+        {
+            const uint8_t c = buf[i];
+            if (!(seen[c >> 5] & (1u << (c & 31))))
+            {
+                seen[c >> 5] |= 1u << (c & 31);
+                distinct++;
+            }
+        }
+    }
+    return (size_t)distinct * 2 <= n;
+}
+
+/// small or incompressible message goes out uncompressed with rsv1 clear
+static int
+_ws_deflate_wanted(session_t *sctx, const uint8_t *buf, size_t buf_len)
+{
+    return (buf_len >= (size_t)sctx->ws_deflate_min) && (!sctx->ws_deflate_probe || _ws_compressible(buf, buf_len));
+}
+
+/// deflate() failed with stream state unknown, release it; with context takeover the
+/// history shared with peer was lost, session failed as by process error
+static void
+_ws_zout_fail(mssn_t *mctx)
+{
+    session_t *sctx = _sctx(mctx);
+    const int takeover = !sctx->zp.out_reset;
+    _ws_zout_release(sctx);
+    mctx->error_msg = "deflate error";
+    if (takeover)
+    {
+        _process_fail(mctx);
+    }
+}
+
+/// sync flushed output of total bytes starting at first: strip 00 00 ff ff, keep single 00
+/// for empty block, output kept length; return 1 for no gain when stream resets per message,
+/// the output never referenced later so message goes out uncompressed
+static int
+_ws_deflate_tail(uint8_t *first, size_t total, size_t msg_len, int reset, size_t *keep)
+{
+    *keep = (total > 4) ? (total - 4) : 0;
+    if (reset && (*keep >= msg_len))
+    {
+        return 1;
+    }
+    if (*keep <= 0)
+    {
+        first[0] = 0;
+        *keep = 1;
+    }
+    return 0;
+}
+
+/// deflate buf into frames, payload placed after max header room
+static mssn_data_t *
+_ws_build_deflate(mssn_t *mctx,
+                  mssn_frame_type ftype,
+                  int rsv_bits,
+                  size_t pcap,
+                  const uint8_t *buf,
+                  size_t buf_len)
+{
+    session_t *sctx = _sctx(mctx);
+    z_stream *zs = _ws_zout(sctx);
+    if (zs == NULL)
+    {
+        mctx->error_msg = "deflate init error";
+        return NULL;
+    }
+
+    const uint8_t *msg = buf;
+    const size_t msg_len = buf_len;
+
+    const int hmax = _ws_build_hlen(pcap, !sctx->server);
+    mssn_data_t *head = NULL;
+    mssn_data_t *last = NULL;
+    size_t total = 0;
+
+    zs->avail_in = 0;
+    zs->avail_out = 0;
+    for (;;)
+    {
+        if ((zs->avail_in == 0) && (buf_len > 0))
+        {
+            // avail_in was uInt
+            const size_t n = _zmin(buf_len, (size_t)1 << 30);
+            zs->next_in = (Bytef *)buf;
+            zs->avail_in = (uInt)n;
+            buf += n;
+            buf_len -= n;
+        }
+        // sync flush requires avail_out > 6, or repeats flush marker
+        if ((zs->avail_out == 0) || ((buf_len <= 0) && (zs->avail_out <= 6)))
+        {
+            mssn_data_t *dt = _zdata_alloc(sctx, NULL, hmax + pcap);
+            if (dt == NULL)
+            {
+                // input consumed by stream, fresh stream stays decodable by peer
+                _zdata_free(sctx, head);
+                _ws_zout_release(sctx);
+                mctx->error_msg = "alloc frame data failed";
+                return NULL;
+            }
+            dt->data += hmax;
+            dt->length = 0;
+            if (head == NULL)
+            {
+                head = dt;
+            }
+            else
+            {
+                last->next = dt;
+            }
+            last = dt;
+            zs->next_out = dt->data;
+            zs->avail_out = (uInt)pcap;
+        }
+
+        const uInt avail_out = zs->avail_out;
+        const int ret = deflate(zs, (buf_len > 0) ? Z_NO_FLUSH : Z_SYNC_FLUSH);
+        if ((ret != Z_OK) && (ret != Z_BUF_ERROR))
+        {
+            _Z_DEBUG("deflate error %d", ret);
+            _zdata_free(sctx, head);
+            _ws_zout_fail(mctx);
+            return NULL;
+        }
+        last->length += avail_out - zs->avail_out;
+        total += avail_out - zs->avail_out;
+
+        if ((buf_len <= 0) && (zs->avail_in == 0) && (zs->avail_out > 0))
+        {
+            break; // flushed
+        }
+    }
+
+    size_t keep = 0;
+    if (_ws_deflate_tail(head->data, total, msg_len, sctx->zp.out_reset, &keep))
+    {
+        _zdata_free(sctx, head);
+        _ws_zout_release(sctx);
+        mssn_data_t *plain = _ws_build_plain(mctx, ftype, rsv_bits & 0x3, pcap, msg, msg_len);
+        if (plain != NULL)
+        {
+            sctx->zst.skipped++;
+            sctx->zst.skipped_bytes += msg_len;
+        }
+        return plain;
+    }
+    const size_t zlen = keep;
+    for (mssn_data_t *dt = head; dt != NULL; dt = dt->next)
+    {
+        dt->length = (int)_zmin((size_t)dt->length, keep);
+        keep -= dt->length;
+        if (keep <= 0)
+        {
+            _zdata_free(sctx, dt->next);
+            dt->next = NULL;
+        }
+    }
+
+    int bi = 0;
+    for (mssn_data_t *dt = head; dt != NULL; dt = dt->next, bi++)
+    {
+        const size_t plen = dt->length;
+        const int hlen = _ws_build_hlen(plen, !sctx->server);
+        _ws_write_header(sctx,
+                         dt->data,
+                         plen,
+                         dt->next == NULL,
+                         (bi == 0) ? (rsv_bits | 0x4) : (rsv_bits & ~0x4),
+                         (bi == 0) ? _ws_opcode(ftype) : _WS_CONTINUATION_FRAME);
+        dt->data -= hlen;
+        dt->length += hlen;
+    }
+
+    sctx->zst.compressed++;
+    sctx->zst.compressed_in += msg_len;
+    sctx->zst.compressed_out += zlen;
+    if (sctx->zp.out_reset)
+    {
+        // no context takeover, idle session keeps no deflate state
+        _ws_zout_release(sctx);
+    }
+
+    _Z_DEBUG("build deflate frames %d, total %ld", bi, total);
+    return head;
+}
+
+/// check build params, output max payload per frame
+static int
+_ws_build_check(mssn_t *mctx,
+                mssn_frame_type ftype,
+                size_t frame_size,
+                const uint8_t *buf,
+                size_t buf_len,
+                size_t *pcap)
+{
+    session_t *sctx = _sctx(mctx);
+
+    // invalid params
+    if ((sctx == NULL) || (frame_size <= 0))
+    {
+        mctx->error_msg = "invalid params";
+        return -1;
+    }
+
+    // invalid frame type
+    if ((ftype < WS_FRAME_PING) || (ftype > WS_FRAME_BINARY))
+    {
+        mctx->error_msg = "invalid frame type";
+        return -1;
+    }
+
+    if ((ftype == WS_FRAME_TEXT || ftype == WS_FRAME_BINARY) && (buf == NULL || buf_len <= 0))
+    {
+        mctx->error_msg = "invalid params";
+        return -1;
+    }
+
+    // only support one control frame at one call, with payload size <= 125
+    if ((ftype >= WS_FRAME_PING) && ((ftype <= WS_FRAME_CLOSE) && (buf_len > 125)))
+    {
+        mctx->error_msg = "control frame require buf_len <= 125";
+        return -1;
+    }
+
+    // control frames may interleave message under mssn_build_begin
+    if ((sctx->out_ftype != 0) && (ftype == WS_FRAME_TEXT || ftype == WS_FRAME_BINARY))
+    {
+        mctx->error_msg = "message building not finished";
+        return -1;
+    }
+
+    // max payload per frame, header shrinks with payload length
+    const int hframe = _ws_build_hlen(frame_size, !sctx->server);
+    if (frame_size <= (size_t)hframe)
+    {
+        mctx->error_msg = "invalid frame size";
+        return -1;
+    }
+    *pcap = frame_size - hframe;
+    return 0;
+}
+
+mssn_data_t *
+mssn_build(mssn_t *mctx,
+           mssn_frame_type ftype,
+           int rsv_bits,
+           size_t frame_size,
+           const uint8_t *buf,
+           size_t buf_len)
+{
+    session_t *sctx = _sctx(mctx);
+    size_t pcap = 0;
+    if (_ws_build_check(mctx, ftype, frame_size, buf, buf_len, &pcap) < 0)
+    {
+        return NULL;
+    }
+
+    int is_ctrl = (ftype == WS_FRAME_PING) || (ftype == WS_FRAME_PONG) || (ftype == WS_FRAME_CLOSE);
+
+    _Z_DEBUG("build ftype:%d, pcap: %ld, masking %d", ftype, pcap, !sctx->server);
+
+    if ((rsv_bits & MSSN_BUILD_DEFLATE) && !is_ctrl)
+    {
+        if (pcap <= 6)
+        {
+            mctx->error_msg = "invalid frame size";
+            return NULL;
+        }
+        if (_ws_deflate_wanted(sctx, buf, buf_len))
+        {
+            return _ws_build_deflate(mctx, ftype, rsv_bits & 0x7, pcap, buf, buf_len);
+        }
+        sctx->zst.skipped++;
+        sctx->zst.skipped_bytes += buf_len;
+        return _ws_build_plain(mctx, ftype, rsv_bits & 0x3, pcap, buf, buf_len);
+    }
+    return _ws_build_plain(mctx, ftype, rsv_bits & 0x7, pcap, buf, buf_len);
+}
+
+/// bytes of frames without compression
+static size_t
+_ws_plain_size(size_t pcap, size_t buf_len, int masking)
+{
+    const size_t nfull = buf_len / pcap;
+    const size_t rest = buf_len % pcap;
+    size_t n = nfull * (_ws_build_hlen(pcap, masking) + pcap);
+    if ((rest > 0) || (nfull == 0))
+    {
+        n += _ws_build_hlen(rest, masking) + rest;
+    }
+    return n;
+}
+
+/// write frames of payload at src into out, src may overlap behind out, NULL sctx for unmasked
+static size_t
+_ws_into_frames(session_t *sctx,
+                mssn_frame_type ftype,
+                int rsv_bits,
+                int deflated,
+                size_t pcap,
+                const uint8_t *src,
+                size_t src_len,
+                uint8_t *out)
+{
+    uint8_t *dst = out;
+    for (int bi = 0;; bi++)
+    {
+        const size_t plen = _zmin(src_len, pcap);
+        const int hlen = _ws_build_hlen(plen, (sctx != NULL) && !sctx->server);
+        const int fin = plen >= src_len;
+        int rsv = rsv_bits;
+        if (deflated)
+        {
+            rsv = (bi == 0) ? (rsv_bits | 0x4) : (rsv_bits & ~0x4);
+        }
+        if (plen > 0)
+        {
+            memmove(dst + hlen, src, plen);
+        }
+        _ws_write_header(sctx, dst + hlen, plen, fin, rsv, (bi == 0) ? _ws_opcode(ftype) : _WS_CONTINUATION_FRAME);
+        dst += hlen + plen;
+        src += plen;
+        src_len -= plen;
+        if (fin)
+        {
+            break;
+        }
+    }
+    return dst - out;
+}
+
+/// deflate with sync flush into out of deflate bound, output total bytes
+static int
+_ws_deflate_contig(z_stream *zs, const uint8_t *buf, size_t buf_len, uint8_t *out, size_t out_len, size_t *total)
+{
+    *total = 0;
+    zs->avail_in = 0;
+    zs->avail_out = 0;
+    for (;;)
+    {
+        // avail_in, avail_out was uInt
+        if ((zs->avail_in == 0) && (buf_len > 0))
+        {
+            const size_t n = _zmin(buf_len, (size_t)1 << 30);
+            zs->next_in = (Bytef *)buf;
+            zs->avail_in = (uInt)n;
+            buf += n;
+            buf_len -= n;
+        }
+        if (zs->avail_out == 0)
+        {
+            const size_t n = _zmin(out_len, (size_t)1 << 30);
+            zs->next_out = out;
+            zs->avail_out = (uInt)n;
+            out += n;
+            out_len -= n;
+        }
+
+        const uInt avail_out = zs->avail_out;
+        const int ret = deflate(zs, (buf_len > 0) ? Z_NO_FLUSH : Z_SYNC_FLUSH);
+        if ((ret != Z_OK) && (ret != Z_BUF_ERROR))
+        {
+            _Z_DEBUG("deflate error %d", ret);
+            return -1;
+        }
+        *total += avail_out - zs->avail_out;
+
+        if ((buf_len <= 0) && (zs->avail_in == 0) && (zs->avail_out > 0))
+        {
+            break; // flushed
+        }
+    }
+    return 0;
+}
+
+/// deflate into out after header room of max frames, then move payload forward between headers
+static int64_t
+_ws_into_deflate(mssn_t *mctx,
+                 mssn_frame_type ftype,
+                 int rsv_bits,
+                 size_t pcap,
+                 const uint8_t *buf,
+                 size_t buf_len,
+                 uint8_t *out,
+                 size_t out_cap)
+{
+    session_t *sctx = _sctx(mctx);
+
+    // deflateBound for Z_FINISH, sync flush marker adds at most 6 bytes per deflate call,
+    // bound without stream for any parameters, size query never holds a stream
+    const size_t bound = deflateBound(Z_NULL, buf_len) + 6 * (buf_len / ((size_t)1 << 30) + 2);
+    const size_t room = ((bound + pcap - 1) / pcap) * _ws_build_hlen(_zmin(bound, pcap), !sctx->server);
+    if ((out == NULL) || ((room + bound) > out_cap))
+    {
+        return (int64_t)(room + bound);
+    }
+
+    z_stream *zs = _ws_zout(sctx);
+    if (zs == NULL)
+    {
+        mctx->error_msg = "deflate init error";
+        return -1;
+    }
+
+    const uint8_t *msg = buf;
+    const size_t msg_len = buf_len;
+    size_t total = 0;
+    size_t keep = 0;
+    if (_ws_deflate_contig(zs, buf, buf_len, out + room, bound, &total) < 0)
+    {
+        _ws_zout_fail(mctx);
+        return -1;
+    }
+    if (_ws_deflate_tail(out + room, total, msg_len, sctx->zp.out_reset, &keep))
+    {
+        _ws_zout_release(sctx);
+        const size_t n = _ws_into_frames(sctx, ftype, rsv_bits & 0x3, 0, pcap, msg, msg_len, out);
+        sctx->zst.skipped++;
+        sctx->zst.skipped_bytes += msg_len;
+        return (int64_t)n;
+    }
+
+    const size_t n = _ws_into_frames(sctx, ftype, rsv_bits, 1, pcap, out + room, keep, out);
+    sctx->zst.compressed++;
+    sctx->zst.compressed_in += msg_len;
+    sctx->zst.compressed_out += keep;
+    if (sctx->zp.out_reset)
+    {
+        // no context takeover, idle session keeps no deflate state
+        _ws_zout_release(sctx);
+    }
+    return (int64_t)n;
+}
+
+int64_t
+mssn_build_into(mssn_t *mctx,
+                mssn_frame_type ftype,
+                int rsv_bits,
+                size_t frame_size,
+                const uint8_t *buf,
+                size_t buf_len,
+                uint8_t *out,
+                size_t out_cap)
+{
+    session_t *sctx = _sctx(mctx);
+    size_t pcap = 0;
+    if (_ws_build_check(mctx, ftype, frame_size, buf, buf_len, &pcap) < 0)
+    {
+        return -1;
+    }
+
+    int is_ctrl = (ftype == WS_FRAME_PING) || (ftype == WS_FRAME_PONG) || (ftype == WS_FRAME_CLOSE);
+    if ((rsv_bits & MSSN_BUILD_DEFLATE) && !is_ctrl)
+    {
+        if (pcap <= 6)
+        {
+            mctx->error_msg = "invalid frame size";
+            return -1;
+        }
+        // deflate path checks capacity with deflate bound, not smaller than uncompressed
+        if (_ws_deflate_wanted(sctx, buf, buf_len))
+        {
+            return _ws_into_deflate(mctx, ftype, rsv_bits & 0x7, pcap, buf, buf_len, out, out_cap);
+        }
+        const size_t plain = _ws_plain_size(pcap, buf_len, !sctx->server);
+        if ((out == NULL) || (out_cap < plain))
+        {
+            return (int64_t)plain;
+        }
+        sctx->zst.skipped++;
+        sctx->zst.skipped_bytes += buf_len;
+        return (int64_t)_ws_into_frames(sctx, ftype, rsv_bits & 0x3, 0, pcap, buf, buf_len, out);
+    }
+
+    const size_t need = _ws_plain_size(pcap, buf_len, !sctx->server);
+    if ((out == NULL) || (out_cap < need))
+    {
+        return (int64_t)need;
+    }
+    return (int64_t)_ws_into_frames(sctx, ftype, rsv_bits & 0x7, 0, pcap, buf, buf_len, out);
+}
+
+int mssn_build_iov(mssn_t *mctx,
+                   mssn_frame_type ftype,
+                   int rsv_bits,
+                   size_t frame_size,
+                   const uint8_t *buf,
+                   size_t buf_len,
+                   mssn_iovec_t **iov)
+{
+    session_t *sctx = _sctx(mctx);
+    size_t pcap = 0;
+    if ((iov == NULL) || (_ws_build_check(mctx, ftype, frame_size, buf, buf_len, &pcap) < 0))
+    {
+        return -1;
+    }
+    if (!sctx->server || (rsv_bits & MSSN_BUILD_DEFLATE))
+    {
+        // payload masked or deflated was not referenced by iov
+        mctx->error_msg = "iov build requires server without deflate";
+        return -1;
+    }
+
+    // iov array, then headers
+    const size_t nframe = (buf_len <= 0) ? 1 : ((buf_len + pcap - 1) / pcap);
+    const size_t iov_size = 2 * nframe * sizeof(mssn_iovec_t);
+    mssn_data_t *dt = NULL;
+    if ((iov_size + nframe * 10) < INT32_MAX)
+    {
+        dt = _zdata_alloc(sctx, NULL, (int)(iov_size + nframe * 10));
+    }
+    if (dt == NULL)
+    {
+        mctx->error_msg = "alloc iov failed";
+        return -1;
+    }
+
+    mssn_iovec_t *v = (mssn_iovec_t *)dt->data;
+    uint8_t *h = dt->data + iov_size;
+    int cnt = 0;
+    for (size_t bi = 0; bi < nframe; bi++)
+    {
+        const size_t plen = _zmin(buf_len, pcap);
+        const int hlen = _ws_encode_header(h,
+                                           plen,
+                                           bi == (nframe - 1),
+                                           rsv_bits,
+                                           (bi == 0) ? _ws_opcode(ftype) : _WS_CONTINUATION_FRAME,
+                                           0);
+        v[cnt].iov_base = h;
+        v[cnt++].iov_len = hlen;
+        h += hlen;
+        if (plen > 0)
+        {
+            v[cnt].iov_base = (void *)buf;
+            v[cnt++].iov_len = plen;
+        }
+        buf += plen;
+        buf_len -= plen;
+    }
+
+    *iov = v;
+    return cnt;
+}
+
+void mssn_reclaim_iov(mssn_t *mctx, mssn_iovec_t *iov)
+{
+    session_t *sctx = _sctx(mctx);
+    if ((sctx != NULL) && (iov != NULL))
+    {
+        // iov array starts data of zdata_t
+        _zdata_free(sctx, &((zdata_t *)iov - 1)->dt);
+    }
+}
+
+// MARK: - Build Stream
+
+/// carried deflate bytes, sync flush trailer stripped from last frame was never emitted
+#define _WS_OUT_CARRY 4
+
+static mssn_data_t *
+_ws_out_chunk(session_t *sctx)
+{
+    const int hmax = _ws_build_hlen(sctx->out_pcap, !sctx->server);
+    const int carry = sctx->out_deflate ? _WS_OUT_CARRY : 0;
+    mssn_data_t *dt = _zdata_alloc(sctx, NULL, hmax + (int)sctx->out_pcap + carry);
+    if (dt != NULL)
+    {
+        dt->data += hmax;
+        dt->length = 0;
+    }
+    return dt;
+}
+
+/// drop unfinished message, deflate stream was released for peer never sees rest of it
+static void
+_ws_out_fini(session_t *sctx)
+{
+    if ((sctx->out_ftype != 0) && sctx->out_deflate)
+    {
+        _ws_zout_release(sctx);
+    }
+    _zdata_free(sctx, sctx->out_pending);
+    sctx->out_pending = NULL;
+    sctx->out_ftype = 0;
+}
+
+/// emit first plen bytes of pending chunk as frame, rest bytes carried into new pending chunk
+static int
+_ws_out_emit(session_t *sctx, size_t plen, int fin, mssn_data_t **head, mssn_data_t **last)
+{
+    mssn_data_t *dt = sctx->out_pending;
+    mssn_data_t *nd = NULL;
+    if (!fin)
+    {
+        nd = _ws_out_chunk(sctx);
+        if (nd == NULL)
+        {
+            return -1;
+        }
+        nd->length = dt->length - (int)plen;
+        memcpy(nd->data, dt->data + plen, nd->length);
+    }
+
+    int rsv = sctx->out_rsv;
+    if (sctx->out_deflate)
+    {
+        rsv = (sctx->out_nframe == 0) ? (rsv | 0x4) : (rsv & ~0x4);
+    }
+    const int hlen = _ws_build_hlen(plen, !sctx->server);
+    _ws_write_header(sctx,
+                     dt->data,
+                     plen,
+                     fin,
+                     rsv,
+                     (sctx->out_nframe == 0) ? _ws_opcode(sctx->out_ftype) : _WS_CONTINUATION_FRAME);
+    dt->data -= hlen;
+    dt->length = hlen + (int)plen;
+    dt->next = NULL;
+    if (*head == NULL)
+    {
+        *head = dt;
+    }
+    else
+    {
+        (*last)->next = dt;
+    }
+    *last = dt;
+
+    sctx->out_pending = nd;
+    sctx->out_nframe += 1;
+    if (sctx->out_deflate)
+    {
+        sctx->out_zlen += plen;
+    }
+    return 0;
+}
+
+/// deflate into pending chunks, full chunk emitted with last bytes carried
+static int
+_ws_out_deflate(session_t *sctx, const uint8_t *buf, size_t buf_len, int flush, mssn_data_t **head, mssn_data_t **last)
+{
+    z_stream *zs = sctx->zout;
+    const size_t cap = sctx->out_pcap + _WS_OUT_CARRY;
+    zs->avail_in = 0;
+    for (;;)
+    {
+        if ((zs->avail_in == 0) && (buf_len > 0))
+        {
+            // avail_in was uInt
+            const size_t n = _zmin(buf_len, (size_t)1 << 30);
+            zs->next_in = (Bytef *)buf;
+            zs->avail_in = (uInt)n;
+            buf += n;
+            buf_len -= n;
+        }
+        mssn_data_t *dt = sctx->out_pending;
+        size_t room = cap - dt->length;
+        // sync flush requires avail_out > 6, or repeats flush marker
+        if ((room == 0) || (flush && (buf_len <= 0) && (room <= 6)))
+        {
+            if (_ws_out_emit(sctx, dt->length - _WS_OUT_CARRY, 0, head, last) < 0)
+            {
+                return -1;
+            }
+            dt = sctx->out_pending;
+            room = cap - dt->length;
+        }
+
+        zs->next_out = dt->data + dt->length;
+        zs->avail_out = (uInt)_zmin(room, (size_t)1 << 30);
+        const uInt avail_out = zs->avail_out;
+        const int ret = deflate(zs, ((buf_len <= 0) && flush) ? Z_SYNC_FLUSH : Z_NO_FLUSH);
+        if ((ret != Z_OK) && (ret != Z_BUF_ERROR))
+        {
+            _Z_DEBUG("deflate error %d", ret);
+            return -1;
+        }
+        dt->length += (int)(avail_out - zs->avail_out);
+
+        if ((buf_len <= 0) && (zs->avail_in == 0) && (zs->avail_out > 0))
+        {
+            break; // consumed, or flushed
+        }
+    }
+    return 0;
+}
+
+int mssn_build_begin(mssn_t *mctx, mssn_frame_type ftype, int rsv_bits, size_t frame_size)
+{
+    session_t *sctx = _sctx(mctx);
+    if ((sctx == NULL) || (frame_size <= 0) || ((ftype != WS_FRAME_TEXT) && (ftype != WS_FRAME_BINARY)))
+    {
+        if (mctx)
+        {
+            mctx->error_msg = "invalid params";
+        }
+        return -1;
+    }
+    if (sctx->out_ftype != 0)
+    {
+        mctx->error_msg = "message building not finished";
+        return -1;
+    }
+
+    const int hframe = _ws_build_hlen(frame_size, !sctx->server);
+    const int deflate = (rsv_bits & MSSN_BUILD_DEFLATE) != 0;
+    if ((frame_size <= (size_t)hframe) || (deflate && (frame_size - hframe) <= 6) ||
+        (frame_size + _WS_OUT_CARRY >= INT32_MAX))
+    {
+        mctx->error_msg = "invalid frame size";
+        return -1;
+    }
+    if (deflate && (_ws_zout(sctx) == NULL))
+    {
+        mctx->error_msg = "deflate init error";
+        return -1;
+    }
+
+    sctx->out_ftype = ftype;
+    sctx->out_rsv = rsv_bits & (deflate ? 0x3 : 0x7);
+    sctx->out_deflate = deflate;
+    sctx->out_nframe = 0;
+    sctx->out_pcap = frame_size - hframe;
+    sctx->out_in = 0;
+    sctx->out_zlen = 0;
+    sctx->out_pending = _ws_out_chunk(sctx);
+    if (sctx->out_pending == NULL)
+    {
+        sctx->out_ftype = 0;
+        mctx->error_msg = "alloc chunk failed";
+        return -1;
+    }
+    return 0;
+}
+
+int mssn_build_append(mssn_t *mctx, const uint8_t *buf, size_t buf_len, mssn_data_t **data)
+{
+    session_t *sctx = _sctx(mctx);
+    if ((sctx == NULL) || (data == NULL) || ((buf == NULL) && (buf_len > 0)))
+    {
+        if (mctx)
+        {
+            mctx->error_msg = "invalid params";
+        }
+        return -1;
+    }
+    if (sctx->out_ftype == 0)
+    {
+        mctx->error_msg = "message building not begun";
+        return -1;
+    }
+
+    mssn_data_t *head = NULL;
+    mssn_data_t *last = NULL;
+    int ret = 0;
+    sctx->out_in += buf_len;
+    if (sctx->out_deflate)
+    {
+        ret = _ws_out_deflate(sctx, buf, buf_len, 0, &head, &last);
+    }
+    else
+    {
+        while ((buf_len > 0) && (ret == 0))
+        {
+            // full chunk emitted when more payload comes, last one kept for FIN
+            mssn_data_t *dt = sctx->out_pending;
+            if ((size_t)dt->length >= sctx->out_pcap)
+            {
+                ret = _ws_out_emit(sctx, dt->length, 0, &head, &last);
+                continue;
+            }
+            const size_t n = _zmin(buf_len, sctx->out_pcap - dt->length);
+            memcpy(dt->data + dt->length, buf, n);
+            dt->length += (int)n;
+            buf += n;
+            buf_len -= n;
+        }
+    }
+    if (ret < 0)
+    {
+        _zdata_free(sctx, head);
+        _ws_out_fini(sctx);
+        mctx->error_msg = "build append error";
+        return -1;
+    }
+    *data = head;
+    return 0;
+}
+
+int mssn_build_finish(mssn_t *mctx, mssn_data_t **data)
+{
+    session_t *sctx = _sctx(mctx);
+    if ((sctx == NULL) || (data == NULL))
+    {
+        if (mctx)
+        {
+            mctx->error_msg = "invalid params";
+        }
+        return -1;
+    }
+    if (sctx->out_ftype == 0)
+    {
+        mctx->error_msg = "message building not begun";
+        return -1;
+    }
+
+    mssn_data_t *head = NULL;
+    mssn_data_t *last = NULL;
+    size_t plen = 0;
+    if (sctx->out_deflate)
+    {
+        if (_ws_out_deflate(sctx, NULL, 0, 1, &head, &last) < 0)
+        {
+            _zdata_free(sctx, head);
+            _ws_out_fini(sctx);
+            mctx->error_msg = "deflate error";
+            return -1;
+        }
+        plen = sctx->out_pending->length;
+        // strip 00 00 ff ff of sync flush, keep single 00 for empty message,
+        // stream flushed without input since last message outputs nothing
+        plen = (plen > _WS_OUT_CARRY) ? (plen - _WS_OUT_CARRY) : 0;
+        if ((plen == 0) && (sctx->out_nframe == 0))
+        {
+            sctx->out_pending->data[0] = 0;
+            plen = 1;
+        }
+    }
+    else
+    {
+        plen = sctx->out_pending->length;
+    }
+    _ws_out_emit(sctx, plen, 1, &head, &last);
+
+    if (sctx->out_deflate)
+    {
+        sctx->zst.compressed++;
+        sctx->zst.compressed_in += sctx->out_in;
+        sctx->zst.compressed_out += sctx->out_zlen;
+        if (sctx->zp.out_reset)
+        {
+            // no context takeover, idle session keeps no deflate state
+            _ws_zout_release(sctx);
+        }
+    }
+    sctx->out_ftype = 0;
+    *data = head;
+    return 0;
+}
+
+// MARK: - Send Queue
+
+/// frames not larger were copied into shared pages
+#define _Z_SEND_SMALL (_Z_DATA_LEN / 4)
+
+static void
+_send_fini(session_t *sctx)
+{
+    _zdata_free(sctx, sctx->data_send);
+    sctx->data_send = NULL;
+    sctx->send_last = NULL;
+    sctx->send_off = 0;
+    sctx->send_bytes = 0;
+}
+
+static void
+_send_link(session_t *sctx, mssn_data_t *dt)
+{
+    dt->next = NULL;
+    if (sctx->data_send == NULL)
+    {
+        sctx->data_send = dt;
+    }
+    else
+    {
+        sctx->send_last->next = dt;
+    }
+    sctx->send_last = dt;
+    sctx->send_bytes += dt->length;
+}
+
+/// spare bytes after data of node owning its memory
+static size_t
+_send_room(mssn_data_t *dt)
+{
+    zdata_t *zd = (zdata_t *)dt;
+    if ((dt == NULL) || (zd->bcast != NULL) || (zd->cap == 0))
+    {
+        // broadcast frames and referenced buffer were never written
+        return 0;
+    }
+    return zd->cap - (dt->data - (uint8_t *)(zd + 1)) - dt->length;
+}
+
+/// copy into spare bytes of last node, then new pages
+static int
+_send_copy(session_t *sctx, const uint8_t *buf, size_t buf_len)
+{
+    while (buf_len > 0)
+    {
+        mssn_data_t *dt = sctx->send_last;
+        size_t room = _send_room(dt);
+        if (room <= 0)
+        {
+            dt = _zchunk_alloc(sctx);
+            if (dt == NULL)
+            {
+                return -1;
+            }
+            dt->length = 0;
+            _send_link(sctx, dt);
+            room = _Z_DATA_LEN;
+        }
+        const size_t n = _zmin(room, buf_len);
+        memcpy(dt->data + dt->length, buf, n);
+        dt->length += (int)n;
+        sctx->send_bytes += n;
+        buf += n;
+        buf_len -= n;
+    }
+    return 0;
+}
+
+int mssn_send_queue(mssn_t *mctx, const uint8_t *buf, size_t buf_len)
+{
+    session_t *sctx = _sctx(mctx);
+    if ((sctx == NULL) || ((buf == NULL) && (buf_len > 0)))
+    {
+        if (mctx)
+        {
+            mctx->error_msg = "invalid params";
+        }
+        return -1;
+    }
+    if (_send_copy(sctx, buf, buf_len) < 0)
+    {
+        mctx->error_msg = "alloc chunk failed";
+        return -1;
+    }
+    return 0;
+}
+
+int mssn_send_data(mssn_t *mctx, mssn_data_t *data)
+{
+    session_t *sctx = _sctx(mctx);
+    if (sctx == NULL)
+    {
+        return -1;
+    }
+    while (data != NULL)
+    {
+        mssn_data_t *dt = data;
+        data = data->next;
+        dt->next = NULL;
+        zdata_t *zd = (zdata_t *)dt;
+        if ((zd->cap == 0) && (zd->bcast == NULL))
+        {
+            // node referencing caller buffer may not outlive it, copied
+            const int ret = _send_copy(sctx, dt->data, dt->length);
+            _zdata_free(sctx, dt);
+            if (ret < 0)
+            {
+                _zdata_free(sctx, data);
+                mctx->error_msg = "alloc chunk failed";
+                return -1;
+            }
+            continue;
+        }
+        // large frame linked without copy, small one coalesced into pages
+        mssn_data_t *page = sctx->send_last;
+        if (((size_t)dt->length <= _Z_SEND_SMALL) && (_send_room(page) < (size_t)dt->length))
+        {
+            page = _zchunk_alloc(sctx);
+            if (page != NULL)
+            {
+                page->length = 0;
+                _send_link(sctx, page);
+            }
+        }
+        if (((size_t)dt->length > _Z_SEND_SMALL) || (page == NULL))
+        {
+            _send_link(sctx, dt);
+            continue;
+        }
+        memcpy(page->data + page->length, dt->data, dt->length);
+        page->length += dt->length;
+        sctx->send_bytes += dt->length;
+        _zdata_free(sctx, dt);
+    }
+    return 0;
+}
+
+int mssn_send_bcast(mssn_t *mctx, mssn_bcast_t *b)
+{
+    session_t *sctx = _sctx(mctx);
+    size_t len = 0;
+    const uint8_t *frames = mssn_bcast_frames(mctx, b, &len);
+    if (frames == NULL)
+    {
+        return -1;
+    }
+    if (len <= _Z_SEND_SMALL)
+    {
+        return mssn_send_queue(mctx, frames, len);
+    }
+    zdata_t *zd = (zdata_t *)_zalloc(sctx, sizeof(zdata_t));
+    if (zd == NULL)
+    {
+        mctx->error_msg = "alloc data failed";
+        return -1;
+    }
+    zd->bcast = mssn_bcast_ref(b);
+    zd->dt.data = (uint8_t *)frames;
+    zd->dt.length = (int)len;
+    _send_link(sctx, &zd->dt);
+    return 0;
+}
+
+int mssn_send_iov(mssn_t *mctx, mssn_iovec_t *iov, int iov_max)
+{
+    session_t *sctx = _sctx(mctx);
+    if ((sctx == NULL) || (iov == NULL) || (iov_max <= 0))
+    {
+        return -1;
+    }
+    int cnt = 0;
+    size_t off = sctx->send_off;
+    for (mssn_data_t *dt = sctx->data_send; (dt != NULL) && (cnt < iov_max); dt = dt->next)
+    {
+        iov[cnt].iov_base = dt->data + off;
+        iov[cnt++].iov_len = dt->length - off;
+        off = 0;
+    }
+    return cnt;
+}
+
+void mssn_send_consume(mssn_t *mctx, size_t nbytes)
+{
+    session_t *sctx = _sctx(mctx);
+    if (sctx == NULL)
+    {
+        return;
+    }
+    nbytes = _zmin(nbytes, sctx->send_bytes);
+    sctx->send_bytes -= nbytes;
+    nbytes += sctx->send_off;
+    while ((sctx->data_send != NULL) && (nbytes >= (size_t)sctx->data_send->length))
+    {
+        mssn_data_t *dt = sctx->data_send;
+        nbytes -= dt->length;
+        sctx->data_send = dt->next;
+        dt->next = NULL;
+        _zdata_free(sctx, dt);
+    }
+    sctx->send_off = nbytes;
+    if (sctx->data_send == NULL)
+    {
+        sctx->send_last = NULL;
+        sctx->send_off = 0;
+    }
+}
+
+size_t
+mssn_send_pending(mssn_t *mctx)
+{
+    session_t *sctx = _sctx(mctx);
+    return (sctx == NULL) ? 0 : sctx->send_bytes;
+}
+
+// MARK: - Header Index
+
+/// names of mssn_header_id, perfect hash below generated from this list by gen_header_hash.py
+static const char *const _hdr_names[MSSN_H_MAX] = {
+    NULL,
+    "A-IM", "Accept", "Accept-Charset", "Accept-Datetime", "Accept-Encoding", "Accept-Language",
+    "Accept-Patch", "Accept-Ranges", "Access-Control-Allow-Credentials",
+    "Access-Control-Allow-Headers", "Access-Control-Allow-Methods", "Access-Control-Allow-Origin",
+    "Access-Control-Expose-Headers", "Access-Control-Max-Age", "Access-Control-Request-Headers",
+    "Access-Control-Request-Method", "Age", "Allow", "Alt-Svc", "Authorization", "Cache-Control",
+    "Connection", "Content-Disposition", "Content-Encoding", "Content-Language", "Content-Length",
+    "Content-Location", "Content-Range", "Content-Security-Policy", "Content-Type", "Cookie",
+    "Date", "DNT", "ETag", "Expect", "Expires", "Forwarded", "From", "Host", "If-Match",
+    "If-Modified-Since", "If-None-Match", "If-Range", "If-Unmodified-Since", "Keep-Alive",
+    "Last-Modified", "Link", "Location", "Max-Forwards", "Origin", "Pragma", "Proxy-Authenticate",
+    "Proxy-Authorization", "Proxy-Connection", "Range", "Referer", "Refresh", "Retry-After",
+    "Sec-Fetch-Dest", "Sec-Fetch-Mode", "Sec-Fetch-Site", "Sec-Fetch-User", "Sec-WebSocket-Accept",
+    "Sec-WebSocket-Extensions", "Sec-WebSocket-Key", "Sec-WebSocket-Protocol",
+    "Sec-WebSocket-Version", "Server", "Set-Cookie", "Strict-Transport-Security", "TE", "Trailer",
+    "Transfer-Encoding", "Upgrade", "Upgrade-Insecure-Requests", "User-Agent", "Vary", "Via",
+    "Warning", "WWW-Authenticate", "X-Content-Type-Options", "X-Forwarded-For", "X-Forwarded-Host",
+    "X-Forwarded-Proto", "X-Frame-Options", "X-Real-IP", "X-Requested-With",
+};
+
+static const uint8_t _hdr_disp[16] = {0, 0, 0, 3, 3, 4, 1, 7, 0, 0, 4, 0, 0, 0, 0, 0};
+
+static const uint8_t _hdr_slot[256] = {
+    47,  0,  0, 74,  0, 36,  0,  0,  0,  0, 87, 64, 69, 16, 49,  0,
+     0, 61, 41, 42,  0,  0, 29,  0,  0, 70,  0,  0,  0,  0,  0,  0,
+    68, 76,  0,  0, 67,  0,  0,  0,  0,  0,  0, 43,  0, 24,  0,  0,
+     0,  0, 30, 71,  0, 82, 21,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0, 55, 51, 44,  0,  0,  0,  0,  0, 80,  0,  0, 25,  0, 84, 26,
+     6,  0,  0,  0,  0,  0, 40,  0,  0, 23,  0,  0, 60, 52, 65,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 58,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0, 37, 57, 53, 86,  1,  0,  0,  0, 14,  0,
+     0,  0,  0,  0,  0,  0,  0,  0, 73,  8,  0, 66,  0,  0, 59,  0,
+     0,  0,  9,  0,  0,  0,  0,  0, 72,  0, 78,  0,  0,  0, 79, 31,
+    17,  0,  0,  0,  0, 75,  0,  0, 12,  0,  0,  0, 19, 34, 15,  0,
+    83, 45,  0,  0, 28,  5, 50,  0, 20,  0,  0, 35,  0,  7, 38,  0,
+     0,  0, 27,  0,  0,  0,  0,  0,  0, 11,  0, 62, 48, 63,  0, 22,
+    56, 10,  0,  0,  0,  2,  0, 85,  0,  0, 46,  0,  0,  4,  0,  0,
+    77,  0,  3,  0, 18, 13, 54, 33,  0, 32,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0, 81,  0,  0,  0,  0,  0,  0,  0, 39,
+};
+
+static const uint8_t _hdr_lens[MSSN_H_MAX] = {
+     0,  4,  6, 14, 15, 15, 15, 12, 13, 32, 28, 28, 27, 29, 22, 30,
+    29,  3,  5,  7, 13, 13, 10, 19, 16, 16, 14, 16, 13, 23, 12,  6,
+     4,  3,  4,  6,  7,  9,  4,  4,  8, 17, 13,  8, 19, 10, 13,  4,
+     8, 12,  6,  6, 18, 19, 16,  5,  7,  7, 11, 14, 14, 14, 14, 20,
+    24, 17, 22, 21,  6, 10, 25,  2,  7, 17,  7, 25, 10,  4,  3,  7,
+    16, 22, 15, 16, 17, 15,  9, 16,
+};
+
+/// fold A-Z of 8 bytes into lowercase, other bytes kept
+static inline uint64_t
+_hdr_fold(uint64_t w)
+{
+    const uint64_t ones = 0x0101010101010101ull;
+    const uint64_t heptets = w & (0x7F * ones);
+    const uint64_t ge_a = heptets + (0x3F * ones); // high bit for byte >= 'A'
+    const uint64_t gt_z = heptets + (0x25 * ones); // high bit for byte > 'Z'
+    const uint64_t upper = ~w & (ge_a ^ gt_z) & (0x80 * ones);
+    return w | (upper >> 2);
+}
+
+/// lowercase word of 8 name bytes, little-endian on all hosts
+static inline uint64_t
+_hdr_word(const char *p)
+{
+    uint64_t w;
+    memcpy(&w, p, 8);
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    w = __builtin_bswap64(w);
+#endif
+    return _hdr_fold(w);
+}
+
+/// lowercase word of name tail less than 8 bytes, zero padded
+static inline uint64_t
+_hdr_tail(const char *p, size_t n)
+{
+    uint64_t w = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        w |= (uint64_t)(uint8_t)p[i] << (i * 8);
+    }
+    return _hdr_fold(w);
+}
+
+/// name hash over lowercase words, tables above generated with it
+static inline uint32_t
+_hdr_hash(const char *name, size_t len)
+{
+    uint64_t h = len * 0x9e3779b97f4a7c15ull;
+    for (; len >= 8; name += 8, len -= 8)
+    {
+        h = (h ^ _hdr_word(name)) * 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+    }
+    if (len > 0)
+    {
+        h = (h ^ _hdr_tail(name, len)) * 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+    }
+    return (uint32_t)h;
+}
+
+/// case-insensitive equal for header names, folding A-Z only
+static inline int
+_hdr_equal(const char *a, const char *b, size_t len)
+{
+    for (; len >= 8; a += 8, b += 8, len -= 8)
+    {
+        if (_hdr_word(a) != _hdr_word(b))
+        {
+            return 0;
+        }
+    }
+    return (len == 0) || (_hdr_tail(a, len) == _hdr_tail(b, len));
+}
+
+/// known header id of name with hash, MSSN_H_UNKNOWN for others
+static int
+_hdr_lookup(const char *name, size_t len, uint32_t h)
+{
+    int id = _hdr_slot[((h >> 8) + _hdr_disp[h & 15] * ((h >> 16) | 1)) & 255];
+    if ((id == MSSN_H_UNKNOWN) || (_hdr_lens[id] != len) || !_hdr_equal(_hdr_names[id], name, len))
+    {
+        return MSSN_H_UNKNOWN;
+    }
+    return id;
+}
+
+/// slot of name in index, empty slot for absent
+static hidx_slot_t *
+_hidx_probe(session_t *sctx, const char *name, size_t len, uint32_t hash)
+{
+    uint32_t mask = (uint32_t)sctx->hidx_cap - 1;
+    for (uint32_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        hidx_slot_t *slot = &sctx->hidx[i];
+        if ((slot->head == NULL) ||
+            ((slot->hash == hash) && ((size_t)slot->head->key_span.length == len) &&
+             _hdr_equal(slot->head->key, name, len)))
+        {
+            return slot;
+        }
+    }
+}
+
+/// double slots in arena, old slots left until arena reset
+static int
+_hidx_grow(session_t *sctx)
+{
+    int ncap = (sctx->hidx_cap > 0) ? (sctx->hidx_cap * 2) : 32;
+    hidx_slot_t *nidx = (hidx_slot_t *)_zarena_alloc(sctx, ncap * sizeof(hidx_slot_t));
+    if (nidx == NULL)
+    {
+        return -1;
+    }
+    hidx_slot_t *oidx = sctx->hidx;
+    int ocap = sctx->hidx_cap;
+    sctx->hidx = nidx;
+    sctx->hidx_cap = ncap;
+    for (int i = 0; i < ocap; i++)
+    {
+        if (oidx[i].head != NULL)
+        {
+            uint32_t mask = (uint32_t)ncap - 1;
+            uint32_t j = oidx[i].hash & mask;
+            while (nidx[j].head != NULL)
+            {
+                j = (j + 1) & mask;
+            }
+            nidx[j] = oidx[i];
+        }
+    }
+    return 0;
+}
+
+/// tag header with completed key, chain repeated names, index first one of each id
+static int
+_hdr_tag(session_t *sctx, mssn_header_t *h)
+{
+    size_t len = h->key_span.length;
+    if ((h->key == NULL) || (len == 0))
+    {
+        return 0;
+    }
+    uint32_t hash = _hdr_hash(h->key, len);
+    h->id = _hdr_lookup(h->key, len, hash);
+
+    // keep load under 3/4
+    if (((sctx->hidx_count + 1) * 4 > sctx->hidx_cap * 3) && (_hidx_grow(sctx) < 0))
+    {
+        return -1;
+    }
+    hidx_slot_t *slot = _hidx_probe(sctx, h->key, len, hash);
+    if (slot->head != NULL)
+    {
+        slot->tail->dup = h;
+        slot->tail = h;
+        return 0;
+    }
+    slot->hash = hash;
+    slot->head = h;
+    slot->tail = h;
+    sctx->hidx_count += 1;
+    if (h->id != MSSN_H_UNKNOWN)
+    {
+        sctx->hdr_index[h->id] = h;
+    }
+    return 0;
+}
+
+/// clear index walking headers, before arena reset
+static void
+_hdr_clear(mssn_t *mctx)
+{
+    session_t *sctx = _sctx(mctx);
+    for (mssn_header_t *h = mctx->headers; h != NULL; h = h->next)
+    {
+        sctx->hdr_index[h->id] = NULL;
+    }
+    sctx->hidx = NULL;
+    sctx->hidx_cap = 0;
+    sctx->hidx_count = 0;
+}
+
+mssn_header_t *
+mssn_header_get(mssn_t *mctx, int id)
+{
+    session_t *sctx = _sctx(mctx);
+    if ((sctx == NULL) || (id <= MSSN_H_UNKNOWN) || (id >= MSSN_H_MAX))
+    {
+        return NULL;
+    }
+    return sctx->hdr_index[id];
+}
+
+mssn_header_t *
+mssn_header_find(mssn_t *mctx, const char *name, int len)
+{
+    session_t *sctx = _sctx(mctx);
+    if ((sctx == NULL) || (sctx->hidx == NULL) || (name == NULL) || (len <= 0))
+    {
+        return NULL;
+    }
+    return _hidx_probe(sctx, name, len, _hdr_hash(name, len))->head;
+}
+
+void mssn_reclaim(mssn_t *mctx, mssn_data_t *data_build)
+{
+    session_t *sctx = _sctx(mctx);
+    mctx->opaque = sctx;
+    mctx->error_msg = NULL;
+
+    if (data_build)
+    {
+        _zdata_free(sctx, data_build);
+        return;
+    }
+
+    // clear frames
+    _zframe_free(sctx, mctx->frames);
+    mctx->frames = NULL;
+    sctx->frame_wlast = NULL;
+
+    if (sctx->stage == SESSION_STAGE_WS)
+    {
+        // keep frames under reading
+        // return for WebSocket connection
+        _Z_REPORT("mssn_reclaim ws");
+        return;
+    }
+
+    if (sctx->frame_cread != sctx->frame_rlast)
+    {
+        _zframe_free(sctx, sctx->frame_cread);
+    }
+    _zframe_free(sctx, sctx->frame_rlast);
+    sctx->frame_rlast = NULL;
+    sctx->frame_cread = NULL;
+    sctx->msg_offset = 0;
+
+    if (mctx->state != MSSN_STATE_ERROR)
+    {
+        mctx->state = MSSN_STATE_INIT;
+    }
+    mctx->method = NULL;
+
+    // clear path, headers in arena
+    mctx->path = NULL;
+    mctx->path_span.offset = 0;
+    mctx->path_span.length = 0;
+    mctx->status = 0;
+    _hdr_clear(mctx);
+    mctx->headers = NULL;
+    sctx->header_rlast = NULL;
+    sctx->hp_token = HP_TOKEN_NONE;
+    _zarena_reset(sctx);
+    _Z_REPORT("mssn_reclaim http");
+}
+
+void mssn_chunk_pool_config(size_t high_water)
+{
+    _zpool_lock();
+    _zpool.high_water = high_water;
+    size_t n = (_zpool.cached > high_water) ? (_zpool.cached - high_water) : 0;
+    _zpool_unlock();
+
+    size_t nget = 0;
+    zchunk_t *head = _zpool_get_list(n, &nget);
+    _zpool_put_list(head, nget);
+}
+
+void mssn_chunk_pool_stats(mssn_chunk_stats_t *st)
+{
+    if (st == NULL)
+    {
+        return;
+    }
+    _zpool_lock();
+    st->chunk_size = _Z_DATA_LEN;
+    st->high_water = _zpool.high_water;
+    st->cached = _zpool.cached;
+    _zpool_unlock();
+    st->thread_cached = _Z_ATOMIC_LOAD(_zpool.thread_cached);
+    st->allocated = _Z_ATOMIC_LOAD(_zpool.allocated);
+    st->hits = _Z_ATOMIC_LOAD(_zpool.hits);
+    st->misses = _Z_ATOMIC_LOAD(_zpool.misses);
+    st->released = _Z_ATOMIC_LOAD(_zpool.released);
+}
+
+void mssn_sha1(const uint8_t *data, int data_len, uint8_t *digest)
+{
+    SHA1_HASH hash;
+    Sha1Calculate(data, data_len, &hash);
+    memcpy(digest, hash.bytes, 20);
+}
+
+// MARK: - HTTP Session
+
+static int
+_hp_msg_begin(http_parser *p)
+{
+    mssn_t *mctx = _mctx(p);
+    mctx->state = MSSN_STATE_BEGIN;
+    _sctx(mctx)->stage = SESSION_STAGE_HTTP;
+    _sctx(mctx)->hp_token = HP_TOKEN_NONE;
+    return 0;
+}
+
+static int
+_hp_status(http_parser *p, const char *at, size_t length)
+{
+    return 0;
+}
+
+static int
+_hp_headers_complete(http_parser *p)
+{
+    mssn_t *mctx = _mctx(p);
+
+    if (p->method == 0xff)
+    {
+        mctx->method = NULL;
+    }
+    else
+    {
+        mctx->method = http_method_str(p->method);
+    }
+
+    mctx->status = p->status_code;
+    mctx->state = MSSN_STATE_HEADER;
+
+    if (!p->upgrade || (mctx->headers == NULL))
+    {
+        return 0;
+    }
+
+    // client accepts 101 response without version
+    int has_version = !_sctx(mctx)->server && (p->status_code == 101);
+    mssn_header_t *h = mssn_header_get(mctx, MSSN_H_SEC_WEBSOCKET_VERSION);
+    if (!has_version && (h != NULL))
+    {
+        has_version = (h->value_span.length == 2) && (strncmp(h->value, "13", 2) == 0);
+    }
+
+    if (has_version)
+    {
+        mctx->upgrade = 1;
+        mctx->state = MSSN_STATE_BODY;
+        _ws_init(mctx);
+    }
+    else
+    {
+        mctx->error_msg = "Invalid websocket version !";
+    }
+    return 0;
+}
+
+static int
+_hp_msg_complete(http_parser *p)
+{
+    mssn_t *mctx = _mctx(p);
+    mctx->state = MSSN_STATE_FINISH;
+    if (mctx->frames != NULL)
+    {
+        mctx->frames->fin = 1;
+    }
+    return 0;
+}
+
+/// set token referencing input buffer with zero copy, or copy into arena,
+/// token splited by http_parser_execute calls were conjoined in arena, NULL when alloc failed
+static const char *
+_hp_token(session_t *sctx, hp_token_t token, const char *str, mssn_span_t *span, const char *at, size_t length)
+{
+    int append = (sctx->hp_token == token) && (str != NULL);
+    sctx->hp_token = token;
+
+    if (append)
+    {
+        char *nstr = (char *)_zarena_alloc(sctx, span->length + length + 1);
+        if (nstr == NULL)
+        {
+            return NULL;
+        }
+        memcpy(nstr, str, span->length);
+        memcpy(nstr + span->length, at, length);
+        span->offset = -1;
+        span->length += length;
+        return nstr;
+    }
+
+    span->length = length;
+    if (sctx->zero_copy)
+    {
+        span->offset = (int)(at - sctx->hp_buf);
+        return at;
+    }
+    span->offset = -1;
+    return _zarena_strdup(sctx, at, length);
+}
+
+/// copy tokens referencing input buffer into arena
+static int
+_hp_detach(mssn_t *mctx)
+{
+    session_t *sctx = _sctx(mctx);
+    if (mctx->path && mctx->path_span.offset >= 0)
+    {
+        mctx->path = _zarena_strdup(sctx, mctx->path, mctx->path_span.length);
+        mctx->path_span.offset = -1;
+        if (mctx->path == NULL)
+        {
+            return -1;
+        }
+    }
+    for (mssn_header_t *h = mctx->headers; h != NULL; h = h->next)
+    {
+        if (h->key && h->key_span.offset >= 0)
+        {
+            h->key = _zarena_strdup(sctx, h->key, h->key_span.length);
+            h->key_span.offset = -1;
+            if (h->key == NULL)
+            {
+                return -1;
+            }
+        }
+        if (h->value && h->value_span.offset >= 0)
+        {
+            h->value = _zarena_strdup(sctx, h->value, h->value_span.length);
+            h->value_span.offset = -1;
+            if (h->value == NULL)
+            {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int
+_hp_url(http_parser *p, const char *at, size_t length)
+{
+    mssn_t *mctx = _mctx(p);
+    mctx->path = _hp_token(_sctx(mctx), HP_TOKEN_URL, mctx->path, &mctx->path_span, at, length);
+    if (mctx->path == NULL)
+    {
+        mctx->error_msg = "alloc url failed";
+        return -1;
+    }
+    return 0;
+}
+
+static int
+_hp_header_field(http_parser *p, const char *at, size_t length)
+{
+    mssn_t *mctx = _mctx(p);
+    session_t *sctx = _sctx(mctx);
+
+    mssn_header_t *h = sctx->header_rlast;
+    if ((sctx->hp_token == HP_TOKEN_FIELD) && (h != NULL))
+    {
+        // field splited
+        h->key = _hp_token(sctx, HP_TOKEN_FIELD, h->key, &h->key_span, at, length);
+        if (h->key == NULL)
+        {
+            mctx->error_msg = "alloc header failed";
+            return -1;
+        }
+        return 0;
+    }
+
+    h = _zarena_alloc(sctx, sizeof(mssn_header_t));
+    if (h == NULL)
+    {
+        mctx->error_msg = "alloc header failed";
+        return -1;
+    }
+    h->key = _hp_token(sctx, HP_TOKEN_FIELD, NULL, &h->key_span, at, length);
+    if (h->key == NULL)
+    {
+        mctx->error_msg = "alloc header failed";
+        return -1;
+    }
+
+    if (mctx->headers == NULL)
+    {
+        mctx->headers = h;
+    }
+
+    if (sctx->header_rlast != NULL)
+    {
+        sctx->header_rlast->next = h;
+    }
+    sctx->header_rlast = h;
+
+    return 0;
+}
+
+static int
+_hp_header_value(http_parser *p, const char *at, size_t length)
+{
+    mssn_t *mctx = _mctx(p);
+    session_t *sctx = _sctx(mctx);
+    mssn_header_t *h = sctx->header_rlast;
+    if (h != NULL)
+    {
+        // key completed when first value arrives
+        if ((sctx->hp_token == HP_TOKEN_FIELD) && (_hdr_tag(sctx, h) < 0))
+        {
+            mctx->error_msg = "alloc header index failed";
+            return -1;
+        }
+        h->value = _hp_token(sctx, HP_TOKEN_VALUE, h->value, &h->value_span, at, length);
+        if (h->value == NULL)
+        {
+            mctx->error_msg = "alloc header failed";
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int
+_hp_chunk_header(http_parser *p)
+{
+    return 0;
+}
+
+static int
+_hp_body(http_parser *p, const char *at, size_t length)
+{
+    mssn_t *mctx = _mctx(p);
+    session_t *sctx = _sctx(mctx);
+
+    mssn_frame_t *fr = mctx->frames;
+    if (fr == NULL)
+    {
+        fr = _zframe_alloc(sctx);
+        if (fr == NULL)
+        {
+            mctx->error_msg = "alloc body frame failed";
+            return -1;
+        }
+        fr->ftype = HTTP_FRAME_BODY;
+        mctx->frames = fr;
+        sctx->frame_wlast = fr;
+    }
+    if (mctx->state < MSSN_STATE_BODY)
+    {
+        mctx->state = MSSN_STATE_BODY;
+    }
+
+    mssn_data_t *dt = sctx->body_zero_copy ? _zdata_ref(sctx, (const uint8_t *)at, length)
+                                           : _zdata_alloc(sctx, (const uint8_t *)at, length);
+    if (dt == NULL)
+    {
+        mctx->error_msg = "alloc body data failed";
+        return -1;
+    }
+    if (fr->data_head == NULL)
+    {
+        fr->data_head = dt;
+    }
+    else
+    {
+        fr->data_last->next = dt;
+    }
+    fr->data_last = dt;
+
+    return 0;
+}
+
+static int
+_hp_chunk_complete(http_parser *p)
+{
+    return 0;
+}
+
+static void
+_hp_init(mssn_t *mctx)
+{
+    session_t *sctx = _sctx(mctx);
+    // http parser
+    _hp_reset(mctx);
+    // http settins
+    http_parser_settings_init(&sctx->hp_settings);
+    sctx->hp_settings.on_message_begin = _hp_msg_begin;
+    sctx->hp_settings.on_url = _hp_url;
+    sctx->hp_settings.on_header_field = _hp_header_field;
+    sctx->hp_settings.on_header_value = _hp_header_value;
+    sctx->hp_settings.on_headers_complete = _hp_headers_complete;
+    sctx->hp_settings.on_body = _hp_body;
+    sctx->hp_settings.on_message_complete = _hp_msg_complete;
+    sctx->hp_settings.on_status = _hp_status;
+    sctx->hp_settings.on_chunk_header = _hp_chunk_header;
+    sctx->hp_settings.on_chunk_complete = _hp_chunk_complete;
+}
+
+static void
+_hp_reset(mssn_t *mctx)
+{
+    session_t *sctx = _sctx(mctx);
+    http_parser_init(&sctx->hp, HTTP_BOTH);
+    sctx->hp.data = mctx;
+    sctx->hp.method = 0xFF;
+    sctx->hp.status_code = 0xFFFF;
+    sctx->hp.content_length = 0;
+    sctx->hp_token = HP_TOKEN_NONE;
+}
+
+static void
+_hp_fini(mssn_t *mctx)
+{
+}
+
+// MARK: - WebSocket Session
+
+static void
+_ws_genmask(session_t *sctx, uint8_t *buf)
+{
+    uint64_t n = prng_next(&sctx->rng);
+    memcpy(buf, &n, 4);
+}
+
+/// header length from first 2 bytes
+static inline int
+_ws_hlen(const uint8_t *h)
+{
+    int hlen = 2 + ((h[1] & 0x80) ? 4 : 0);
+    switch (h[1] & 0x7F)
+    {
+    case 127:
+        return hlen + 8;
+    case 126:
+        return hlen + 2;
+    default:
+        return hlen;
+    }
+}
+
+/// parse whole frame header
+static int
+_ws_header_parse(mssn_t *mctx, const uint8_t *buf, int hlen)
+{
+    session_t *sctx = _sctx(mctx);
+    ws_t *ws = &sctx->ws;
+
+    _Z_DEBUG("head hex 0x%02x 0x%02x", buf[0], buf[1]);
+
+    ws->h1.fin = buf[0] >> 7;
+    ws->h1.rsv1 = (0x40 & buf[0]) >> 6;
+    ws->h1.rsv2 = (0x20 & buf[0]) >> 5;
+    ws->h1.rsv3 = (0x10 & buf[0]) >> 4;
+    ws->h1.opcode = 0xF & buf[0];
+
+    ws->h2.mask = (0x80 & buf[1]) >> 7;
+    ws->h2.plen = 0x7F & buf[1];
+
+    if (ws->h2.mask && sctx->server)
+    {
+        memcpy(ws->masking_key, buf + hlen - 4, 4);
+        _Z_DEBUG("masking 4 bytes 0x%02x 0x%02x 0x%02x 0x%02x", ws->masking_key[0], ws->masking_key[1], ws->masking_key[2], ws->masking_key[3]);
+    }
+    else if (ws->h2.mask != !!sctx->server)
+    {
+        mctx->error_msg = "masking-key not match";
+        _Z_DEBUG("masking-key not match");
+        return -1;
+    }
+
+    if (ws->h2.plen == 127)
+    {
+        uint64_t tmp_len;
+        memcpy(&tmp_len, buf + 2, 8);
+        ws->u.plen64 = _zswap64(tmp_len);
+    }
+    else if (ws->h2.plen == 126)
+    {
+        uint16_t tmp_len;
+        memcpy(&tmp_len, buf + 2, 2);
+        ws->u.plen64 = ntohs(tmp_len);
+    }
+
+    ws->fr_pread = 0;
+    ws->fr_stage = 1;
+
+    _Z_DEBUG("hlen %d, opcode:%x, fin:%d, plen:%ld", hlen, ws->h1.opcode, ws->h1.fin, _fr_plen(ws));
+    return 0;
+}
+
+/// read frame header at any split point, return bytes consumed, header
+/// complete when fr_stage changed to 1
+static int
+_ws_header(mssn_t *mctx, const uint8_t *buf, int buf_len)
+{
+    ws_t *ws = &_sctx(mctx)->ws;
+
+    // whole header in buffer
+    if ((ws->hread == 0) && (buf_len >= 2) && (buf_len >= _ws_hlen(buf)))
+    {
+        int hlen = _ws_hlen(buf);
+        return (_ws_header_parse(mctx, buf, hlen) < 0) ? -1 : hlen;
+    }
+
+    int nread = 0;
+    int want = 2;
+    for (;;)
+    {
+        if (ws->hread >= 2)
+        {
+            want = _ws_hlen(ws->hbuf);
+        }
+        int n = (int)_zmin(want - ws->hread, buf_len - nread);
+        memcpy(ws->hbuf + ws->hread, buf + nread, n);
+        ws->hread += n;
+        nread += n;
+        if (ws->hread < want)
+        {
+            _Z_DEBUG("header require more data, %d < %d", ws->hread, want);
+            return nread;
+        }
+        if ((want > 2) || (_ws_hlen(ws->hbuf) == 2))
+        {
+            break;
+        }
+    }
+
+    ws->hread = 0;
+    return (_ws_header_parse(mctx, ws->hbuf, want) < 0) ? -1 : nread;
+}
+
+/// select frame for payload, control frame may come between fragments
+static int
+_ws_frame_begin(mssn_t *mctx)
+{
+    session_t *sctx = _sctx(mctx);
+    ws_t *ws = &sctx->ws;
+
+    int ftype = _ws_ftype(ws->h1.opcode);
+    if (ws->h1.opcode == _WS_CONTINUATION_FRAME)
+    {
+        if (sctx->frame_rlast == NULL)
+        {
+            mctx->error_msg = "invalid continuation frame";
+            return -1;
+        }
+        sctx->frame_cread = sctx->frame_rlast;
+        return 0;
+    }
+    else if (ftype < 0)
+    {
+        mctx->error_msg = "invalid opcode";
+        return -1;
+    }
+    else if (ws->h1.opcode & 0x8)
+    {
+        if (!ws->h1.fin || (_fr_plen(ws) > 125))
+        {
+            mctx->error_msg = "invalid control frame";
+            return -1;
+        }
+    }
+    else if (sctx->frame_rlast != NULL)
+    {
+        mctx->error_msg = "expect continuation frame";
+        return -1;
+    }
+
+    mssn_frame_t *fr = _zframe_alloc(sctx);
+    if (fr == NULL)
+    {
+        mctx->error_msg = "alloc frame failed";
+        return -1;
+    }
+    fr->ftype = ftype;
+    fr->data_head = _zchunk_alloc(sctx);
+    fr->data_last = fr->data_head;
+    if (fr->data_head == NULL)
+    {
+        _zframe_free(sctx, fr);
+        mctx->error_msg = "alloc frame failed";
+        return -1;
+    }
+    if (!(ws->h1.opcode & 0x8))
+    {
+        sctx->frame_rlast = fr;
+        // rsv1 in first frame marks compressed message
+        sctx->msg_deflate = (sctx->ws_inflate || sctx->ws_deflate) && ws->h1.rsv1;
+    }
+    sctx->frame_cread = fr;
+    return 0;
+}
+
+/// unmask payload into chunks of current frame
+static int
+_ws_payload(session_t *sctx, const uint8_t *buf, size_t buf_len)
+{
+    ws_t *ws = &sctx->ws;
+    mssn_frame_t *fr = sctx->frame_cread;
+
+    while (buf_len > 0)
+    {
+        mssn_data_t *dt = fr->data_last;
+        if (dt->length == _Z_DATA_LEN)
+        {
+            dt = _zchunk_alloc(sctx);
+            if (dt == NULL)
+            {
+                return -1;
+            }
+            fr->data_last->next = dt;
+            fr->data_last = dt;
+        }
+
+        size_t mlen = _zmin(_Z_DATA_LEN - dt->length, buf_len);
+        if (ws->h2.mask)
+        {
+            simd_mask(dt->data + dt->length, buf, mlen, ws->masking_key, ws->fr_pread);
+        }
+        else
+        {
+            memcpy(dt->data + dt->length, buf, mlen);
+        }
+
+        buf += mlen;
+        buf_len -= mlen;
+        dt->length += mlen;
+        ws->fr_pread += mlen;
+    }
+    return 0;
+}
+
+// MARK: - Zlib
+
+/// zlib alloc through allocator in opaque, size kept before memory
+static voidpf
+_zlib_alloc(voidpf opaque, uInt items, uInt size)
+{
+    const mssn_allocator_t *za = (const mssn_allocator_t *)opaque;
+    size_t n = (size_t)items * size + 16;
+    uint8_t *p = (uint8_t *)za->alloc(za->ud, n);
+    if (p == NULL)
+    {
+        return Z_NULL;
+    }
+    memcpy(p, &n, sizeof(size_t));
+    return p + 16;
+}
+
+static void
+_zlib_free(voidpf opaque, voidpf address)
+{
+    const mssn_allocator_t *za = (const mssn_allocator_t *)opaque;
+    if (address != NULL)
+    {
+        uint8_t *p = (uint8_t *)address - 16;
+        size_t n;
+        memcpy(&n, p, sizeof(size_t));
+        za->free(za->ud, p, n);
+    }
+}
+
+/// create raw inflate stream with mem_level 0, or deflate stream
+static z_stream *
+_zs_create(mssn_allocator_t *za, int wbits, int mem_level)
+{
+    z_stream *zs = (z_stream *)za->alloc(za->ud, sizeof(z_stream));
+    if (zs == NULL)
+    {
+        return NULL;
+    }
+    memset(zs, 0, sizeof(z_stream));
+    zs->zalloc = _zlib_alloc;
+    zs->zfree = _zlib_free;
+    zs->opaque = za;
+    int ret = (mem_level <= 0)
+                  ? inflateInit2(zs, -wbits)
+                  : deflateInit2(zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -wbits, mem_level, Z_DEFAULT_STRATEGY);
+    if (ret != Z_OK)
+    {
+        za->free(za->ud, zs, sizeof(z_stream));
+        return NULL;
+    }
+    return zs;
+}
+
+static void
+_zs_destroy(mssn_allocator_t *za, z_stream *zs, int deflate)
+{
+    if (deflate)
+    {
+        deflateEnd(zs);
+    }
+    else
+    {
+        inflateEnd(zs);
+    }
+    za->free(za->ud, zs, sizeof(z_stream));
+}
+
+// MARK: - Zlib Pool
+
+struct s_mssn_zpool
+{
+    int window_bits;
+    int mem_level;
+    int capacity; // max idle streams of each kind
+    int nin;      // idle inflate streams
+    int nout;     // idle deflate streams
+    mssn_allocator_t za;
+    z_stream **zin;
+    z_stream **zout;
+};
+
+mssn_zpool_t *
+mssn_zpool_create(int window_bits, int mem_level, int capacity, const mssn_allocator_t *allocator)
+{
+    const mssn_allocator_t *za = allocator ? allocator : &_zlibc;
+    if ((window_bits < 9) || (window_bits > 15) || (mem_level < 1) || (mem_level > 9) || (capacity <= 0) ||
+        (za->alloc == NULL) || (za->free == NULL))
+    {
+        return NULL;
+    }
+
+    mssn_zpool_t *zpool = (mssn_zpool_t *)za->alloc(za->ud, sizeof(mssn_zpool_t));
+    if (zpool == NULL)
+    {
+        return NULL;
+    }
+    memset(zpool, 0, sizeof(mssn_zpool_t));
+    zpool->za = *za;
+    zpool->zin = (z_stream **)za->alloc(za->ud, capacity * sizeof(z_stream *));
+    zpool->zout = (z_stream **)za->alloc(za->ud, capacity * sizeof(z_stream *));
+    if ((zpool->zin == NULL) || (zpool->zout == NULL))
+    {
+        if (zpool->zin)
+        {
+            za->free(za->ud, zpool->zin, capacity * sizeof(z_stream *));
+        }
+        if (zpool->zout)
+        {
+            za->free(za->ud, zpool->zout, capacity * sizeof(z_stream *));
+        }
+        za->free(za->ud, zpool, sizeof(mssn_zpool_t));
+        return NULL;
+    }
+    zpool->window_bits = window_bits;
+    zpool->mem_level = mem_level;
+    zpool->capacity = capacity;
+
+    // pre-initialized streams
+    while (zpool->nin < capacity)
+    {
+        z_stream *zs = _zs_create(&zpool->za, window_bits, 0);
+        if (zs == NULL)
+        {
+            break;
+        }
+        zpool->zin[zpool->nin++] = zs;
+    }
+    while (zpool->nout < capacity)
+    {
+        z_stream *zs = _zs_create(&zpool->za, window_bits, mem_level);
+        if (zs == NULL)
+        {
+            break;
+        }
+        zpool->zout[zpool->nout++] = zs;
+    }
+    return zpool;
+}
+
+void mssn_zpool_destroy(mssn_zpool_t *zpool)
+{
+    if (zpool == NULL)
+    {
+        return;
+    }
+    while (zpool->nin > 0)
+    {
+        _zs_destroy(&zpool->za, zpool->zin[--zpool->nin], 0);
+    }
+    while (zpool->nout > 0)
+    {
+        _zs_destroy(&zpool->za, zpool->zout[--zpool->nout], 1);
+    }
+    mssn_allocator_t za = zpool->za;
+    za.free(za.ud, zpool->zin, zpool->capacity * sizeof(z_stream *));
+    za.free(za.ud, zpool->zout, zpool->capacity * sizeof(z_stream *));
+    za.free(za.ud, zpool, sizeof(mssn_zpool_t));
+}
+
+/// borrow idle stream, create one when pool is empty
+static z_stream *
+_zspool_get(mssn_zpool_t *zpool, int deflate)
+{
+    if (deflate)
+    {
+        return (zpool->nout > 0) ? zpool->zout[--zpool->nout]
+                                 : _zs_create(&zpool->za, zpool->window_bits, zpool->mem_level);
+    }
+    return (zpool->nin > 0) ? zpool->zin[--zpool->nin] : _zs_create(&zpool->za, zpool->window_bits, 0);
+}
+
+/// reset stream and keep it idle, destroy it when pool is full
+static void
+_zspool_put(mssn_zpool_t *zpool, z_stream *zs, int deflate)
+{
+    if (deflate && (zpool->nout < zpool->capacity))
+    {
+        deflateReset(zs);
+        zpool->zout[zpool->nout++] = zs;
+    }
+    else if (!deflate && (zpool->nin < zpool->capacity))
+    {
+        inflateReset(zs);
+        zpool->zin[zpool->nin++] = zs;
+    }
+    else
+    {
+        _zs_destroy(&zpool->za, zs, deflate);
+    }
+}
+
+// MARK: - Session Zlib
+
+static z_stream *
+_ws_zin(session_t *sctx)
+{
+    if (sctx->zin != NULL)
+    {
+        return sctx->zin;
+    }
+    // borrow for one message without context takeover
+    mssn_zpool_t *zpool = sctx->zpool;
+    if ((zpool != NULL) && sctx->zp.in_reset && (sctx->zp.in_bits <= zpool->window_bits))
+    {
+        sctx->zin = _zspool_get(zpool, 0);
+        sctx->zin_pooled = (sctx->zin != NULL);
+        return sctx->zin;
+    }
+    sctx->zin = _zs_create(&sctx->za, sctx->zp.in_bits, 0);
+    return sctx->zin;
+}
+
+static z_stream *
+_ws_zout(session_t *sctx)
+{
+    if (sctx->zout != NULL)
+    {
+        return sctx->zout;
+    }
+    const int wbits = (sctx->ws_wbits < sctx->zp.out_bits) ? sctx->ws_wbits : sctx->zp.out_bits;
+    // borrow for one message without context takeover, smaller window was compatible
+    mssn_zpool_t *zpool = sctx->zpool;
+    if ((zpool != NULL) && sctx->zp.out_reset && (zpool->window_bits <= wbits))
+    {
+        sctx->zout = _zspool_get(zpool, 1);
+        sctx->zout_pooled = (sctx->zout != NULL);
+        return sctx->zout;
+    }
+    sctx->zout = _zs_create(&sctx->za, wbits, sctx->ws_memlevel);
+    return sctx->zout;
+}
+
+static void
+_ws_zin_release(session_t *sctx)
+{
+    if (sctx->zin == NULL)
+    {
+        return;
+    }
+    if (sctx->zin_pooled)
+    {
+        _zspool_put(sctx->zpool, sctx->zin, 0);
+    }
+    else
+    {
+        _zs_destroy(&sctx->za, sctx->zin, 0);
+    }
+    sctx->zin = NULL;
+    sctx->zin_pooled = 0;
+}
 
-    if (sctx->stage == SESSION_STAGE_WS)
+static void
+_ws_zout_release(session_t *sctx)
+{
+    if (sctx->zout == NULL)
     {
-        // return for WebSocket connection
-        _Z_REPORT("mssn_reclaim ws");
         return;
     }
-
-    mctx->state = MSSN_STATE_INIT;
-    mctx->method = NULL;
-
-    // clear path
-    _zfree((void *)mctx->path);
-    mctx->path = NULL;
-    mctx->status = 0;
-
-    // clear headers
-    mssn_header_t *n = mctx->headers;
-    while (n != NULL)
+    if (sctx->zout_pooled)
     {
-        mssn_header_t *tmp = n->next;
-        _zfree((void *)n->key);
-        _zfree((void *)n->value);
-        _zfree(n);
-        n = tmp;
+        _zspool_put(sctx->zpool, sctx->zout, 1);
     }
-    mctx->headers = NULL;
-    sctx->header_rlast = NULL;
-    _Z_REPORT("mssn_reclaim http");
+    else
+    {
+        _zs_destroy(&sctx->za, sctx->zout, 1);
+    }
+    sctx->zout = NULL;
+    sctx->zout_pooled = 0;
 }
 
-void mssn_sha1(const uint8_t *data, int data_len, uint8_t *digest)
+static void
+_ws_zfini(session_t *sctx)
 {
-    SHA1_HASH hash;
-    Sha1Calculate(data, data_len, &hash);
-    memcpy(digest, hash.bytes, 20);
+    _ws_zin_release(sctx);
+    _ws_zout_release(sctx);
 }
 
-// MARK: - HTTP Session
-
-static int
-_hp_msg_begin(http_parser *p)
+/// apply negotiated parameters, NULL for default, streams created with other parameters were released
+static void
+_ws_zparam(session_t *sctx, const zparam_t *zp)
 {
-    mssn_t *mctx = _mctx(p);
-    mctx->state = MSSN_STATE_BEGIN;
-    _sctx(mctx)->stage = SESSION_STAGE_HTTP;
-    return 0;
+    static const zparam_t zdefault = {15, 15, 0, 0};
+    if (zp == NULL)
+    {
+        zp = &zdefault;
+    }
+    if ((sctx->zp.in_bits != zp->in_bits) || (sctx->zp.out_bits != zp->out_bits) ||
+        (sctx->zp.in_reset != zp->in_reset) || (sctx->zp.out_reset != zp->out_reset))
+    {
+        _ws_zfini(sctx);
+    }
+    sctx->zp = *zp;
 }
 
-static int
-_hp_status(http_parser *p, const char *at, size_t length)
+int mssn_zpool_attach(mssn_t *mctx, mssn_zpool_t *zpool)
 {
+    session_t *sctx = _sctx(mctx);
+    if (sctx == NULL)
+    {
+        return -1;
+    }
+    if (sctx->zpool != zpool)
+    {
+        _ws_zfini(sctx);
+        sctx->zpool = zpool;
+    }
     return 0;
 }
 
-static int
-_hp_headers_complete(http_parser *p)
+// MARK: - Broadcast
+
+struct s_mssn_bcast
 {
-    mssn_t *mctx = _mctx(p);
+    int refs;                // atomic
+    int wbits;               // window bits of deflated frames, 0 for none
+    size_t plain_len;        // bytes of plain frames
+    size_t deflated_len;     // bytes of deflated frames
+    size_t size;             // allocation size
+    uint64_t sends;          // atomic
+    uint64_t sends_deflated; // atomic
+    uint64_t bytes_sent;     // atomic
+    mssn_allocator_t za;
+    uint8_t *plain;
+    uint8_t *deflated;
+};
 
-    if (p->method == 0xff)
+/// deflate with fresh stream, the message never references earlier ones,
+/// output NULL for no gain
+static uint8_t *
+_bcast_deflate(mssn_allocator_t *za, int wbits, const uint8_t *buf, size_t buf_len, size_t *keep, size_t *zsize)
+{
+    z_stream *zs = _zs_create(za, wbits, 8);
+    if (zs == NULL)
     {
-        mctx->method = NULL;
+        return NULL;
     }
-    else
+    *zsize = deflateBound(zs, buf_len) + 6 * (buf_len / ((size_t)1 << 30) + 2);
+    uint8_t *zbuf = (uint8_t *)za->alloc(za->ud, *zsize);
+    size_t total = 0;
+    if ((zbuf != NULL) && ((_ws_deflate_contig(zs, buf, buf_len, zbuf, *zsize, &total) < 0) ||
+                           _ws_deflate_tail(zbuf, total, buf_len, 1, keep)))
     {
-        mctx->method = http_method_str(p->method);
+        za->free(za->ud, zbuf, *zsize);
+        zbuf = NULL;
     }
+    _zs_destroy(za, zs, 1);
+    return zbuf;
+}
 
-    mctx->status = p->status_code;
-    mctx->state = MSSN_STATE_HEADER;
+mssn_bcast_t *
+mssn_bcast_create(mssn_frame_type ftype,
+                  int rsv_bits,
+                  size_t frame_size,
+                  const uint8_t *buf,
+                  size_t buf_len,
+                  int window_bits,
+                  const mssn_allocator_t *allocator)
+{
+    mssn_allocator_t za = allocator ? *allocator : _zlibc;
+    if ((za.alloc == NULL) || (za.free == NULL) || (ftype < WS_FRAME_PING) || (ftype > WS_FRAME_BINARY))
+    {
+        return NULL;
+    }
+    int is_ctrl = (ftype == WS_FRAME_PING) || (ftype == WS_FRAME_PONG) || (ftype == WS_FRAME_CLOSE);
+    if ((!is_ctrl && (buf == NULL || buf_len <= 0)) || (is_ctrl && buf_len > 125))
+    {
+        return NULL;
+    }
+    const int hframe = _ws_build_hlen(frame_size, 0);
+    if (frame_size <= (size_t)hframe)
+    {
+        return NULL;
+    }
+    const size_t pcap = frame_size - hframe;
 
-    if (!p->upgrade || (mctx->headers == NULL))
+    // deflated copy for peers without server context takeover
+    int deflate = (rsv_bits & MSSN_BUILD_DEFLATE) && !is_ctrl;
+    size_t keep = 0;
+    size_t zsize = 0;
+    uint8_t *zbuf = NULL;
+    if (deflate)
     {
-        return 0;
+        if ((window_bits < 9) || (window_bits > 15) || (pcap <= 6))
+        {
+            return NULL;
+        }
+        zbuf = _bcast_deflate(&za, window_bits, buf, buf_len, &keep, &zsize);
     }
 
-    int has_version = 0;
-    mssn_header_t *h = mctx->headers;
-    do
+    const size_t plain_len = _ws_plain_size(pcap, buf_len, 0);
+    const size_t deflated_len = zbuf ? _ws_plain_size(pcap, keep, 0) : 0;
+    const size_t size = sizeof(mssn_bcast_t) + plain_len + deflated_len;
+    mssn_bcast_t *b = (mssn_bcast_t *)za.alloc(za.ud, size);
+    if (b == NULL)
     {
-        mssn_header_t *n = h->next;
-        if ((strncmp(h->key, "Sec-WebSocket-Version", 21) == 0) &&
-            (strncmp(h->value, "13", 2) == 0))
+        if (zbuf)
         {
-            has_version = 1;
-            break;
+            za.free(za.ud, zbuf, zsize);
         }
-        h = n;
-    } while (h);
+        return NULL;
+    }
+    memset(b, 0, sizeof(mssn_bcast_t));
+    b->refs = 1;
+    b->za = za;
+    b->size = size;
+    b->plain = (uint8_t *)(b + 1);
+    b->plain_len = _ws_into_frames(NULL, ftype, rsv_bits & (deflate ? 0x3 : 0x7), 0, pcap, buf, buf_len, b->plain);
+    if (zbuf)
+    {
+        b->wbits = window_bits;
+        b->deflated = b->plain + plain_len;
+        b->deflated_len = _ws_into_frames(NULL, ftype, rsv_bits & 0x7, 1, pcap, zbuf, keep, b->deflated);
+        za.free(za.ud, zbuf, zsize);
+    }
+    return b;
+}
 
-    if (has_version)
+mssn_bcast_t *
+mssn_bcast_ref(mssn_bcast_t *b)
+{
+    if (b != NULL)
     {
-        mctx->upgrade = 1;
-        mctx->state = MSSN_STATE_BODY;
-        _ws_init(mctx);
+        _Z_ATOMIC_ADD(b->refs, 1);
     }
-    else
+    return b;
+}
+
+void mssn_bcast_unref(mssn_bcast_t *b)
+{
+    if ((b != NULL) && (_Z_ATOMIC_UNREF(b->refs) == 0))
     {
-        mctx->error_msg = "Invalid websocket version !";
+        mssn_allocator_t za = b->za;
+        za.free(za.ud, b, b->size);
     }
-    return 0;
 }
 
-static int
-_hp_msg_complete(http_parser *p)
+const uint8_t *
+mssn_bcast_frames(mssn_t *mctx, mssn_bcast_t *b, size_t *len)
 {
-    mssn_t *mctx = _mctx(p);
-    mctx->state = MSSN_STATE_FINISH;
-    return 0;
+    session_t *sctx = _sctx(mctx);
+    if ((sctx == NULL) || (b == NULL) || (len == NULL))
+    {
+        return NULL;
+    }
+    if (!sctx->server)
+    {
+        mctx->error_msg = "broadcast requires server";
+        return NULL;
+    }
+
+    // deflated frames decodable by peer resetting inflate per message with no smaller window
+    const int use_deflated = (b->deflated != NULL) && sctx->ws_deflate && sctx->zp.out_reset &&
+                             (b->wbits <= sctx->zp.out_bits);
+    *len = use_deflated ? b->deflated_len : b->plain_len;
+    _Z_ATOMIC_ADD(b->sends, 1);
+    _Z_ATOMIC_ADD(b->bytes_sent, *len);
+    if (use_deflated)
+    {
+        _Z_ATOMIC_ADD(b->sends_deflated, 1);
+        return b->deflated;
+    }
+    return b->plain;
 }
 
-static int
-_hp_url(http_parser *p, const char *at, size_t length)
+void mssn_bcast_stats(mssn_bcast_t *b, mssn_bcast_stats_t *st)
 {
-    mssn_t *mctx = _mctx(p);
-    if (mctx->path)
+    if ((b == NULL) || (st == NULL))
     {
-        _zfree((void *)mctx->path);
+        return;
     }
-    mctx->path = _zalloc(1, length + 1);
-    memcpy((char *)mctx->path, at, length);
-    return 0;
+    st->refs = (size_t)_Z_ATOMIC_LOAD(b->refs);
+    st->shared_bytes = b->plain_len + b->deflated_len;
+    st->sends = _Z_ATOMIC_LOAD(b->sends);
+    st->sends_deflated = _Z_ATOMIC_LOAD(b->sends_deflated);
+    st->dup_bytes = _Z_ATOMIC_LOAD(b->bytes_sent);
 }
 
+/// inflate frame data into new chunks, append 00 00 ff ff for message end, output counted
+/// from fr->offset against ws_inflate_max
 static int
-_hp_header_field(http_parser *p, const char *at, size_t length)
+_ws_inflate(mssn_t *mctx, mssn_frame_t *fr, int final)
 {
-    mssn_header_t *h = _zalloc(1, sizeof(mssn_header_t));
-    h->key = _zalloc(1, length + 1);
-    memcpy((char *)h->key, at, length);
+    static const uint8_t tail[4] = {0x00, 0x00, 0xff, 0xff};
+    session_t *sctx = _sctx(mctx);
+    z_stream *zs = _ws_zin(sctx);
+    if (zs == NULL)
+    {
+        mctx->error_msg = "inflate init error";
+        return -1;
+    }
 
-    mssn_t *mctx = _mctx(p);
-    if (mctx->headers == NULL)
+    mssn_data_t *head = _zchunk_alloc(sctx);
+    if (head == NULL)
     {
-        mctx->headers = h;
+        mctx->error_msg = "alloc inflate data failed";
+        return -1;
     }
+    mssn_data_t *last = head;
+    zs->next_out = head->data;
+    zs->avail_out = _Z_DATA_LEN;
 
-    session_t *sctx = _sctx(mctx);
-    if (sctx->header_rlast != NULL)
+    mssn_data_t *in = fr->data_head;
+    uint64_t out = 0;
+    int ret = Z_OK;
+    for (int tail_done = !final; (in != NULL) || !tail_done;)
     {
-        sctx->header_rlast->next = h;
+        if (in != NULL)
+        {
+            zs->next_in = in->data;
+            zs->avail_in = in->length;
+            in = in->next;
+        }
+        else
+        {
+            zs->next_in = (Bytef *)tail;
+            zs->avail_in = 4;
+            tail_done = 1;
+        }
+
+        while ((zs->avail_in > 0) || (zs->avail_out == 0))
+        {
+            if (zs->avail_out == 0)
+            {
+                last->length = _Z_DATA_LEN;
+                out += _Z_DATA_LEN;
+                if ((sctx->ws_inflate_max > 0) && (fr->offset + out > sctx->ws_inflate_max))
+                {
+                    // decompression bomb stops before next chunk
+                    _zdata_free(sctx, head);
+                    mctx->error_msg = "message too big";
+                    return -1;
+                }
+                last->next = _zchunk_alloc(sctx);
+                if (last->next == NULL)
+                {
+                    _zdata_free(sctx, head);
+                    mctx->error_msg = "alloc inflate data failed";
+                    return -1;
+                }
+                last = last->next;
+                zs->next_out = last->data;
+                zs->avail_out = _Z_DATA_LEN;
+            }
+            ret = inflate(zs, Z_SYNC_FLUSH);
+            if (ret == Z_STREAM_END)
+            {
+                // peer finished deflate stream with final block
+                inflateReset(zs);
+            }
+            else if (ret == Z_BUF_ERROR)
+            {
+                if (zs->avail_out > 0)
+                {
+                    break; // no progress possible
+                }
+            }
+            else if (ret != Z_OK)
+            {
+                _Z_DEBUG("inflate error %d", ret);
+                last->length = _Z_DATA_LEN - zs->avail_out;
+                _zdata_free(sctx, head);
+                mctx->error_msg = "inflate error";
+                return -1;
+            }
+        }
+    }
+    last->length = _Z_DATA_LEN - zs->avail_out;
+    if ((sctx->ws_inflate_max > 0) && (fr->offset + out + last->length > sctx->ws_inflate_max))
+    {
+        _zdata_free(sctx, head);
+        mctx->error_msg = "message too big";
+        return -1;
     }
-    sctx->header_rlast = h;
 
+    _zdata_free(sctx, fr->data_head);
+    fr->data_head = head;
+    fr->data_last = last;
     return 0;
 }
 
-static int
-_hp_header_value(http_parser *p, const char *at, size_t length)
+static void
+_ws_output(mssn_t *mctx, mssn_frame_t *fr)
 {
-    mssn_t *mctx = _mctx(p);
-    mssn_header_t *h = _sctx(mctx)->header_rlast;
-    if (h != NULL)
+    session_t *sctx = _sctx(mctx);
+    if (sctx->frame_wlast == NULL)
     {
-        h->value = _zalloc(1, length + 1);
-        memcpy((char *)h->value, at, length);
+        mctx->frames = fr;
     }
-    return 0;
+    else
+    {
+        sctx->frame_wlast->next = fr;
+    }
+    sctx->frame_wlast = fr;
 }
 
+/// output message after fin frame
 static int
-_hp_chunk_header(http_parser *p)
+_ws_frame_end(mssn_t *mctx)
 {
+    session_t *sctx = _sctx(mctx);
+    mssn_frame_t *fr = sctx->frame_cread;
+    sctx->frame_cread = NULL;
+    sctx->ws.fr_stage = 0;
+
+    if (!sctx->ws.h1.fin)
+    {
+        return 0;
+    }
+
+    if (fr == sctx->frame_rlast)
+    {
+        fr->offset = sctx->msg_offset;
+        sctx->frame_rlast = NULL;
+        sctx->msg_offset = 0;
+        if (sctx->msg_deflate && (_ws_inflate(mctx, fr, 1) < 0))
+        {
+            _zframe_free(sctx, fr);
+            return -1;
+        }
+        if (sctx->msg_deflate && sctx->zp.in_reset)
+        {
+            // no context takeover, idle session keeps no inflate state
+            _ws_zin_release(sctx);
+        }
+    }
+    fr->fin = 1;
+    _ws_output(mctx, fr);
     return 0;
 }
 
+/// output payload of unfinished message, continue reading with new frame
 static int
-_hp_body(http_parser *p, const char *at, size_t length)
+_ws_stream(mssn_t *mctx)
 {
-    mssn_t *mctx = _mctx(p);
     session_t *sctx = _sctx(mctx);
-
-    mssn_frame_t *fr = mctx->frames;
-    if (fr == NULL)
+    mssn_frame_t *fr = sctx->frame_rlast;
+    if ((fr == NULL) || (fr->data_head->length <= 0))
     {
-        fr = _zalloc(1, sizeof(mssn_frame_t));
-        fr->ftype = HTTP_FRAME_BODY;
-        mctx->frames = fr;
-        sctx->frame_rlast = NULL;
+        return 0;
     }
 
-    if (fr->data_head == NULL)
+    mssn_frame_t *nfr = _zframe_alloc(sctx);
+    if (nfr == NULL)
     {
-        fr->data_head = _zdata_alloc((uint8_t *)at, length);
-        fr->data_last = fr->data_head;
+        mctx->error_msg = "alloc frame failed";
+        return -1;
     }
-    else
+    nfr->ftype = fr->ftype;
+    nfr->data_head = _zchunk_alloc(sctx);
+    nfr->data_last = nfr->data_head;
+    if (nfr->data_head == NULL)
+    {
+        _zframe_free(sctx, nfr);
+        mctx->error_msg = "alloc frame failed";
+        return -1;
+    }
+    if (sctx->frame_cread == fr)
     {
-        fr->data_last->next = _zdata_alloc((uint8_t *)at, length);
-        fr->data_last = fr->data_last->next;
+        sctx->frame_cread = nfr;
     }
+    sctx->frame_rlast = nfr;
 
-    return 0;
-}
+    fr->offset = sctx->msg_offset;
+    if (sctx->msg_deflate && (_ws_inflate(mctx, fr, 0) < 0))
+    {
+        _zframe_free(sctx, fr);
+        return -1;
+    }
 
-static int
-_hp_chunk_complete(http_parser *p)
-{
+    fr->fin = 0;
+    for (mssn_data_t *dt = fr->data_head; dt != NULL; dt = dt->next)
+    {
+        sctx->msg_offset += dt->length;
+    }
+    _ws_output(mctx, fr);
     return 0;
 }
 
-static void
-_hp_init(mssn_t *mctx)
+/// process every complete frame in buffer
+static int
+_ws_process(mssn_t *mctx, const uint8_t *buf, int buf_len)
 {
     session_t *sctx = _sctx(mctx);
-    // http parser
-    http_parser_init(&sctx->hp, HTTP_BOTH);
-    sctx->hp.data = mctx;
-    sctx->hp.method = 0xFF;
-    sctx->hp.status_code = 0xFFFF;
-    sctx->hp.content_length = 0;
-    // http settins
-    http_parser_settings_init(&sctx->hp_settings);
-    sctx->hp_settings.on_message_begin = _hp_msg_begin;
-    sctx->hp_settings.on_url = _hp_url;
-    sctx->hp_settings.on_header_field = _hp_header_field;
-    sctx->hp_settings.on_header_value = _hp_header_value;
-    sctx->hp_settings.on_headers_complete = _hp_headers_complete;
-    sctx->hp_settings.on_body = _hp_body;
-    sctx->hp_settings.on_message_complete = _hp_msg_complete;
-    sctx->hp_settings.on_status = _hp_status;
-    sctx->hp_settings.on_chunk_header = _hp_chunk_header;
-    sctx->hp_settings.on_chunk_complete = _hp_chunk_complete;
-}
+    ws_t *ws = &sctx->ws;
+    int nread = 0;
 
-static void
-_hp_fini(mssn_t *mctx)
-{
-}
+    for (;;)
+    {
+        if (ws->fr_stage == 0)
+        {
+            int hlen = _ws_header(mctx, buf + nread, buf_len - nread);
+            if (hlen < 0)
+            {
+                return -1;
+            }
+            nread += hlen;
+            if (ws->fr_stage == 0)
+            {
+                break; // header splited, all consumed
+            }
+            if (_ws_frame_begin(mctx) < 0)
+            {
+                return -1;
+            }
+        }
 
-// MARK: - WebSocket Session
+        size_t mlen = _zmin(_fr_plen(ws) - ws->fr_pread, buf_len - nread);
+        _Z_DEBUG("payload mlen %ld, buf_len %d", mlen, buf_len - nread);
+        if (_ws_payload(sctx, buf + nread, mlen) < 0)
+        {
+            mctx->error_msg = "alloc payload failed";
+            return -1;
+        }
+        nread += mlen;
 
-static void
-_ws_genmask(session_t *sctx, uint8_t *buf)
-{
-    uint64_t n = prng_next(&sctx->rng);
-    memcpy(buf, &n, 4);
+        if (ws->fr_pread < _fr_plen(ws))
+        {
+            break; // require more data
+        }
+
+        if (_ws_frame_end(mctx) < 0)
+        {
+            return -1;
+        }
+        if (nread >= buf_len)
+        {
+            break;
+        }
+    }
+
+    if (sctx->ws_stream && (_ws_stream(mctx) < 0))
+    {
+        return -1;
+    }
+    return nread;
 }
 
 static void
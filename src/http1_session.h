@@ -20,11 +20,115 @@ typedef struct s_mssn_data
     uint8_t *data;
 } mssn_data_t;
 
+typedef struct
+{
+    int offset; // offset in buffer of last mssn_process, -1 for copied into session
+    int length; // span length
+} mssn_span_t;
+
+/// known header names, interned while parsing
+typedef enum
+{
+    MSSN_H_UNKNOWN = 0,
+    MSSN_H_A_IM,                             // A-IM
+    MSSN_H_ACCEPT,                           // Accept
+    MSSN_H_ACCEPT_CHARSET,                   // Accept-Charset
+    MSSN_H_ACCEPT_DATETIME,                  // Accept-Datetime
+    MSSN_H_ACCEPT_ENCODING,                  // Accept-Encoding
+    MSSN_H_ACCEPT_LANGUAGE,                  // Accept-Language
+    MSSN_H_ACCEPT_PATCH,                     // Accept-Patch
+    MSSN_H_ACCEPT_RANGES,                    // Accept-Ranges
+    MSSN_H_ACCESS_CONTROL_ALLOW_CREDENTIALS, // Access-Control-Allow-Credentials
+    MSSN_H_ACCESS_CONTROL_ALLOW_HEADERS,     // Access-Control-Allow-Headers
+    MSSN_H_ACCESS_CONTROL_ALLOW_METHODS,     // Access-Control-Allow-Methods
+    MSSN_H_ACCESS_CONTROL_ALLOW_ORIGIN,      // Access-Control-Allow-Origin
+    MSSN_H_ACCESS_CONTROL_EXPOSE_HEADERS,    // Access-Control-Expose-Headers
+    MSSN_H_ACCESS_CONTROL_MAX_AGE,           // Access-Control-Max-Age
+    MSSN_H_ACCESS_CONTROL_REQUEST_HEADERS,   // Access-Control-Request-Headers
+    MSSN_H_ACCESS_CONTROL_REQUEST_METHOD,    // Access-Control-Request-Method
+    MSSN_H_AGE,                              // Age
+    MSSN_H_ALLOW,                            // Allow
+    MSSN_H_ALT_SVC,                          // Alt-Svc
+    MSSN_H_AUTHORIZATION,                    // Authorization
+    MSSN_H_CACHE_CONTROL,                    // Cache-Control
+    MSSN_H_CONNECTION,                       // Connection
+    MSSN_H_CONTENT_DISPOSITION,              // Content-Disposition
+    MSSN_H_CONTENT_ENCODING,                 // Content-Encoding
+    MSSN_H_CONTENT_LANGUAGE,                 // Content-Language
+    MSSN_H_CONTENT_LENGTH,                   // Content-Length
+    MSSN_H_CONTENT_LOCATION,                 // Content-Location
+    MSSN_H_CONTENT_RANGE,                    // Content-Range
+    MSSN_H_CONTENT_SECURITY_POLICY,          // Content-Security-Policy
+    MSSN_H_CONTENT_TYPE,                     // Content-Type
+    MSSN_H_COOKIE,                           // Cookie
+    MSSN_H_DATE,                             // Date
+    MSSN_H_DNT,                              // DNT
+    MSSN_H_ETAG,                             // ETag
+    MSSN_H_EXPECT,                           // Expect
+    MSSN_H_EXPIRES,                          // Expires
+    MSSN_H_FORWARDED,                        // Forwarded
+    MSSN_H_FROM,                             // From
+    MSSN_H_HOST,                             // Host
+    MSSN_H_IF_MATCH,                         // If-Match
+    MSSN_H_IF_MODIFIED_SINCE,                // If-Modified-Since
+    MSSN_H_IF_NONE_MATCH,                    // If-None-Match
+    MSSN_H_IF_RANGE,                         // If-Range
+    MSSN_H_IF_UNMODIFIED_SINCE,              // If-Unmodified-Since
+    MSSN_H_KEEP_ALIVE,                       // Keep-Alive
+    MSSN_H_LAST_MODIFIED,                    // Last-Modified
+    MSSN_H_LINK,                             // Link
+    MSSN_H_LOCATION,                         // Location
+    MSSN_H_MAX_FORWARDS,                     // Max-Forwards
+    MSSN_H_ORIGIN,                           // Origin
+    MSSN_H_PRAGMA,                           // Pragma
+    MSSN_H_PROXY_AUTHENTICATE,               // Proxy-Authenticate
+    MSSN_H_PROXY_AUTHORIZATION,              // Proxy-Authorization
+    MSSN_H_PROXY_CONNECTION,                 // Proxy-Connection
+    MSSN_H_RANGE,                            // Range
+    MSSN_H_REFERER,                          // Referer
+    MSSN_H_REFRESH,                          // Refresh
+    MSSN_H_RETRY_AFTER,                      // Retry-After
+    MSSN_H_SEC_FETCH_DEST,                   // Sec-Fetch-Dest
+    MSSN_H_SEC_FETCH_MODE,                   // Sec-Fetch-Mode
+    MSSN_H_SEC_FETCH_SITE,                   // Sec-Fetch-Site
+    MSSN_H_SEC_FETCH_USER,                   // Sec-Fetch-User
+    MSSN_H_SEC_WEBSOCKET_ACCEPT,             // Sec-WebSocket-Accept
+    MSSN_H_SEC_WEBSOCKET_EXTENSIONS,         // Sec-WebSocket-Extensions
+    MSSN_H_SEC_WEBSOCKET_KEY,                // Sec-WebSocket-Key
+    MSSN_H_SEC_WEBSOCKET_PROTOCOL,           // Sec-WebSocket-Protocol
+    MSSN_H_SEC_WEBSOCKET_VERSION,            // Sec-WebSocket-Version
+    MSSN_H_SERVER,                           // Server
+    MSSN_H_SET_COOKIE,                       // Set-Cookie
+    MSSN_H_STRICT_TRANSPORT_SECURITY,        // Strict-Transport-Security
+    MSSN_H_TE,                               // TE
+    MSSN_H_TRAILER,                          // Trailer
+    MSSN_H_TRANSFER_ENCODING,                // Transfer-Encoding
+    MSSN_H_UPGRADE,                          // Upgrade
+    MSSN_H_UPGRADE_INSECURE_REQUESTS,        // Upgrade-Insecure-Requests
+    MSSN_H_USER_AGENT,                       // User-Agent
+    MSSN_H_VARY,                             // Vary
+    MSSN_H_VIA,                              // Via
+    MSSN_H_WARNING,                          // Warning
+    MSSN_H_WWW_AUTHENTICATE,                 // WWW-Authenticate
+    MSSN_H_X_CONTENT_TYPE_OPTIONS,           // X-Content-Type-Options
+    MSSN_H_X_FORWARDED_FOR,                  // X-Forwarded-For
+    MSSN_H_X_FORWARDED_HOST,                 // X-Forwarded-Host
+    MSSN_H_X_FORWARDED_PROTO,                // X-Forwarded-Proto
+    MSSN_H_X_FRAME_OPTIONS,                  // X-Frame-Options
+    MSSN_H_X_REAL_IP,                        // X-Real-IP
+    MSSN_H_X_REQUESTED_WITH,                 // X-Requested-With
+    MSSN_H_MAX
+} mssn_header_id;
+
 typedef struct s_mssn_header
 {
     const char *key;
     const char *value;
     struct s_mssn_header *next;
+    mssn_span_t key_span;      // key span
+    mssn_span_t value_span;    // value span
+    int id;                    // mssn_header_id of key, MSSN_H_UNKNOWN for others
+    struct s_mssn_header *dup; // next header of same name, case-insensitive
 } mssn_header_t;
 
 typedef enum
@@ -43,6 +147,8 @@ typedef struct s_mssn_frame
     mssn_data_t *data_head;    // data head, unmasking
     mssn_data_t *data_last;    // data last
     struct s_mssn_frame *next; // next frame
+    uint64_t offset;           // payload offset in message, with MSSN_OPT_WS_STREAM
+    int fin;                   // last part of message
 } mssn_frame_t;
 
 typedef enum
@@ -60,35 +166,180 @@ typedef struct
     mssn_state_t state;     // state for last processing
     const char *method;     // method, nil meens HTTP response
     const char *path;       // path, nil meens HTTP response
+    mssn_span_t path_span;  // path span
     int status;             // http response status code
     int upgrade;            // upgrade to websocket
     mssn_header_t *headers; // header data for last process
-    mssn_frame_t *frames;   // frames data for last process
+    mssn_frame_t *frames;   // frames data since last reclaim
     const char *error_msg;  // error message for last process
     void *opaque;           // internal use
 } mssn_t;
 
+typedef enum
+{
+    MSSN_OPT_ZERO_COPY = 1,              // non-zero for headers, path referencing buffer of mssn_process
+    MSSN_OPT_WS_STREAM = 2,              // non-zero for delivering partial websocket message
+    MSSN_OPT_WS_INFLATE = 3,             // non-zero for inflating permessage-deflate message
+    MSSN_OPT_WS_WINDOW_BITS = 4,         // permessage-deflate max window bits, 9 ~ 15, default 15
+    MSSN_OPT_WS_MEM_LEVEL = 5,           // deflate memLevel, 1 ~ 9, default 8
+    MSSN_OPT_WS_NO_CONTEXT_TAKEOVER = 6, // non-zero for requiring no context takeover both sides
+    MSSN_OPT_WS_DEFLATE_MIN = 7,         // min message bytes for MSSN_BUILD_DEFLATE, default 64
+    MSSN_OPT_WS_DEFLATE_PROBE = 8,       // non-zero for probing incompressible message, default 1
+    MSSN_OPT_BODY_ZERO_COPY = 9,         // non-zero for HTTP body data referencing buffer of mssn_process
+    MSSN_OPT_WS_INFLATE_MAX = 10,        // max inflated message bytes, 0 for unlimited, default 16 MB
+} mssn_option_t;
+
+typedef enum
+{
+    MSSN_BUILD_DEFLATE = 0x100, // with rsv bits, compress text/binary message with permessage-deflate
+} mssn_build_flag_t;
+
+typedef struct
+{
+    void *(*alloc)(void *ud, size_t size);          // allocate size bytes
+    void (*free)(void *ud, void *ptr, size_t size); // free ptr with size from alloc
+    void *ud;                                       // user data for callbacks
+} mssn_allocator_t;
+
+typedef struct
+{
+    size_t chunk_size;    // bytes per data chunk
+    size_t high_water;    // max chunks cached in global list
+    size_t cached;        // chunks cached in global list
+    size_t thread_cached; // chunks cached by threads
+    size_t allocated;     // chunks from libc, including cached
+    size_t hits;          // allocation served from cache
+    size_t misses;        // allocation served from libc
+    size_t released;      // chunks returned to libc over high-water
+} mssn_chunk_stats_t;
+
+typedef struct
+{
+    void *iov_base; // layout of struct iovec on POSIX
+    size_t iov_len;
+} mssn_iovec_t;
+
+typedef struct
+{
+    uint64_t compressed;     // messages deflated
+    uint64_t compressed_in;  // payload bytes before deflate
+    uint64_t compressed_out; // payload bytes after deflate
+    uint64_t skipped;        // messages sent uncompressed by size, probe, or no gain
+    uint64_t skipped_bytes;  // payload bytes sent uncompressed
+} mssn_deflate_stats_t;
+
+typedef struct
+{
+    size_t refs;             // live references
+    size_t shared_bytes;     // frame bytes held once, plain and deflated
+    uint64_t sends;          // frames handed out by mssn_bcast_frames
+    uint64_t sends_deflated; // sends with deflated frames
+    uint64_t dup_bytes;      // bytes that per-context building would have duplicated
+} mssn_bcast_stats_t;
+
+typedef struct s_mssn_pool mssn_pool_t;
+
+typedef struct s_mssn_zpool mssn_zpool_t;
+
+typedef struct s_mssn_bcast mssn_bcast_t;
+
 /// @brief create context
 /// @param server non-zero for server
 /// @return context
 mssn_t *mssn_create(int server);
 
+/// @brief create context with allocator, every allocation of context goes
+/// through allocator, bypass process-wide data chunk pool
+/// @param server non-zero for server
+/// @param allocator NULL for libc
+/// @return context
+mssn_t *mssn_create_ex(int server, const mssn_allocator_t *allocator);
+
 /// @brief close context
 void mssn_close(mssn_t *ctx);
 
-/// @brief output frames in mssn_t, with error in mssn_t's error_msg
+/// @brief reset context to initial HTTP state, keep options and allocated buffers, drop send queue
+void mssn_reset(mssn_t *ctx);
+
+/// @brief create session pool with pre-initialized contexts, not thread-safe
+/// @param server non-zero for server
+/// @param capacity contexts created and max idle contexts kept
+/// @param allocator NULL for libc
+mssn_pool_t *mssn_pool_create(int server, int capacity, const mssn_allocator_t *allocator);
+
+/// @brief close idle contexts and destroy pool
+void mssn_pool_destroy(mssn_pool_t *pool);
+
+/// @brief get idle context from pool, or create new one when empty
+mssn_t *mssn_pool_get(mssn_pool_t *pool);
+
+/// @brief reset context and return it to pool, close it when pool is full
+void mssn_pool_put(mssn_pool_t *pool, mssn_t *ctx);
+
+/// @brief create worker zlib stream pool with pre-initialized inflate/deflate streams, not thread-safe.
+/// Sessions attached borrow stream for one message when negotiated without context takeover,
+/// and reset it on return, compression memory scales with in-flight messages
+/// @param window_bits window bits of streams, 9 ~ 15, deflate stream used when negotiated window not smaller,
+/// inflate stream used when negotiated window not larger
+/// @param mem_level deflate memLevel, 1 ~ 9
+/// @param capacity streams of each kind created and max idle streams kept
+/// @param allocator NULL for libc
+mssn_zpool_t *mssn_zpool_create(int window_bits, int mem_level, int capacity, const mssn_allocator_t *allocator);
+
+/// @brief destroy pool after every attached context was closed or detached
+void mssn_zpool_destroy(mssn_zpool_t *zpool);
+
+/// @brief attach context to zlib pool from same thread, NULL for detach
+/// @return 0 for success
+int mssn_zpool_attach(mssn_t *ctx, mssn_zpool_t *zpool);
+
+/// @brief set context option before processing
+/// - MSSN_OPT_ZERO_COPY: key, value and path point into buffer of mssn_process without NUL
+///   terminated, read them with spans. Tokens split across mssn_process calls, or
+///   finished before the call completing headers, were copied into session with offset -1.
+///   Spans were valid until the buffer released
+/// - MSSN_OPT_BODY_ZERO_COPY: HTTP body data point into buffer of mssn_process without
+///   copying, at offset data - buf. Copy or consume them, then mssn_reclaim before the
+///   buffer released or the next mssn_process. WebSocket payload was copied anyway for unmasking
+/// - MSSN_OPT_WS_STREAM: payload of unfinished text/binary message was output as frame with
+///   fin 0 when mssn_process returns, frame offset is the payload offset in message
+/// - MSSN_OPT_WS_INFLATE: message with rsv1 was inflated into frame data
+/// - MSSN_OPT_WS_INFLATE_MAX: inflating beyond max bytes fails with "message too big", also
+///   counting parts already delivered with MSSN_OPT_WS_STREAM
+/// - MSSN_OPT_WS_WINDOW_BITS, MSSN_OPT_WS_MEM_LEVEL, MSSN_OPT_WS_NO_CONTEXT_TAKEOVER: policy of
+///   mssn_ws_negotiate, trading compression ratio for zlib memory. Without context takeover,
+///   zlib state was released after every message
+/// - MSSN_OPT_WS_DEFLATE_MIN, MSSN_OPT_WS_DEFLATE_PROBE: message smaller than min, or sampled
+///   bytes looking random, was built uncompressed with rsv1 clear. Without context takeover,
+///   message not shrinking after deflate was also built uncompressed
+/// @return 0 for success, -1 for invalid option
+int mssn_setopt(mssn_t *ctx, mssn_option_t opt, int value);
+
+/// @brief negotiate permessage-deflate with Sec-WebSocket-Extensions value, inflate message
+/// and set parameters for MSSN_BUILD_DEFLATE when accepted, until mssn_reset
+/// - server: value from request offers, return response value, NULL for no acceptable offer
+/// - client: value from server response, return accepted value, NULL with error_msg for invalid
+/// @return value valid until next negotiate or close
+const char *mssn_ws_negotiate(mssn_t *ctx, const char *value, int value_len);
+
+/// @brief deflate counters of mssn_build since create or reset
+void mssn_deflate_stats(mssn_t *ctx, mssn_deflate_stats_t *st);
+
+/// @brief output frames in mssn_t, with error in mssn_t's error_msg,
+/// every complete websocket frame in buffer were appended to frames,
+/// incomplete data were kept inside context, caller never rebuffer it
 /// @param buf raw data
 /// @param buf_len data length
-/// - return = 0, require more data
-/// - return > 0, parsed bytes
-/// - return < 0, encounter error
+/// - return >= 0, parsed bytes, whole buffer except stopping at HTTP upgrade not to websocket
+/// - return < 0, encounter error, state was MSSN_STATE_ERROR and later data refused until mssn_reset
 int mssn_process(mssn_t *, const uint8_t *buf, int buf_len);
 
 /// @brief build websocket binary frame data, data will be fragment but control frame
 /// @param ctx context
 /// @param ftype websocket frame type
 /// @param frame_size max frame size including websocket header
-/// @param rsv rsv 3 bits
+/// @param rsv_bits rsv 3 bits, with MSSN_BUILD_DEFLATE for deflating text/binary message,
+/// rsv1 set in first frame
 /// @param buf data to be send
 /// @param buf_len data length
 /// @return every mssn_data_t is a compact websocket frame
@@ -99,11 +350,132 @@ mssn_data_t *mssn_build(mssn_t *ctx,
                         const uint8_t *buf,
                         size_t buf_len);
 
+/// @brief build websocket frames contiguously into out without allocation, like snprintf
+/// @param out caller buffer, NULL for querying size
+/// @param out_cap out capacity
+/// @return bytes written, or bytes needed when larger than out_cap with nothing written,
+/// -1 for error. With MSSN_BUILD_DEFLATE, needed bytes were deflate bound, and returned
+/// bytes written may be much less
+int64_t mssn_build_into(mssn_t *ctx,
+                        mssn_frame_type ftype,
+                        int rsv_bits,
+                        size_t frame_size,
+                        const uint8_t *buf,
+                        size_t buf_len,
+                        uint8_t *out,
+                        size_t out_cap);
+
+/// @brief build websocket frames as iovec for writev/sendmsg in server, headers were written into
+/// context buffer, payload entries point into buf without copy, buf should be kept until sent
+/// @param iov output, headers interleaving payload, release with mssn_reclaim_iov
+/// @return iovec count, may exceed IOV_MAX with small frame_size, -1 for error or client context,
+/// or MSSN_BUILD_DEFLATE in rsv_bits
+int mssn_build_iov(mssn_t *ctx,
+                   mssn_frame_type ftype,
+                   int rsv_bits,
+                   size_t frame_size,
+                   const uint8_t *buf,
+                   size_t buf_len,
+                   mssn_iovec_t **iov);
+
+/// @brief release iovec from mssn_build_iov
+void mssn_reclaim_iov(mssn_t *ctx, mssn_iovec_t *iov);
+
+/// @brief begin text/binary message built incrementally, payload appended was emitted as
+/// first frame, continuation frames, then FIN frame from mssn_build_finish, outbound memory
+/// bounded by frame_size. Control frames may be built between, other messages not
+/// @param rsv_bits rsv 3 bits, with MSSN_BUILD_DEFLATE for deflating incrementally, without
+/// min size, probe or no gain fallback
+/// @return 0 for success
+int mssn_build_begin(mssn_t *ctx, mssn_frame_type ftype, int rsv_bits, size_t frame_size);
+
+/// @brief append payload, output complete frames, may be NULL, release with mssn_reclaim
+/// @return 0 for success, -1 for error with message dropped
+int mssn_build_append(mssn_t *ctx, const uint8_t *buf, size_t buf_len, mssn_data_t **data);
+
+/// @brief finish message, output rest frames ending with FIN frame, release with mssn_reclaim
+/// @return 0 for success
+int mssn_build_finish(mssn_t *ctx, mssn_data_t **data);
+
+/// @brief encode broadcast message once into immutable unmasked frames shared by server contexts,
+/// refcounted and thread-safe, released when last reference dropped
+/// @param rsv_bits rsv 3 bits, with MSSN_BUILD_DEFLATE for also keeping deflated frames, compressed with
+/// fresh stream for peers negotiated without server context takeover, skipped when no gain
+/// @param window_bits deflate window bits, 9 ~ 15, peers negotiated smaller window get plain frames
+/// @param allocator NULL for libc
+/// @return broadcast with one reference, NULL for invalid params
+mssn_bcast_t *mssn_bcast_create(mssn_frame_type ftype,
+                                int rsv_bits,
+                                size_t frame_size,
+                                const uint8_t *buf,
+                                size_t buf_len,
+                                int window_bits,
+                                const mssn_allocator_t *allocator);
+
+/// @brief add reference, hold one for every context until its frames were sent
+mssn_bcast_t *mssn_bcast_ref(mssn_bcast_t *b);
+
+/// @brief drop reference
+void mssn_bcast_unref(mssn_bcast_t *b);
+
+/// @brief frames for server context to send, deflated when its negotiation allows, never copied
+/// @param len output frames length
+/// @return frames valid while reference held, NULL for error or client context
+const uint8_t *mssn_bcast_frames(mssn_t *ctx, mssn_bcast_t *b, size_t *len);
+
+/// @brief bytes shared by broadcast versus duplicated by building per context
+void mssn_bcast_stats(mssn_bcast_t *b, mssn_bcast_stats_t *st);
+
+/// @brief queue bytes for send such as HTTP response, copied into shared pages
+/// @return 0 for success, -1 for allocation failure with part queued, connection should be closed
+int mssn_send_queue(mssn_t *ctx, const uint8_t *buf, size_t buf_len);
+
+/// @brief queue frames from mssn_build or stream builder, taking ownership, small frames were
+/// coalesced into shared pages, large ones linked without copy. Body data under
+/// MSSN_OPT_BODY_ZERO_COPY references buffer of mssn_process, always copied
+/// @return 0 for success, -1 for allocation failure with part queued and rest released,
+/// connection should be closed
+int mssn_send_data(mssn_t *ctx, mssn_data_t *data);
+
+/// @brief queue broadcast frames for server context, small ones copied, large ones referenced
+/// @return 0 for success
+int mssn_send_bcast(mssn_t *ctx, mssn_bcast_t *b);
+
+/// @brief iovec view of queued bytes in order, for one writev/sendmsg per flush,
+/// valid until next queue or consume
+/// @param iov caller array
+/// @param iov_max iov capacity, IOV_MAX at most for writev
+/// @return iovec count, 0 for empty queue
+int mssn_send_iov(mssn_t *ctx, mssn_iovec_t *iov, int iov_max);
+
+/// @brief release bytes written, partial write of iovec allowed
+void mssn_send_consume(mssn_t *ctx, size_t nbytes);
+
+/// @brief bytes queued not written, for backpressure
+size_t mssn_send_pending(mssn_t *ctx);
+
+/// @brief first header of known name in last process, repeated ones chained by dup
+/// @param id mssn_header_id
+/// @return header, NULL for absent
+mssn_header_t *mssn_header_get(mssn_t *ctx, int id);
+
+/// @brief first header of name in last process, case-insensitive in O(1), repeated ones chained by dup
+/// @param name header name, not required NUL terminated
+/// @param len name length
+/// @return header, NULL for absent
+mssn_header_t *mssn_header_find(mssn_t *ctx, const char *name, int len);
+
 /// @brief reclaim frames, headers, datas if needed
 /// @param ctx context
 /// @param data_build data from mssn_build
 void mssn_reclaim(mssn_t *ctx, mssn_data_t *data_build);
 
+/// @brief set high-water mark of process-wide data chunk pool, default 1024 chunks
+void mssn_chunk_pool_config(size_t high_water);
+
+/// @brief data chunk pool stats
+void mssn_chunk_pool_stats(mssn_chunk_stats_t *st);
+
 /// @brief sha1 digest
 void mssn_sha1(const uint8_t *data, int data_len, uint8_t *digest);
 
@@ -19,6 +19,7 @@
  * IN THE SOFTWARE.
  */
 #include "http_parser.h"
+#include "m_simd.h"
 #include <assert.h>
 #include <stddef.h>
 #include <ctype.h>
@@ -1090,6 +1091,16 @@ reexecute:
               SET_ERRNO(HPE_INVALID_URL);
               goto error;
             }
+            /* consume run of ordinary url chars keeping state, next
+             * structural char goes through parse_url_char */
+            if (CURRENT_STATE() == s_req_path ||
+                CURRENT_STATE() == s_req_query_string) {
+              size_t run = simd_url_run((const uint8_t *)p + 1,
+                                        data + len - p - 1,
+                                        HTTP_PARSER_STRICT);
+              COUNT_HEADER_SIZE(run);
+              p += run;
+            }
         }
         break;
       }
@@ -1514,6 +1525,10 @@ reexecute:
                 const char* pe = p + MIN(left, max_header_size);
 
                 for (; p != pe; p++) {
+                  /* skip plain value bytes 16 or 32 at a time */
+                  p += simd_header_value((const uint8_t *)p, pe - p);
+                  if (p == pe)
+                    break;
                   ch = *p;
                   if (ch == CR || ch == LF) {
                     --p;
@@ -0,0 +1,355 @@
+/*
+ * Copyright (c) 2024 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+/* SIMD kernels with runtime CPU dispatch, 64 bit scalar as fallback
+ */
+
+#include "m_simd.h"
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define _SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+// kernels resolved by any thread, relaxed since every store writes same pointers
+#define _SIMD_LOAD(V) __atomic_load_n(&(V), __ATOMIC_RELAXED)
+#define _SIMD_STORE(V, N) __atomic_store_n(&(V), (N), __ATOMIC_RELAXED)
+#else
+#define _SIMD_LOAD(V) (V)
+#define _SIMD_STORE(V, N) ((V) = (N))
+#endif
+
+typedef void (*_mask_fn)(uint8_t *, const uint8_t *, size_t, uint32_t);
+typedef size_t (*_scan_fn)(const uint8_t *, size_t);
+typedef size_t (*_url_fn)(const uint8_t *, size_t, int);
+
+static void _mask_resolve(uint8_t *, const uint8_t *, size_t, uint32_t);
+static size_t _hvalue_resolve(const uint8_t *, size_t);
+static size_t _url_resolve(const uint8_t *, size_t, int);
+
+static _mask_fn _mask_impl = _mask_resolve;
+static _scan_fn _hvalue_impl = _hvalue_resolve;
+static _url_fn _url_impl = _url_resolve;
+static const char *_simd_name = NULL;
+
+// MARK: - Scalar
+
+// key in memory order, already rotated for payload offset
+static void
+_mask_scalar(uint8_t *dst, const uint8_t *src, size_t len, uint32_t key)
+{
+    uint64_t k64 = ((uint64_t)key << 32) | key;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t v;
+        memcpy(&v, src + i, 8);
+        v ^= k64;
+        memcpy(dst + i, &v, 8);
+    }
+    const uint8_t *k = (const uint8_t *)&key;
+    for (; i < len; i++)
+    {
+        dst[i] = src[i] ^ k[i & 3];
+    }
+}
+
+/// CR, LF, control chars except HTAB, and DEL stop header value
+static inline int
+_hvalue_stop(uint8_t c)
+{
+    return ((c < 0x20) && (c != 0x09)) || (c == 0x7F);
+}
+
+static size_t
+_hvalue_scalar(const uint8_t *buf, size_t len)
+{
+    const uint64_t ones = 0x0101010101010101ull;
+    const uint64_t highs = 0x8080808080808080ull;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t v;
+        memcpy(&v, buf + i, 8);
+        // any byte < 0x20, or equal to 0x7F, checked byte by byte
+        uint64_t lt = (v - ones * 0x20) & ~v & highs;
+        uint64_t x = v ^ (ones * 0x7F);
+        uint64_t eq = (x - ones) & ~x & highs;
+        if (lt | eq)
+        {
+            break;
+        }
+    }
+    for (; i < len; i++)
+    {
+        if (_hvalue_stop(buf[i]))
+        {
+            return i;
+        }
+    }
+    return len;
+}
+
+/// space, controls, '#', '?', DEL stop url run, HTAB, FF allowed and bytes over DEL stop in strict
+static inline int
+_url_stop(uint8_t c, int strict)
+{
+    if (c <= 0x20)
+    {
+        return strict || ((c != 0x09) && (c != 0x0C));
+    }
+    return (c == '#') || (c == '?') || (c == 0x7F) || (strict && (c > 0x7F));
+}
+
+static size_t
+_url_scalar(const uint8_t *buf, size_t len, int strict)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        if (_url_stop(buf[i], strict))
+        {
+            return i;
+        }
+    }
+    return len;
+}
+
+// MARK: - x86
+
+#ifdef _SIMD_X86
+
+__attribute__((target("sse2"))) static void
+_mask_sse2(uint8_t *dst, const uint8_t *src, size_t len, uint32_t key)
+{
+    const __m128i k128 = _mm_set1_epi32((int)key);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(v, k128));
+    }
+    _mask_scalar(dst + i, src + i, len - i, key);
+}
+
+__attribute__((target("avx2"))) static void
+_mask_avx2(uint8_t *dst, const uint8_t *src, size_t len, uint32_t key)
+{
+    const __m256i k256 = _mm256_set1_epi32((int)key);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(v, k256));
+    }
+    _mask_sse2(dst + i, src + i, len - i, key);
+}
+
+__attribute__((target("sse2"))) static size_t
+_hvalue_sse2(const uint8_t *buf, size_t len)
+{
+    const __m128i c1f = _mm_set1_epi8(0x1F);
+    const __m128i tab = _mm_set1_epi8(0x09);
+    const __m128i del = _mm_set1_epi8(0x7F);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+        // unsigned v <= 0x1F, bytes over 0x7F were valid
+        __m128i ctl = _mm_cmpeq_epi8(_mm_min_epu8(v, c1f), v);
+        ctl = _mm_andnot_si128(_mm_cmpeq_epi8(v, tab), ctl);
+        int m = _mm_movemask_epi8(_mm_or_si128(ctl, _mm_cmpeq_epi8(v, del)));
+        if (m != 0)
+        {
+            return i + __builtin_ctz(m);
+        }
+    }
+    return i + _hvalue_scalar(buf + i, len - i);
+}
+
+__attribute__((target("avx2"))) static size_t
+_hvalue_avx2(const uint8_t *buf, size_t len)
+{
+    const __m256i c1f = _mm256_set1_epi8(0x1F);
+    const __m256i tab = _mm256_set1_epi8(0x09);
+    const __m256i del = _mm256_set1_epi8(0x7F);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+        __m256i ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(v, c1f), v);
+        ctl = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, tab), ctl);
+        unsigned m = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(ctl, _mm256_cmpeq_epi8(v, del)));
+        if (m != 0)
+        {
+            return i + __builtin_ctz(m);
+        }
+    }
+    return i + _hvalue_sse2(buf + i, len - i);
+}
+
+__attribute__((target("sse2"))) static size_t
+_url_sse2(const uint8_t *buf, size_t len, int strict)
+{
+    const __m128i c20 = _mm_set1_epi8(0x20);
+    const __m128i c7f = _mm_set1_epi8(0x7F);
+    const __m128i hash = _mm_set1_epi8('#');
+    const __m128i qmark = _mm_set1_epi8('?');
+    // lenient allows HTAB, FF, instead of bytes over DEL in strict
+    const __m128i allow1 = _mm_set1_epi8(strict ? 0xFF : 0x09);
+    const __m128i allow2 = _mm_set1_epi8(strict ? 0xFF : 0x0C);
+    const __m128i over = _mm_set1_epi8(strict ? 0xFF : 0x00);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+        // unsigned v <= 0x20, v > 0x7F for strict
+        __m128i low = _mm_cmpeq_epi8(_mm_min_epu8(v, c20), v);
+        low = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi8(v, allow1), _mm_cmpeq_epi8(v, allow2)), low);
+        __m128i high = _mm_or_si128(_mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(v, c7f), v), over), _mm_cmpeq_epi8(v, c7f));
+        __m128i sep = _mm_or_si128(_mm_cmpeq_epi8(v, hash), _mm_cmpeq_epi8(v, qmark));
+        int m = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(low, high), sep));
+        if (m != 0)
+        {
+            return i + __builtin_ctz(m);
+        }
+    }
+    return i + _url_scalar(buf + i, len - i, strict);
+}
+
+__attribute__((target("avx2"))) static size_t
+_url_avx2(const uint8_t *buf, size_t len, int strict)
+{
+    const __m256i c20 = _mm256_set1_epi8(0x20);
+    const __m256i c7f = _mm256_set1_epi8(0x7F);
+    const __m256i hash = _mm256_set1_epi8('#');
+    const __m256i qmark = _mm256_set1_epi8('?');
+    const __m256i allow1 = _mm256_set1_epi8(strict ? 0xFF : 0x09);
+    const __m256i allow2 = _mm256_set1_epi8(strict ? 0xFF : 0x0C);
+    const __m256i over = _mm256_set1_epi8(strict ? 0xFF : 0x00);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+        __m256i low = _mm256_cmpeq_epi8(_mm256_min_epu8(v, c20), v);
+        low = _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, allow1), _mm256_cmpeq_epi8(v, allow2)), low);
+        __m256i high = _mm256_or_si256(_mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(v, c7f), v), over),
+                                       _mm256_cmpeq_epi8(v, c7f));
+        __m256i sep = _mm256_or_si256(_mm256_cmpeq_epi8(v, hash), _mm256_cmpeq_epi8(v, qmark));
+        unsigned m = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(low, high), sep));
+        if (m != 0)
+        {
+            return i + __builtin_ctz(m);
+        }
+    }
+    return i + _url_sse2(buf + i, len - i, strict);
+}
+
+#endif // _SIMD_X86
+
+// MARK: - Dispatch
+
+static void
+_simd_set(const char *name, _mask_fn mask, _scan_fn hvalue, _url_fn url)
+{
+    _SIMD_STORE(_mask_impl, mask);
+    _SIMD_STORE(_hvalue_impl, hvalue);
+    _SIMD_STORE(_url_impl, url);
+    _SIMD_STORE(_simd_name, name);
+}
+
+/// kernels by name, NULL for best one supported by CPU
+static int
+_simd_init(const char *name)
+{
+#ifdef _SIMD_X86
+    __builtin_cpu_init();
+    if (((name == NULL) || (strcmp(name, "avx2") == 0)) && __builtin_cpu_supports("avx2"))
+    {
+        _simd_set("avx2", _mask_avx2, _hvalue_avx2, _url_avx2);
+        return 0;
+    }
+    if (((name == NULL) || (strcmp(name, "sse2") == 0)) && __builtin_cpu_supports("sse2"))
+    {
+        _simd_set("sse2", _mask_sse2, _hvalue_sse2, _url_sse2);
+        return 0;
+    }
+#endif
+    if ((name == NULL) || (strcmp(name, "scalar") == 0))
+    {
+        _simd_set("scalar", _mask_scalar, _hvalue_scalar, _url_scalar);
+        return 0;
+    }
+    return -1;
+}
+
+static void
+_mask_resolve(uint8_t *dst, const uint8_t *src, size_t len, uint32_t key)
+{
+    _simd_init(NULL);
+    _SIMD_LOAD(_mask_impl)(dst, src, len, key);
+}
+
+static size_t
+_hvalue_resolve(const uint8_t *buf, size_t len)
+{
+    _simd_init(NULL);
+    return _SIMD_LOAD(_hvalue_impl)(buf, len);
+}
+
+static size_t
+_url_resolve(const uint8_t *buf, size_t len, int strict)
+{
+    _simd_init(NULL);
+    return _SIMD_LOAD(_url_impl)(buf, len, strict);
+}
+
+void
+simd_mask(uint8_t *dst, const uint8_t *src, size_t len, const uint8_t key[4], uint64_t offset)
+{
+    if (len == 0)
+    {
+        return;
+    }
+    uint8_t rk[4];
+    for (int i = 0; i < 4; i++)
+    {
+        rk[i] = key[(offset + i) & 3];
+    }
+    uint32_t k32;
+    memcpy(&k32, rk, 4);
+    _SIMD_LOAD(_mask_impl)(dst, src, len, k32);
+}
+
+size_t
+simd_header_value(const uint8_t *buf, size_t len)
+{
+    return _SIMD_LOAD(_hvalue_impl)(buf, len);
+}
+
+size_t
+simd_url_run(const uint8_t *buf, size_t len, int strict)
+{
+    return _SIMD_LOAD(_url_impl)(buf, len, strict);
+}
+
+int
+simd_select(const char *name)
+{
+    return _simd_init(name);
+}
+
+const char *
+simd_name(void)
+{
+    if (_SIMD_LOAD(_simd_name) == NULL)
+    {
+        _simd_init(NULL);
+    }
+    return _SIMD_LOAD(_simd_name);
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2024 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef _M_SIMD_H
+#define _M_SIMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief xor data with 4 bytes websocket masking key, dst may equal src
+/// @param dst output
+/// @param src input
+/// @param len data length
+/// @param key masking key
+/// @param offset payload offset of src[0], for rotating masking key
+void simd_mask(uint8_t *dst, const uint8_t *src, size_t len, const uint8_t key[4], uint64_t offset);
+
+/// @brief find first byte ending plain header value, CR, LF, control char except HTAB, or DEL
+/// @return offset of the byte, len for none
+size_t simd_header_value(const uint8_t *buf, size_t len);
+
+/// @brief find first byte ending run of ordinary url chars in path or query, space, controls,
+/// '#', '?' or DEL, HTAB and FF were ordinary unless strict, bytes over DEL were ordinary unless strict
+/// @return offset of the byte, len for none
+size_t simd_url_run(const uint8_t *buf, size_t len, int strict);
+
+/// @brief kernel name selected by runtime dispatch, 'avx2', 'sse2' or 'scalar'
+const char *simd_name(void);
+
+/// @brief force kernels by name for tests and benchmarks, NULL for best one supported by CPU
+/// @return 0 for success, -1 for unknown name or not supported by CPU
+int simd_select(const char *name);
+
+#endif
@@ -0,0 +1,146 @@
+/*
+ * allocator hooks, every allocation failure surfaces as error instead of crash
+ */
+
+#include "test_util.h"
+
+static void
+test_balanced(void)
+{
+    static uint8_t payload[10000];
+    tu_alloc_t ta = {0};
+    mssn_allocator_t za = tu_allocator(&ta);
+    mssn_t *cli = mssn_create_ex(0, &za);
+    mssn_t *srv = mssn_create_ex(1, &za);
+    tu_feed(srv, tu_upgrade_req, strlen(tu_upgrade_req));
+    for (int i = 0; i < 20; i++)
+    {
+        mssn_data_t *dt = mssn_build(cli, WS_FRAME_BINARY, 0, sizeof(payload) + 16, payload, sizeof(payload));
+        CHECK(dt != NULL);
+        for (mssn_data_t *d = dt; d != NULL; d = d->next)
+        {
+            tu_feed(srv, d->data, d->length);
+        }
+        mssn_reclaim(cli, dt);
+        mssn_reclaim(srv, NULL);
+    }
+    const char *resp = "HTTP/1.1 200 OK\r\nContent-Length: 3\r\n\r\nabc";
+    tu_feed(cli, resp, strlen(resp));
+    mssn_reclaim(cli, NULL);
+    mssn_close(cli);
+    mssn_close(srv);
+    CHECK(ta.live == 0);
+    CHECK(ta.peak > 0);
+}
+
+static void
+test_many_headers_capped(void)
+{
+    static char req[16384];
+    int n = sprintf(req, "GET / HTTP/1.1\r\n");
+    for (int i = 0; i < 150; i++)
+    {
+        n += sprintf(req + n, "X-Header-Number-%d: value-of-header-%d\r\n", i, i);
+    }
+    n += sprintf(req + n, "\r\n");
+
+    tu_alloc_t ta = {0, 0, 12 * 1024, 0};
+    mssn_allocator_t za = tu_allocator(&ta);
+    mssn_t *ctx = mssn_create_ex(1, &za);
+    CHECK(ctx != NULL);
+    CHECK(mssn_process(ctx, (const uint8_t *)req, n) == -1);
+    CHECK(ctx->error_msg != NULL);
+    CHECK(ta.fails > 0);
+    mssn_close(ctx);
+    CHECK(ta.live == 0);
+
+    // same request split byte by byte with zero copy, detach copies into arena
+    ta.fails = 0;
+    ctx = mssn_create_ex(1, &za);
+    mssn_setopt(ctx, MSSN_OPT_ZERO_COPY, 1);
+    int ret = 0;
+    for (int i = 0; (i < n) && (ret >= 0); i++)
+    {
+        ret = mssn_process(ctx, (const uint8_t *)req + i, 1);
+    }
+    CHECK(ret == -1);
+    CHECK(ctx->error_msg != NULL);
+    mssn_close(ctx);
+    CHECK(ta.live == 0);
+}
+
+/// run websocket traffic and HTTP body under cap, return 0 when all succeeded
+static int
+run_capped(size_t cap)
+{
+    static uint8_t payload[20000];
+    tu_fill(payload, sizeof(payload), 7, 8);
+    tu_alloc_t ta = {0, 0, cap, 0};
+    mssn_allocator_t za = tu_allocator(&ta);
+    int failed = 0;
+
+    mssn_t *cli = mssn_create_ex(0, &za);
+    mssn_t *srv = mssn_create_ex(1, &za);
+    if ((cli == NULL) || (srv == NULL))
+    {
+        failed = 1;
+        goto done;
+    }
+    if (mssn_process(srv, (const uint8_t *)tu_upgrade_req, (int)strlen(tu_upgrade_req)) < 0)
+    {
+        CHECK(srv->error_msg != NULL);
+        failed = 1;
+        goto done;
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        mssn_data_t *dt = mssn_build(cli, WS_FRAME_BINARY, 0, 4096, payload, sizeof(payload));
+        if (dt == NULL)
+        {
+            CHECK(cli->error_msg != NULL);
+            failed = 1;
+            goto done;
+        }
+        for (mssn_data_t *d = dt; (d != NULL) && !failed; d = d->next)
+        {
+            if (mssn_process(srv, d->data, d->length) < 0)
+            {
+                CHECK(srv->error_msg != NULL);
+                failed = 1;
+            }
+        }
+        mssn_reclaim(cli, dt);
+        mssn_reclaim(srv, NULL);
+        if (failed)
+        {
+            goto done;
+        }
+    }
+
+done:
+    mssn_close(cli);
+    mssn_close(srv);
+    CHECK(ta.live == 0);
+    return failed;
+}
+
+static void
+test_cap_sweep(void)
+{
+    int failures = 0;
+    for (size_t cap = 256; cap <= 64 * 1024; cap += 256)
+    {
+        failures += run_capped(cap);
+    }
+    CHECK(failures > 0);
+    CHECK(run_capped(0) == 0);
+}
+
+int main(void)
+{
+    test_balanced();
+    test_many_headers_capped();
+    test_cap_sweep();
+    TEST_OK();
+    return 0;
+}
@@ -0,0 +1,78 @@
+/*
+ * headers and path served from session arena, reused across messages
+ */
+
+#include "test_util.h"
+
+static void
+test_grow_and_reuse(void)
+{
+    static char req[200000];
+    mssn_t *ctx = mssn_create(1);
+    for (int round = 0; round < 50; round++)
+    {
+        // headers outgrow one arena block in later rounds
+        int n = sprintf(req, "GET /path/%d?q=1 HTTP/1.1\r\nHost: x\r\n", round);
+        int nhdr = 30 + round * 3;
+        for (int i = 0; i < nhdr; i++)
+        {
+            n += sprintf(req + n, "X-Header-%d: value-%d-%0*d\r\n", i, i, round * 4, 7);
+        }
+        n += sprintf(req + n, "Content-Length: 5\r\n\r\nhello");
+        tu_feed(ctx, req, n);
+
+        char want[64];
+        sprintf(want, "/path/%d?q=1", round);
+        CHECK(strcmp(ctx->path, want) == 0);
+        CHECK(ctx->path_span.offset == -1);
+
+        int cnt = 0;
+        for (mssn_header_t *h = ctx->headers; h != NULL; h = h->next, cnt++)
+        {
+            CHECK(h->key[h->key_span.length] == '\0');
+            CHECK(h->value[h->value_span.length] == '\0');
+            if ((cnt >= 1) && (cnt <= nhdr))
+            {
+                char key[64];
+                sprintf(key, "X-Header-%d", cnt - 1);
+                CHECK(strcmp(h->key, key) == 0);
+            }
+        }
+        CHECK(cnt == nhdr + 2);
+        CHECK(ctx->state == MSSN_STATE_FINISH);
+        CHECK((ctx->frames != NULL) && (memcmp(ctx->frames->data_head->data, "hello", 5) == 0));
+        mssn_reclaim(ctx, NULL);
+        CHECK((ctx->headers == NULL) && (ctx->path == NULL));
+    }
+    mssn_close(ctx);
+}
+
+static void
+test_split_tokens(void)
+{
+    const char *req = "GET /a/long/path HTTP/1.1\r\nHost: example.com\r\nX-Split-Name: split value\r\n\r\n";
+    int n = (int)strlen(req);
+    for (int split = 1; split < n; split++)
+    {
+        mssn_t *ctx = mssn_create(1);
+        char *b1 = strndup(req, split);
+        tu_feed(ctx, b1, split);
+        memset(b1, 'Z', split); // tokens were copied
+        tu_feed(ctx, req + split, n - split);
+        CHECK(strcmp(ctx->path, "/a/long/path") == 0);
+        mssn_header_t *h = ctx->headers->next;
+        CHECK((strcmp(ctx->headers->value, "example.com") == 0) && (h != NULL));
+        CHECK((strcmp(h->key, "X-Split-Name") == 0) && (strcmp(h->value, "split value") == 0));
+        CHECK(h->key_span.length == 12 && h->value_span.length == 11);
+        mssn_close(ctx);
+        free(b1);
+    }
+}
+
+int main(void)
+{
+    test_grow_and_reuse();
+    test_split_tokens();
+    TEST_OK();
+    return 0;
+}
@@ -0,0 +1,185 @@
+/*
+ * broadcast frames shared by server contexts, deflated per negotiation, refcounted across threads
+ */
+
+#include <pthread.h>
+#include "test_util.h"
+
+/// server/client pair, negotiated offer when not NULL
+static void
+make_pair(mssn_t **srv, mssn_t **cli, const char *offer)
+{
+    *srv = tu_ws_server();
+    *cli = tu_ws_client();
+    if (offer != NULL)
+    {
+        const char *resp = mssn_ws_negotiate(*srv, offer, (int)strlen(offer));
+        CHECK(resp != NULL);
+        CHECK(mssn_ws_negotiate(*cli, resp, (int)strlen(resp)) != NULL);
+    }
+}
+
+/// frames for srv decoded by cli, check rsv1 and payload
+static void
+check_frames(mssn_t *srv, mssn_t *cli, mssn_bcast_t *b, const uint8_t *p, size_t sz, int want_rsv1)
+{
+    size_t len = 0;
+    const uint8_t *wire = mssn_bcast_frames(srv, b, &len);
+    CHECK(wire != NULL);
+    CHECK(((wire[0] >> 6) & 1) == want_rsv1);
+    tu_feed(cli, wire, len);
+    uint8_t *got = malloc(sz + 1);
+    size_t total = 0;
+    for (mssn_frame_t *fr = cli->frames; fr != NULL; fr = fr->next)
+    {
+        CHECK(total + tu_payload(fr, got + total) <= sz);
+        total += tu_payload(fr, got + total);
+    }
+    CHECK((total == sz) && (memcmp(got, p, sz) == 0));
+    mssn_reclaim(cli, NULL);
+    free(got);
+}
+
+static void
+test_negotiations(void)
+{
+    const size_t sz = 30000;
+    uint8_t *p = malloc(sz);
+    for (size_t k = 0; k < sz; k++)
+    {
+        p[k] = "broadcast "[k % 10] ^ (k % 89 == 0);
+    }
+    mssn_bcast_t *b = mssn_bcast_create(WS_FRAME_TEXT, MSSN_BUILD_DEFLATE, 8192, p, sz, 12, NULL);
+    CHECK(b != NULL);
+    // deflated frames only for fresh server stream with enough window
+    const char *offers[4] = {"permessage-deflate; server_no_context_takeover; client_max_window_bits",
+                             "permessage-deflate",
+                             "permessage-deflate; server_no_context_takeover; server_max_window_bits=10",
+                             NULL};
+    const int want[4] = {1, 0, 0, 0};
+    for (int round = 0; round < 3; round++)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            mssn_t *srv;
+            mssn_t *cli;
+            make_pair(&srv, &cli, offers[i]);
+            mssn_bcast_t *r = mssn_bcast_ref(b);
+            CHECK(r == b);
+            check_frames(srv, cli, r, p, sz, want[i]);
+            mssn_bcast_unref(r);
+            mssn_close(srv);
+            mssn_close(cli);
+        }
+    }
+    mssn_bcast_stats_t st;
+    mssn_bcast_stats(b, &st);
+    CHECK((st.refs == 1) && (st.sends == 12) && (st.sends_deflated == 3));
+    CHECK(st.dup_bytes > st.shared_bytes);
+
+    mssn_t *cli = tu_ws_client();
+    size_t len;
+    CHECK(mssn_bcast_frames(cli, b, &len) == NULL);
+    mssn_close(cli);
+    mssn_bcast_unref(b);
+
+    // incompressible keeps no deflated copy
+    tu_fill(p, sz, 5, 256);
+    b = mssn_bcast_create(WS_FRAME_BINARY, MSSN_BUILD_DEFLATE, 1000, p, sz, 15, NULL);
+    mssn_bcast_stats(b, &st);
+    CHECK(st.shared_bytes < sz + 400);
+    mssn_t *srv;
+    make_pair(&srv, &cli, offers[0]);
+    check_frames(srv, cli, b, p, sz, 0);
+    mssn_close(srv);
+    mssn_close(cli);
+    mssn_bcast_unref(b);
+
+    // control frame never deflated, invalid params
+    b = mssn_bcast_create(WS_FRAME_PING, MSSN_BUILD_DEFLATE, 100, (const uint8_t *)"hi", 2, 15, NULL);
+    make_pair(&srv, &cli, offers[0]);
+    const uint8_t *wire = mssn_bcast_frames(srv, b, &len);
+    CHECK((len == 4) && (wire[0] == 0x89));
+    mssn_close(srv);
+    mssn_close(cli);
+    mssn_bcast_unref(b);
+    CHECK(mssn_bcast_create(WS_FRAME_PING, 0, 100, p, 200, 15, NULL) == NULL);
+    CHECK(mssn_bcast_create(WS_FRAME_TEXT, MSSN_BUILD_DEFLATE, 100, p, 200, 8, NULL) == NULL);
+    free(p);
+}
+
+typedef struct
+{
+    mssn_bcast_t *b;
+    int loops;
+} ref_arg_t;
+
+static void *
+ref_worker(void *arg)
+{
+    ref_arg_t *ra = (ref_arg_t *)arg;
+    mssn_t *srv = tu_ws_server();
+    for (int i = 0; i < ra->loops; i++)
+    {
+        mssn_bcast_t *r = mssn_bcast_ref(ra->b);
+        size_t len = 0;
+        CHECK(mssn_bcast_frames(srv, r, &len) != NULL);
+        mssn_bcast_unref(r);
+    }
+    mssn_close(srv);
+    // thread's own reference from creator
+    mssn_bcast_unref(ra->b);
+    return NULL;
+}
+
+static void
+test_refcount(void)
+{
+    tu_alloc_t ta = {0};
+    mssn_allocator_t za = tu_allocator(&ta);
+    uint8_t p[5000];
+    tu_fill(p, sizeof(p), 6, 4);
+    mssn_bcast_t *b = mssn_bcast_create(WS_FRAME_BINARY, MSSN_BUILD_DEFLATE, 1000, p, sizeof(p), 15, &za);
+    CHECK((b != NULL) && (ta.live > 0));
+
+    enum { NTHREAD = 8 };
+    pthread_t th[NTHREAD];
+    ref_arg_t ra = {b, 2000};
+    for (int i = 0; i < NTHREAD; i++)
+    {
+        mssn_bcast_ref(b);
+        CHECK(pthread_create(&th[i], NULL, ref_worker, &ra) == 0);
+    }
+    for (int i = 0; i < NTHREAD; i++)
+    {
+        pthread_join(th[i], NULL);
+    }
+    mssn_bcast_stats_t st;
+    mssn_bcast_stats(b, &st);
+    CHECK((st.refs == 1) && (st.sends == NTHREAD * 2000));
+
+    // queued large frames keep reference until consumed
+    mssn_t *srv = tu_ws_server();
+    CHECK(mssn_send_bcast(srv, b) == 0);
+    mssn_bcast_unref(b);
+    CHECK(ta.live > 0);
+    mssn_iovec_t iov[16];
+    size_t total = 0;
+    const int n = mssn_send_iov(srv, iov, 16);
+    for (int i = 0; i < n; i++)
+    {
+        total += iov[i].iov_len;
+    }
+    CHECK(total > sizeof(p));
+    mssn_send_consume(srv, total);
+    CHECK(ta.live == 0);
+    mssn_close(srv);
+}
+
+int main(void)
+{
+    test_negotiations();
+    test_refcount();
+    TEST_OK();
+    return 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * MSSN_OPT_BODY_ZERO_COPY body data referencing input buffer, copied when queued for send
+ */
+
+#include "test_util.h"
+
+/// append body data of frames, check every node inside buf exactly when zero copy
+static void
+collect(mssn_t *ctx, const uint8_t *buf, int len, int zc, uint8_t *out, int *olen)
+{
+    for (mssn_frame_t *fr = ctx->frames; fr != NULL; fr = fr->next)
+    {
+        for (mssn_data_t *dt = fr->data_head; dt != NULL; dt = dt->next)
+        {
+            const int inside = (dt->data >= buf) && (dt->data + dt->length <= buf + len);
+            CHECK(inside == zc);
+            memcpy(out + *olen, dt->data, dt->length);
+            *olen += dt->length;
+        }
+    }
+}
+
+static void
+test_content_length(void)
+{
+    static uint8_t body[100000];
+    static uint8_t req[120000];
+    static uint8_t got[120000];
+    for (size_t i = 0; i < sizeof(body); i++)
+    {
+        body[i] = (uint8_t)('a' + i % 23);
+    }
+    int rlen = sprintf((char *)req, "POST /up HTTP/1.1\r\nContent-Length: %d\r\n\r\n", (int)sizeof(body));
+    memcpy(req + rlen, body, sizeof(body));
+    rlen += (int)sizeof(body);
+    for (int zc = 0; zc < 2; zc++)
+    {
+        for (int step = 777; step < rlen; step += 20011)
+        {
+            mssn_t *srv = mssn_create(1);
+            CHECK(mssn_setopt(srv, MSSN_OPT_BODY_ZERO_COPY, zc) == 0);
+            int glen = 0;
+            for (int off = 0; off < rlen;)
+            {
+                // fresh buffer every call, released right after reclaim
+                const int n = (rlen - off < step) ? (rlen - off) : step;
+                uint8_t *tmp = malloc(n);
+                memcpy(tmp, req + off, n);
+                CHECK(mssn_process(srv, tmp, n) == n);
+                CHECK((srv->frames == NULL) || (srv->state >= MSSN_STATE_BODY));
+                collect(srv, tmp, n, zc, got, &glen);
+                const int fin = (srv->state == MSSN_STATE_FINISH);
+                mssn_reclaim(srv, NULL);
+                free(tmp);
+                off += n;
+                CHECK(!fin || (off == rlen));
+            }
+            CHECK((glen == (int)sizeof(body)) && (memcmp(got, body, glen) == 0));
+            mssn_close(srv);
+        }
+    }
+}
+
+static void
+test_chunked(void)
+{
+    const char *req = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n6\r\n world\r\n0\r\n\r\n";
+    const int rlen = (int)strlen(req);
+    mssn_t *srv = mssn_create(1);
+    mssn_setopt(srv, MSSN_OPT_BODY_ZERO_COPY, 1);
+    CHECK(mssn_process(srv, (const uint8_t *)req, rlen) == rlen);
+    uint8_t got[16];
+    int glen = 0;
+    collect(srv, (const uint8_t *)req, rlen, 1, got, &glen);
+    CHECK((glen == 11) && (memcmp(got, "hello world", 11) == 0));
+    CHECK(srv->state == MSSN_STATE_FINISH);
+    // path span length valid without zero copy, read by binding
+    CHECK((srv->path_span.length == 1) && (srv->path[0] == '/'));
+    // nodes left until close
+    mssn_close(srv);
+}
+
+static void
+test_echo_body(void)
+{
+    // body nodes handed to send queue, then input buffer released
+    tu_alloc_t ta = {0};
+    mssn_allocator_t za = tu_allocator(&ta);
+    mssn_t *srv = mssn_create_ex(1, &za);
+    mssn_setopt(srv, MSSN_OPT_BODY_ZERO_COPY, 1);
+    const char *head = "POST /echo HTTP/1.1\r\nContent-Length: 6000\r\n\r\n";
+    const int hlen = (int)strlen(head);
+    uint8_t *buf = malloc(hlen + 6000);
+    memcpy(buf, head, hlen);
+    tu_fill(buf + hlen, 6000, 11, 26);
+    uint8_t want[6010];
+    memcpy(want, buf + hlen, 6000);
+    memcpy(want + 6000, "tail", 4);
+
+    CHECK(mssn_process(srv, buf, hlen + 6000) == hlen + 6000);
+    CHECK((srv->frames != NULL) && (srv->frames->data_head != NULL));
+    mssn_data_t *dt = srv->frames->data_head;
+    srv->frames->data_head = NULL;
+    srv->frames->data_last = NULL;
+    CHECK(mssn_send_data(srv, dt) == 0);
+    mssn_reclaim(srv, NULL);
+    memset(buf, 0, hlen + 6000);
+    free(buf);
+    // spare bytes only from pages, never from referenced buffer
+    CHECK(mssn_send_queue(srv, (const uint8_t *)"tail", 4) == 0);
+    CHECK(mssn_send_pending(srv) == 6004);
+
+    mssn_iovec_t iov[8];
+    const int n = mssn_send_iov(srv, iov, 8);
+    size_t total = 0;
+    for (int i = 0; i < n; i++)
+    {
+        CHECK(memcmp(want + total, iov[i].iov_base, iov[i].iov_len) == 0);
+        total += iov[i].iov_len;
+    }
+    CHECK(total == 6004);
+    mssn_send_consume(srv, total);
+    mssn_close(srv);
+    CHECK(ta.live == 0);
+}
+
+int main(void)
+{
+    test_content_length();
+    test_chunked();
+    test_echo_body();
+    TEST_OK();
+    return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * mssn_build_into writes mssn_build bytes contiguously, sizes queried like snprintf
+ */
+
+#include "test_util.h"
+
+/// feed wire to rx in pieces, compare single message payload
+static void
+recv_check(mssn_t *rx, const uint8_t *wire, int64_t n, const uint8_t *p, size_t sz)
+{
+    uint8_t *got = malloc(sz + 1);
+    for (int64_t off = 0; off < n;)
+    {
+        const int len = (n - off > 7000) ? 7000 : (int)(n - off);
+        CHECK(mssn_process(rx, wire + off, len) == len);
+        off += len;
+    }
+    size_t total = 0;
+    for (mssn_frame_t *fr = rx->frames; fr != NULL; fr = fr->next)
+    {
+        CHECK(total + tu_payload(fr, got + total) <= sz);
+        total += tu_payload(fr, got + total);
+    }
+    CHECK((total == sz) && (memcmp(got, p, sz) == 0));
+    mssn_reclaim(rx, NULL);
+    free(got);
+}
+
+int main(void)
+{
+    mssn_t *srv = tu_ws_server();
+    mssn_t *cli = tu_ws_client();
+    const char *resp = mssn_ws_negotiate(srv, "permessage-deflate", 18);
+    CHECK(resp != NULL);
+    CHECK(mssn_ws_negotiate(cli, resp, (int)strlen(resp)) != NULL);
+    mssn_t *plain = tu_ws_server();
+
+    const size_t sizes[] = {1, 100, 126, 5000, 65536, 200000};
+    const size_t fs[] = {20, 131, 4096, 1 << 20};
+    uint8_t *p = malloc(200000);
+    uint8_t *out = malloc(1 << 20);
+    for (size_t i = 0; i < 200000; i++)
+    {
+        p[i] = (i % 5 == 0) ? (uint8_t)(i * 131) : (uint8_t) "abcd"[i % 4];
+    }
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        for (size_t j = 0; j < sizeof(fs) / sizeof(fs[0]); j++)
+        {
+            // same bytes as mssn_build
+            const int64_t n = mssn_build_into(plain, WS_FRAME_BINARY, 0, fs[j], p, sizes[i], out, 1 << 20);
+            mssn_data_t *dt = mssn_build(plain, WS_FRAME_BINARY, 0, fs[j], p, sizes[i]);
+            CHECK((n > 0) && (dt != NULL));
+            int64_t off = 0;
+            for (mssn_data_t *d = dt; d != NULL; d = d->next)
+            {
+                CHECK(off + d->length <= n);
+                CHECK(memcmp(out + off, d->data, d->length) == 0);
+                off += d->length;
+            }
+            CHECK(off == n);
+            mssn_reclaim(plain, dt);
+            // size query, and too small out left untouched
+            CHECK(mssn_build_into(plain, WS_FRAME_BINARY, 0, fs[j], p, sizes[i], NULL, 0) == n);
+            memset(out, 0xAA, 8);
+            CHECK(mssn_build_into(plain, WS_FRAME_BINARY, 0, fs[j], p, sizes[i], out, (size_t)n - 1) == n);
+            CHECK(out[0] == 0xAA);
+
+            // masked client frames, plain and deflated, decoded by server
+            for (int f = 0; f < 2; f++)
+            {
+                const int flags = f ? MSSN_BUILD_DEFLATE : 0;
+                const int64_t need = mssn_build_into(cli, WS_FRAME_BINARY, flags, fs[j], p, sizes[i], NULL, 0);
+                CHECK(need > (int64_t)sizes[i]);
+                uint8_t *wire = malloc((size_t)need);
+                const int64_t m = mssn_build_into(cli, WS_FRAME_BINARY, flags, fs[j], p, sizes[i], wire, (size_t)need);
+                CHECK((m > 0) && (m <= need));
+                recv_check(srv, wire, m, p, sizes[i]);
+                free(wire);
+            }
+        }
+    }
+    mssn_deflate_stats_t st;
+    mssn_deflate_stats(cli, &st);
+    CHECK((st.compressed > 0) && (st.compressed_out < st.compressed_in));
+    CHECK(mssn_build_into(cli, WS_FRAME_BINARY, 0, 1, p, 10, out, 100) == -1);
+
+    mssn_close(srv);
+    mssn_close(cli);
+    mssn_close(plain);
+    free(p);
+    free(out);
+    TEST_OK();
+    return 0;
+}
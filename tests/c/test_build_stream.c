@@ -0,0 +1,153 @@
+/*
+ * message built incrementally with mssn_build_begin/append/finish, control frames between
+ */
+
+#include "test_util.h"
+
+/// process frames in rx, each within frame size
+static void
+feed_frames(mssn_t *rx, mssn_data_t *dt, size_t frame_size)
+{
+    for (mssn_data_t *d = dt; d != NULL; d = d->next)
+    {
+        CHECK((size_t)d->length <= frame_size);
+        tu_feed(rx, d->data, d->length);
+    }
+}
+
+/// stream len bytes in chunks from tx to rx, ping after first chunk, check single message
+static void
+stream_msg(mssn_t *tx, mssn_t *rx, const uint8_t *p, size_t len, size_t chunk, size_t frame_size, int flags)
+{
+    CHECK(mssn_build_begin(tx, WS_FRAME_BINARY, flags, frame_size) == 0);
+    // one message at a time
+    CHECK(mssn_build_begin(tx, WS_FRAME_BINARY, flags, frame_size) == -1);
+    CHECK(mssn_build(tx, WS_FRAME_TEXT, 0, 100, p, 10) == NULL);
+    for (size_t off = 0; off < len; off += chunk)
+    {
+        const size_t n = (len - off < chunk) ? (len - off) : chunk;
+        mssn_data_t *dt = NULL;
+        CHECK(mssn_build_append(tx, p + off, n, &dt) == 0);
+        feed_frames(rx, dt, frame_size);
+        mssn_reclaim(tx, dt);
+        if (off == 0)
+        {
+            mssn_data_t *pg = mssn_build(tx, WS_FRAME_PING, 0, 100, (const uint8_t *)"x", 1);
+            CHECK(pg != NULL);
+            feed_frames(rx, pg, 100);
+            mssn_reclaim(tx, pg);
+        }
+    }
+    mssn_data_t *dt = NULL;
+    CHECK((mssn_build_finish(tx, &dt) == 0) && (dt != NULL));
+    feed_frames(rx, dt, frame_size);
+    mssn_reclaim(tx, dt);
+
+    uint8_t *got = malloc(len + 1);
+    size_t total = 0;
+    int fin = 0;
+    for (mssn_frame_t *fr = rx->frames; fr != NULL; fr = fr->next)
+    {
+        if (fr->ftype == WS_FRAME_BINARY)
+        {
+            CHECK(total + tu_payload(fr, got + total) <= len);
+            total += tu_payload(fr, got + total);
+            fin += fr->fin;
+        }
+    }
+    CHECK((fin == 1) && (total == len) && (memcmp(got, p, len) == 0));
+    mssn_reclaim(rx, NULL);
+    free(got);
+}
+
+static void
+test_matrix(void)
+{
+    const size_t sz = 50000;
+    uint8_t *p = malloc(sz);
+    const char *offers[3] = {NULL, "permessage-deflate",
+                             "permessage-deflate; server_no_context_takeover; client_no_context_takeover"};
+    const size_t fsizes[4] = {16, 100, 1000, 70000};
+    const size_t chunks[4] = {1, 7, 999, 50000};
+    const size_t lens[3] = {0, 3, 50000};
+    for (int o = 0; o < 3; o++)
+    {
+        for (int dir = 0; dir < 2; dir++)
+        {
+            for (int fi = 0; fi < 4; fi++)
+            {
+                for (int ci = 0; ci < 4; ci++)
+                {
+                    for (int li = 0; li < 3; li++)
+                    {
+                        mssn_t *srv = tu_ws_server();
+                        mssn_t *cli = tu_ws_client();
+                        if (offers[o] != NULL)
+                        {
+                            const char *resp = mssn_ws_negotiate(srv, offers[o], (int)strlen(offers[o]));
+                            CHECK(mssn_ws_negotiate(cli, resp, (int)strlen(resp)) != NULL);
+                        }
+                        mssn_t *tx = dir ? srv : cli;
+                        mssn_t *rx = dir ? cli : srv;
+                        const int flags = o ? MSSN_BUILD_DEFLATE : 0;
+                        for (int msg = 0; msg < 2; msg++)
+                        {
+                            // incompressible half of cases, still deflated without fallback
+                            if (o && (fi & 1))
+                            {
+                                tu_fill(p, lens[li], msg, 256);
+                            }
+                            else
+                            {
+                                for (size_t k = 0; k < lens[li]; k++)
+                                {
+                                    p[k] = "streaming "[(k + msg) % 10] ^ (k % 101 == 0);
+                                }
+                            }
+                            stream_msg(tx, rx, p, lens[li], chunks[ci], fsizes[fi], flags);
+                        }
+                        mssn_deflate_stats_t st;
+                        mssn_deflate_stats(tx, &st);
+                        CHECK((o == 0) || (st.compressed == 2));
+
+                        // abandoned message released by reset or close
+                        mssn_data_t *dt = NULL;
+                        mssn_build_begin(tx, WS_FRAME_TEXT, flags, 64);
+                        mssn_build_append(tx, p, (lens[li] < 200) ? lens[li] : 200, &dt);
+                        mssn_reclaim(tx, dt);
+                        if (dir)
+                        {
+                            mssn_reset(tx);
+                        }
+                        mssn_close(srv);
+                        mssn_close(cli);
+                    }
+                }
+            }
+        }
+    }
+    free(p);
+}
+
+static void
+test_misuse(void)
+{
+    mssn_t *srv = tu_ws_server();
+    mssn_data_t *dt = NULL;
+    CHECK(mssn_build_append(srv, (const uint8_t *)"a", 1, &dt) == -1);
+    CHECK(mssn_build_finish(srv, &dt) == -1);
+    CHECK(mssn_build_begin(srv, WS_FRAME_PING, 0, 100) == -1);
+    CHECK(mssn_build_begin(srv, WS_FRAME_TEXT, MSSN_BUILD_DEFLATE, 8) == -1);
+    CHECK(mssn_build_begin(NULL, WS_FRAME_TEXT, 0, 100) == -1);
+    CHECK(mssn_build_append(NULL, (const uint8_t *)"a", 1, &dt) == -1);
+    CHECK(mssn_build_finish(NULL, &dt) == -1);
+    mssn_close(srv);
+}
+
+int main(void)
+{
+    test_matrix();
+    test_misuse();
+    TEST_OK();
+    return 0;
+}
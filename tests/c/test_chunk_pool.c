@@ -0,0 +1,84 @@
+/*
+ * data chunk pool, thread cache flush and high-water trim
+ */
+
+#include <pthread.h>
+#include "test_util.h"
+
+static void *
+run_pair(void *arg)
+{
+    static uint8_t payload[100000];
+    mssn_t *cli = tu_ws_client();
+    mssn_t *srv = tu_ws_server();
+    for (int i = 0; i < 100; i++)
+    {
+        mssn_data_t *dt = mssn_build(cli, WS_FRAME_BINARY, 0, sizeof(payload) + 16, payload, sizeof(payload));
+        CHECK(dt != NULL);
+        int off = 0;
+        while (off < dt->length)
+        {
+            int ret = mssn_process(srv, dt->data + off, dt->length - off);
+            CHECK(ret > 0);
+            off += ret;
+        }
+        size_t got = 0;
+        for (mssn_data_t *d = srv->frames->data_head; d != NULL; d = d->next)
+        {
+            got += d->length;
+        }
+        CHECK(got == sizeof(payload));
+        mssn_reclaim(cli, dt);
+        mssn_reclaim(srv, NULL);
+    }
+    mssn_close(cli);
+    mssn_close(srv);
+    return NULL;
+}
+
+static void
+test_threads_flush(void)
+{
+    pthread_t th[4];
+    for (int i = 0; i < 4; i++)
+    {
+        CHECK(pthread_create(&th[i], NULL, run_pair, NULL) == 0);
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        pthread_join(th[i], NULL);
+    }
+
+    // exited threads returned their cache to global list
+    mssn_chunk_stats_t st;
+    mssn_chunk_pool_stats(&st);
+    CHECK(st.chunk_size > 0);
+    CHECK(st.thread_cached == 0);
+    CHECK(st.cached == st.allocated);
+    CHECK(st.hits > st.misses);
+}
+
+static void
+test_high_water(void)
+{
+    run_pair(NULL);
+    mssn_chunk_stats_t st;
+    mssn_chunk_pool_config(10);
+    mssn_chunk_pool_stats(&st);
+    CHECK(st.high_water == 10);
+    CHECK(st.cached <= 10);
+    CHECK(st.allocated == st.cached + st.thread_cached);
+
+    mssn_chunk_pool_config(0);
+    mssn_chunk_pool_stats(&st);
+    CHECK(st.cached == 0);
+    mssn_chunk_pool_config(1024);
+}
+
+int main(void)
+{
+    test_threads_flush();
+    test_high_water();
+    TEST_OK();
+    return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * mssn_build with MSSN_BUILD_DEFLATE, inflated back by peer context
+ */
+
+#include "test_util.h"
+
+/// build message in tx, check frame bits, process in rx and compare payload, no gain message
+/// built uncompressed when may_skip
+static void
+roundtrip(mssn_t *tx, mssn_t *rx, size_t sz, size_t fsz, int flags, int text, int may_skip)
+{
+    uint8_t *p = malloc(sz);
+    uint8_t *got = malloc(sz + 1);
+    for (size_t i = 0; i < sz; i++)
+    {
+        p[i] = (i % 7 == 0) ? (uint8_t)(i * 31) : (uint8_t) "hello world "[i % 12];
+    }
+    mssn_data_t *dt = mssn_build(tx, text ? WS_FRAME_TEXT : WS_FRAME_BINARY, flags, fsz, p, sz);
+    CHECK(dt != NULL);
+    const int deflated = (dt->data[0] >> 6) & 1;
+    CHECK((deflated == ((flags & MSSN_BUILD_DEFLATE) != 0)) || (may_skip && !deflated));
+    for (mssn_data_t *d = dt; d != NULL; d = d->next)
+    {
+        CHECK((size_t)d->length <= fsz);
+        const int fin = d->data[0] >> 7;
+        const int rsv1 = (d->data[0] >> 6) & 1;
+        const int op = d->data[0] & 0xF;
+        CHECK(fin == (d->next == NULL));
+        CHECK(rsv1 == (deflated && (d == dt)));
+        CHECK(op == ((d == dt) ? (text ? 1 : 2) : 0));
+        tu_feed(rx, d->data, d->length);
+    }
+    size_t total = 0;
+    int fin = 0;
+    for (mssn_frame_t *fr = rx->frames; fr != NULL; fr = fr->next)
+    {
+        CHECK(total + tu_payload(fr, got + total) <= sz);
+        total += tu_payload(fr, got + total);
+        fin += fr->fin;
+    }
+    CHECK((fin == 1) && (total == sz));
+    CHECK(memcmp(got, p, sz) == 0);
+    mssn_reclaim(rx, NULL);
+    mssn_reclaim(tx, dt);
+    free(p);
+    free(got);
+}
+
+static void
+test_sizes(const char *offer, int no_takeover)
+{
+    mssn_t *srv = tu_ws_server();
+    mssn_t *cli = tu_ws_client();
+    const char *resp = mssn_ws_negotiate(srv, offer, (int)strlen(offer));
+    CHECK(resp != NULL);
+    CHECK(mssn_ws_negotiate(cli, resp, (int)strlen(resp)) != NULL);
+    mssn_setopt(srv, MSSN_OPT_WS_DEFLATE_MIN, 0);
+    mssn_setopt(cli, MSSN_OPT_WS_DEFLATE_MIN, 0);
+    mssn_setopt(srv, MSSN_OPT_WS_DEFLATE_PROBE, 0);
+    mssn_setopt(cli, MSSN_OPT_WS_DEFLATE_PROBE, 0);
+
+    const size_t sizes[] = {1, 5, 100, 125, 126, 200, 4000, 65535, 65536, 70000, 300000};
+    const size_t fs[] = {20, 131, 132, 200, 4096, 70000, 1 << 20};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        for (size_t j = 0; j < sizeof(fs) / sizeof(fs[0]); j++)
+        {
+            for (int f = 0; f < 2; f++)
+            {
+                const int flags = f ? MSSN_BUILD_DEFLATE : 0;
+                roundtrip(cli, srv, sizes[i], fs[j], flags, i & 1, no_takeover);
+                roundtrip(srv, cli, sizes[i], fs[j], flags, !(i & 1), no_takeover);
+            }
+        }
+    }
+    mssn_close(srv);
+    mssn_close(cli);
+}
+
+static void
+test_control_and_stats(void)
+{
+    mssn_t *srv = tu_ws_server();
+    const char *offer = "permessage-deflate";
+    CHECK(mssn_ws_negotiate(srv, offer, (int)strlen(offer)) != NULL);
+
+    // control frame never compressed
+    mssn_data_t *dt = mssn_build(srv, WS_FRAME_PING, MSSN_BUILD_DEFLATE, 100, (const uint8_t *)"abc", 3);
+    CHECK((dt != NULL) && (dt->next == NULL) && (dt->data[0] == 0x89));
+    mssn_reclaim(srv, dt);
+
+    // frame size without room for header
+    CHECK(mssn_build(srv, WS_FRAME_TEXT, 0, 1, (const uint8_t *)"abc", 3) == NULL);
+
+    uint8_t p[8192];
+    tu_fill(p, sizeof(p), 1, 4);
+    dt = mssn_build(srv, WS_FRAME_TEXT, MSSN_BUILD_DEFLATE, 16384, p, sizeof(p));
+    CHECK((dt != NULL) && (dt->length < (int)sizeof(p)));
+    mssn_reclaim(srv, dt);
+    mssn_deflate_stats_t st;
+    mssn_deflate_stats(srv, &st);
+    CHECK(st.compressed == 1);
+    CHECK((st.compressed_in == sizeof(p)) && (st.compressed_out < st.compressed_in));
+    mssn_close(srv);
+}
+
+int main(void)
+{
+    test_sizes("permessage-deflate", 0);
+    test_sizes("permessage-deflate; server_no_context_takeover; client_no_context_takeover", 1);
+    test_control_and_stats();
+    TEST_OK();
+    return 0;
+}
@@ -0,0 +1,78 @@
+/*
+ * small or incompressible message built uncompressed, with skipped counters
+ */
+
+#include "test_util.h"
+
+/// build message in tx, check rsv1, process in rx and compare payload
+static void
+send_msg(mssn_t *tx, mssn_t *rx, const uint8_t *p, size_t sz, int want_rsv1)
+{
+    uint8_t *got = malloc(sz);
+    mssn_data_t *dt = mssn_build(tx, WS_FRAME_BINARY, MSSN_BUILD_DEFLATE, 4096, p, sz);
+    CHECK(dt != NULL);
+    CHECK(((dt->data[0] >> 6) & 1) == want_rsv1);
+    for (mssn_data_t *d = dt; d != NULL; d = d->next)
+    {
+        tu_feed(rx, d->data, d->length);
+    }
+    size_t total = 0;
+    for (mssn_frame_t *fr = rx->frames; fr != NULL; fr = fr->next)
+    {
+        total += tu_payload(fr, got + total);
+    }
+    CHECK((total == sz) && (memcmp(got, p, sz) == 0));
+    mssn_reclaim(rx, NULL);
+    mssn_reclaim(tx, dt);
+    free(got);
+}
+
+static void
+run_bypass(int no_takeover)
+{
+    mssn_t *srv = tu_ws_server();
+    mssn_t *cli = tu_ws_client();
+    const char *offer = no_takeover ? "permessage-deflate; client_no_context_takeover" : "permessage-deflate";
+    const char *resp = mssn_ws_negotiate(srv, offer, (int)strlen(offer));
+    CHECK(resp != NULL);
+    CHECK(mssn_ws_negotiate(cli, resp, (int)strlen(resp)) != NULL);
+
+    static uint8_t txt[8192];
+    static uint8_t rnd[8192];
+    unsigned seed = 7;
+    for (size_t i = 0; i < sizeof(txt); i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        txt[i] = "{\"ack\":1,\"id\":12345}"[i % 20];
+        rnd[i] = (uint8_t)(seed >> 16);
+    }
+    send_msg(cli, srv, txt, 20, 0);   // below min
+    send_msg(cli, srv, txt, 8192, 1); // compressible
+    send_msg(cli, srv, rnd, 8192, 0); // probe rejects
+    mssn_setopt(cli, MSSN_OPT_WS_DEFLATE_PROBE, 0);
+    // no gain falls back to plain only without context takeover
+    send_msg(cli, srv, rnd, 70, !no_takeover);
+    send_msg(cli, srv, txt, 300, 1); // peer inflate stream still in sync
+    mssn_setopt(cli, MSSN_OPT_WS_DEFLATE_MIN, 0);
+    send_msg(cli, srv, txt, 20, !no_takeover);
+
+    mssn_deflate_stats_t st;
+    mssn_deflate_stats(cli, &st);
+    CHECK(st.compressed == (no_takeover ? 2u : 4u));
+    CHECK(st.skipped == (no_takeover ? 4u : 2u));
+    CHECK(st.compressed_out < st.compressed_in);
+    CHECK(st.skipped_bytes == (no_takeover ? 20u + 8192u + 70u + 20u : 20u + 8192u));
+    mssn_reset(cli);
+    mssn_deflate_stats(cli, &st);
+    CHECK((st.compressed == 0) && (st.skipped == 0));
+    mssn_close(srv);
+    mssn_close(cli);
+}
+
+int main(void)
+{
+    run_bypass(0);
+    run_bypass(1);
+    TEST_OK();
+    return 0;
+}
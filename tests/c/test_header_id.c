@@ -0,0 +1,178 @@
+/*
+ * known header names interned by id, looked up with mssn_header_get and mssn_header_find
+ */
+
+#include <ctype.h>
+#include "test_util.h"
+
+/// header present with value, not NUL terminated under zero copy
+static int
+has_value(const mssn_header_t *h, const char *v)
+{
+    return (h != NULL) && (h->value_span.length == (int)strlen(v)) && (strncmp(h->value, v, strlen(v)) == 0);
+}
+
+static void
+test_lookup(void)
+{
+    const char *req = "GET /chat HTTP/1.1\r\nhost: a.com\r\nUpgrade: websocket\r\nCONNECTION: Upgrade\r\n"
+                      "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n"
+                      "X-Custom-Thing: yes\r\nCookie: a=1\r\nCookie: b=2\r\nX-Empty:\r\nx-real-ip: 1.2.3.4\r\n\r\n";
+    const int rlen = (int)strlen(req);
+    for (int zc = 0; zc < 2; zc++)
+    {
+        for (int split = 1; split < rlen; split += 3)
+        {
+            mssn_t *srv = mssn_create(1);
+            mssn_setopt(srv, MSSN_OPT_ZERO_COPY, zc);
+            CHECK(mssn_process(srv, (const uint8_t *)req, split) == split);
+            CHECK(mssn_process(srv, (const uint8_t *)req + split, rlen - split) == rlen - split);
+            CHECK(srv->upgrade == 1);
+            mssn_header_t *h = mssn_header_get(srv, MSSN_H_HOST);
+            CHECK(has_value(h, "a.com") && (h->id == MSSN_H_HOST));
+            CHECK(has_value(mssn_header_get(srv, MSSN_H_CONNECTION), "Upgrade"));
+            CHECK(has_value(mssn_header_get(srv, MSSN_H_X_REAL_IP), "1.2.3.4"));
+            // repeated header chained by dup
+            h = mssn_header_get(srv, MSSN_H_COOKIE);
+            CHECK(has_value(h, "a=1") && has_value(h->dup, "b=2") && (h->dup->dup == NULL));
+            // name without NUL, unknown names by list walk
+            CHECK(has_value(mssn_header_find(srv, "X-REAL-IP", 9), "1.2.3.4"));
+            CHECK(has_value(mssn_header_find(srv, "x-custom-thingXX", 14), "yes"));
+            CHECK(mssn_header_find(srv, "X-Custom-Thing", 14)->id == MSSN_H_UNKNOWN);
+            CHECK(has_value(mssn_header_find(srv, "x-empty", 7), ""));
+            CHECK(mssn_header_find(srv, "X-Nope", 6) == NULL);
+            CHECK(mssn_header_get(srv, MSSN_H_ETAG) == NULL);
+            CHECK(mssn_header_get(srv, MSSN_H_UNKNOWN) == NULL);
+            CHECK((mssn_header_get(srv, MSSN_H_MAX) == NULL) && (mssn_header_get(srv, -3) == NULL));
+
+            // index cleared by reset and reclaim
+            mssn_reset(srv);
+            CHECK(mssn_header_get(srv, MSSN_H_HOST) == NULL);
+            const char *r2 = "GET / HTTP/1.1\r\nETag: x\r\n\r\n";
+            tu_feed(srv, r2, strlen(r2));
+            CHECK(has_value(mssn_header_get(srv, MSSN_H_ETAG), "x"));
+            CHECK(mssn_header_get(srv, MSSN_H_HOST) == NULL);
+            mssn_reclaim(srv, NULL);
+            CHECK(mssn_header_get(srv, MSSN_H_ETAG) == NULL);
+            mssn_close(srv);
+        }
+    }
+}
+
+static void
+test_interned(void)
+{
+    const char *names[] = {"A-IM", "accept-charset", "WWW-Authenticate", "x-requested-with",
+                           "Access-Control-Allow-Credentials", "te", "dnt", "Via"};
+    for (int i = 0; i < 8; i++)
+    {
+        char req[256];
+        const int n = snprintf(req, sizeof(req), "GET / HTTP/1.1\r\n%s: v%d\r\n\r\n", names[i], i);
+        mssn_t *srv = mssn_create(1);
+        tu_feed(srv, req, n);
+        CHECK((srv->headers != NULL) && (srv->headers->id != MSSN_H_UNKNOWN));
+        CHECK(mssn_header_get(srv, srv->headers->id) == srv->headers);
+        mssn_close(srv);
+    }
+
+    // websocket version checked by index
+    const char *req = "GET /chat HTTP/1.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                      "Sec-WebSocket-Version: 8\r\n\r\n";
+    mssn_t *srv = mssn_create(1);
+    mssn_process(srv, (const uint8_t *)req, (int)strlen(req));
+    CHECK((srv->upgrade == 0) && (srv->error_msg != NULL));
+    mssn_close(srv);
+}
+
+/// every known name by id, independent of perfect hash tables in session
+static const struct
+{
+    int id;
+    const char *name;
+} known[] = {
+    {MSSN_H_A_IM, "A-IM"}, {MSSN_H_ACCEPT, "Accept"}, {MSSN_H_ACCEPT_CHARSET, "Accept-Charset"},
+    {MSSN_H_ACCEPT_DATETIME, "Accept-Datetime"}, {MSSN_H_ACCEPT_ENCODING, "Accept-Encoding"},
+    {MSSN_H_ACCEPT_LANGUAGE, "Accept-Language"}, {MSSN_H_ACCEPT_PATCH, "Accept-Patch"},
+    {MSSN_H_ACCEPT_RANGES, "Accept-Ranges"},
+    {MSSN_H_ACCESS_CONTROL_ALLOW_CREDENTIALS, "Access-Control-Allow-Credentials"},
+    {MSSN_H_ACCESS_CONTROL_ALLOW_HEADERS, "Access-Control-Allow-Headers"},
+    {MSSN_H_ACCESS_CONTROL_ALLOW_METHODS, "Access-Control-Allow-Methods"},
+    {MSSN_H_ACCESS_CONTROL_ALLOW_ORIGIN, "Access-Control-Allow-Origin"},
+    {MSSN_H_ACCESS_CONTROL_EXPOSE_HEADERS, "Access-Control-Expose-Headers"},
+    {MSSN_H_ACCESS_CONTROL_MAX_AGE, "Access-Control-Max-Age"},
+    {MSSN_H_ACCESS_CONTROL_REQUEST_HEADERS, "Access-Control-Request-Headers"},
+    {MSSN_H_ACCESS_CONTROL_REQUEST_METHOD, "Access-Control-Request-Method"}, {MSSN_H_AGE, "Age"},
+    {MSSN_H_ALLOW, "Allow"}, {MSSN_H_ALT_SVC, "Alt-Svc"}, {MSSN_H_AUTHORIZATION, "Authorization"},
+    {MSSN_H_CACHE_CONTROL, "Cache-Control"}, {MSSN_H_CONNECTION, "Connection"},
+    {MSSN_H_CONTENT_DISPOSITION, "Content-Disposition"}, {MSSN_H_CONTENT_ENCODING, "Content-Encoding"},
+    {MSSN_H_CONTENT_LANGUAGE, "Content-Language"}, {MSSN_H_CONTENT_LENGTH, "Content-Length"},
+    {MSSN_H_CONTENT_LOCATION, "Content-Location"}, {MSSN_H_CONTENT_RANGE, "Content-Range"},
+    {MSSN_H_CONTENT_SECURITY_POLICY, "Content-Security-Policy"}, {MSSN_H_CONTENT_TYPE, "Content-Type"},
+    {MSSN_H_COOKIE, "Cookie"}, {MSSN_H_DATE, "Date"}, {MSSN_H_DNT, "DNT"}, {MSSN_H_ETAG, "ETag"},
+    {MSSN_H_EXPECT, "Expect"}, {MSSN_H_EXPIRES, "Expires"}, {MSSN_H_FORWARDED, "Forwarded"},
+    {MSSN_H_FROM, "From"}, {MSSN_H_HOST, "Host"}, {MSSN_H_IF_MATCH, "If-Match"},
+    {MSSN_H_IF_MODIFIED_SINCE, "If-Modified-Since"}, {MSSN_H_IF_NONE_MATCH, "If-None-Match"},
+    {MSSN_H_IF_RANGE, "If-Range"}, {MSSN_H_IF_UNMODIFIED_SINCE, "If-Unmodified-Since"},
+    {MSSN_H_KEEP_ALIVE, "Keep-Alive"}, {MSSN_H_LAST_MODIFIED, "Last-Modified"}, {MSSN_H_LINK, "Link"},
+    {MSSN_H_LOCATION, "Location"}, {MSSN_H_MAX_FORWARDS, "Max-Forwards"}, {MSSN_H_ORIGIN, "Origin"},
+    {MSSN_H_PRAGMA, "Pragma"}, {MSSN_H_PROXY_AUTHENTICATE, "Proxy-Authenticate"},
+    {MSSN_H_PROXY_AUTHORIZATION, "Proxy-Authorization"}, {MSSN_H_PROXY_CONNECTION, "Proxy-Connection"},
+    {MSSN_H_RANGE, "Range"}, {MSSN_H_REFERER, "Referer"}, {MSSN_H_REFRESH, "Refresh"},
+    {MSSN_H_RETRY_AFTER, "Retry-After"}, {MSSN_H_SEC_FETCH_DEST, "Sec-Fetch-Dest"},
+    {MSSN_H_SEC_FETCH_MODE, "Sec-Fetch-Mode"}, {MSSN_H_SEC_FETCH_SITE, "Sec-Fetch-Site"},
+    {MSSN_H_SEC_FETCH_USER, "Sec-Fetch-User"}, {MSSN_H_SEC_WEBSOCKET_ACCEPT, "Sec-WebSocket-Accept"},
+    {MSSN_H_SEC_WEBSOCKET_EXTENSIONS, "Sec-WebSocket-Extensions"},
+    {MSSN_H_SEC_WEBSOCKET_KEY, "Sec-WebSocket-Key"},
+    {MSSN_H_SEC_WEBSOCKET_PROTOCOL, "Sec-WebSocket-Protocol"},
+    {MSSN_H_SEC_WEBSOCKET_VERSION, "Sec-WebSocket-Version"}, {MSSN_H_SERVER, "Server"},
+    {MSSN_H_SET_COOKIE, "Set-Cookie"}, {MSSN_H_STRICT_TRANSPORT_SECURITY, "Strict-Transport-Security"},
+    {MSSN_H_TE, "TE"}, {MSSN_H_TRAILER, "Trailer"}, {MSSN_H_TRANSFER_ENCODING, "Transfer-Encoding"},
+    {MSSN_H_UPGRADE, "Upgrade"}, {MSSN_H_UPGRADE_INSECURE_REQUESTS, "Upgrade-Insecure-Requests"},
+    {MSSN_H_USER_AGENT, "User-Agent"}, {MSSN_H_VARY, "Vary"}, {MSSN_H_VIA, "Via"},
+    {MSSN_H_WARNING, "Warning"}, {MSSN_H_WWW_AUTHENTICATE, "WWW-Authenticate"},
+    {MSSN_H_X_CONTENT_TYPE_OPTIONS, "X-Content-Type-Options"}, {MSSN_H_X_FORWARDED_FOR, "X-Forwarded-For"},
+    {MSSN_H_X_FORWARDED_HOST, "X-Forwarded-Host"}, {MSSN_H_X_FORWARDED_PROTO, "X-Forwarded-Proto"},
+    {MSSN_H_X_FRAME_OPTIONS, "X-Frame-Options"}, {MSSN_H_X_REAL_IP, "X-Real-IP"},
+    {MSSN_H_X_REQUESTED_WITH, "X-Requested-With"},
+};
+
+static void
+test_all_names(void)
+{
+    const int nknown = (int)(sizeof(known) / sizeof(known[0]));
+    CHECK(nknown == MSSN_H_MAX - 1);
+    for (int i = 0; i < nknown; i++)
+    {
+        CHECK(known[i].id == i + 1);
+        const size_t len = strlen(known[i].name);
+        for (int fold = 0; fold < 3; fold++)
+        {
+            // as listed, lowercase, uppercase
+            char name[64];
+            for (size_t k = 0; k <= len; k++)
+            {
+                const char c = known[i].name[k];
+                name[k] = (fold == 1) ? (char)tolower(c) : (fold == 2) ? (char)toupper(c) : c;
+            }
+            // value valid for parser, chunked body not followed
+            const char *value = (known[i].id == MSSN_H_TRANSFER_ENCODING) ? "chunked" : "0";
+            char req[128];
+            const int n = snprintf(req, sizeof(req), "GET / HTTP/1.1\r\n%s: %s\r\n\r\n", name, value);
+            mssn_t *srv = mssn_create(1);
+            CHECK(mssn_process(srv, (const uint8_t *)req, n) == n);
+            CHECK((srv->headers != NULL) && (srv->headers->id == known[i].id));
+            CHECK(mssn_header_get(srv, known[i].id) == srv->headers);
+            CHECK(mssn_header_find(srv, known[i].name, (int)len) == srv->headers);
+            mssn_close(srv);
+        }
+    }
+}
+
+int main(void)
+{
+    test_lookup();
+    test_interned();
+    test_all_names();
+    TEST_OK();
+    return 0;
+}
@@ -0,0 +1,100 @@
+/*
+ * header index over many and repeated names, case folding letters only
+ */
+
+#include "test_util.h"
+
+/// header present with value, not NUL terminated under zero copy
+static int
+has_value(const mssn_header_t *h, const char *v)
+{
+    return (h != NULL) && (h->value_span.length == (int)strlen(v)) && (strncmp(h->value, v, strlen(v)) == 0);
+}
+
+static void
+test_many_repeated(void)
+{
+    char req[20000];
+    int rlen = sprintf(req, "GET / HTTP/1.1\r\n");
+    for (int i = 0; i < 200; i++)
+    {
+        rlen += sprintf(req + rlen, "X-H%d: v%d\r\n", i, i);
+    }
+    rlen += sprintf(req + rlen, "cookie: a\r\nX-Multi: 1\r\nCOOKIE: b\r\nx-multi: 2\r\nCookie: c\r\nX-MULTI: 3\r\n\r\n");
+    for (int zc = 0; zc < 2; zc++)
+    {
+        for (int split = 1; split < rlen; split += 97)
+        {
+            mssn_t *srv = mssn_create(1);
+            mssn_setopt(srv, MSSN_OPT_ZERO_COPY, zc);
+            CHECK(mssn_process(srv, (const uint8_t *)req, split) == split);
+            CHECK(mssn_process(srv, (const uint8_t *)req + split, rlen - split) == rlen - split);
+            for (int i = 0; i < 200; i++)
+            {
+                char k[16];
+                char v[16];
+                const int klen = sprintf(k, "x-h%d", i);
+                sprintf(v, "v%d", i);
+                mssn_header_t *h = mssn_header_find(srv, k, klen);
+                CHECK(has_value(h, v) && (h->dup == NULL));
+            }
+            mssn_header_t *h = mssn_header_get(srv, MSSN_H_COOKIE);
+            CHECK(h == mssn_header_find(srv, "Cookie", 6));
+            CHECK(has_value(h, "a") && has_value(h->dup, "b") && has_value(h->dup->dup, "c"));
+            CHECK(h->dup->dup->dup == NULL);
+            h = mssn_header_find(srv, "X-Multi", 7);
+            CHECK(has_value(h, "1") && has_value(h->dup, "2") && has_value(h->dup->dup, "3"));
+            CHECK(h->dup->dup->dup == NULL);
+            CHECK((mssn_header_find(srv, "X-H200", 6) == NULL) && (mssn_header_find(srv, "X-H", 3) == NULL));
+
+            mssn_reclaim(srv, NULL);
+            CHECK((mssn_header_find(srv, "X-H1", 4) == NULL) && (mssn_header_get(srv, MSSN_H_COOKIE) == NULL));
+            const char *r2 = "GET / HTTP/1.1\r\nX-H1: again\r\n\r\n";
+            tu_feed(srv, r2, strlen(r2));
+            CHECK(has_value(mssn_header_find(srv, "X-h1", 4), "again"));
+            CHECK(mssn_header_find(srv, "X-H2", 4) == NULL);
+            mssn_close(srv);
+        }
+    }
+}
+
+static void
+test_fold_letters_only(void)
+{
+    // '^' and '~' differ only in 0x20 bit, in tail and in full words
+    const char *req = "GET / HTTP/1.1\r\nx-a~b: tilde\r\nX-Long-Name^Aaaaa: caret\r\n"
+                      "Sec-WebSocket-Key^: odd\r\nx-y: short\r\n\r\n";
+    mssn_t *srv = mssn_create(1);
+    tu_feed(srv, req, strlen(req));
+    CHECK(has_value(mssn_header_find(srv, "X-A~B", 5), "tilde"));
+    CHECK(mssn_header_find(srv, "X-a^b", 5) == NULL);
+    CHECK(has_value(mssn_header_find(srv, "x-long-name^aaaaa", 17), "caret"));
+    CHECK(mssn_header_find(srv, "X-LONG-NAME~AAAAA", 17) == NULL);
+    CHECK(mssn_header_find(srv, "sec-websocket-key~", 18) == NULL);
+    CHECK(mssn_header_get(srv, MSSN_H_SEC_WEBSOCKET_KEY) == NULL);
+    // tail shorter than padding never matches padded name
+    CHECK(has_value(mssn_header_find(srv, "X-Y", 3), "short"));
+    CHECK(mssn_header_find(srv, "x-y ", 4) == NULL);
+    mssn_close(srv);
+
+    // known names in any letter case
+    const char *names[] = {"ACCEPT-ENCODING", "accept-encoding", "aCCEPT-eNCODING", "Accept-Encoding"};
+    for (int i = 0; i < 4; i++)
+    {
+        char r[128];
+        const int n = snprintf(r, sizeof(r), "GET / HTTP/1.1\r\n%s: gzip\r\n\r\n", names[i]);
+        srv = mssn_create(1);
+        tu_feed(srv, r, n);
+        CHECK(srv->headers->id == MSSN_H_ACCEPT_ENCODING);
+        CHECK(has_value(mssn_header_get(srv, MSSN_H_ACCEPT_ENCODING), "gzip"));
+        mssn_close(srv);
+    }
+}
+
+int main(void)
+{
+    test_many_repeated();
+    test_fold_letters_only();
+    TEST_OK();
+    return 0;
+}
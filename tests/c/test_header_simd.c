@@ -0,0 +1,96 @@
+/*
+ * simd_header_value against scalar scan, long header values split anywhere
+ */
+
+#include "m_simd.h"
+#include "test_util.h"
+
+/// scalar reference
+static size_t
+ref_header_value(const uint8_t *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        if (((buf[i] < 0x20) && (buf[i] != '\t')) || (buf[i] == 0x7F))
+        {
+            return i;
+        }
+    }
+    return len;
+}
+
+static void
+test_kernel(void)
+{
+    uint8_t buf[300];
+    unsigned seed = 3;
+    for (int it = 0; it < 200000; it++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        const size_t n = (seed >> 16) % 300;
+        for (size_t i = 0; i < n; i++)
+        {
+            seed = seed * 1103515245u + 12345u;
+            const unsigned r = (seed >> 16) % 100;
+            const unsigned v = seed >> 24;
+            buf[i] = (r < 90) ? (uint8_t)(0x20 + v % 95) : (r < 95) ? (uint8_t)(0x80 | v) : (r < 97) ? '\t' : (uint8_t)v;
+        }
+        // unaligned start
+        const size_t off = (n < 8) ? n : (size_t)(it % 8);
+        CHECK(simd_header_value(buf + off, n - off) == ref_header_value(buf + off, n - off));
+    }
+    // every byte value at every lane
+    for (int c = 0; c < 256; c++)
+    {
+        for (size_t pos = 0; pos < 70; pos++)
+        {
+            memset(buf, 'a', 80);
+            buf[pos] = (uint8_t)c;
+            CHECK(simd_header_value(buf, 80) == ref_header_value(buf, 80));
+        }
+    }
+}
+
+static void
+test_parse_split(void)
+{
+    char cookie[2000];
+    char req[4096];
+    for (int i = 0; i < 1999; i++)
+    {
+        cookie[i] = "abcdefgh=;\t \x80\xff"[i % 14];
+    }
+    cookie[1999] = '\0';
+    const int rlen = snprintf(req, sizeof(req),
+                              "GET / HTTP/1.1\r\nHost: x\r\nCookie: %s\r\nUser-Agent: Mozilla/5.0 (X11)\r\n\r\n",
+                              cookie);
+    for (int split = 1; split < rlen; split += 7)
+    {
+        mssn_t *srv = mssn_create(1);
+        CHECK(mssn_process(srv, (const uint8_t *)req, split) == split);
+        CHECK(mssn_process(srv, (const uint8_t *)req + split, rlen - split) == rlen - split);
+        CHECK(srv->state >= MSSN_STATE_HEADER);
+        int found = 0;
+        for (mssn_header_t *h = srv->headers; h != NULL; h = h->next)
+        {
+            found += (strcmp(h->key, "Cookie") == 0) && (strcmp(h->value, cookie) == 0);
+        }
+        CHECK(found == 1);
+        mssn_close(srv);
+    }
+
+    // control char inside long value
+    const char *bad = "GET / HTTP/1.1\r\nHost: x\r\nCookie: aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\x01"
+                      "bbbb\r\n\r\n";
+    mssn_t *srv = mssn_create(1);
+    CHECK(mssn_process(srv, (const uint8_t *)bad, (int)strlen(bad)) == -1);
+    mssn_close(srv);
+}
+
+int main(void)
+{
+    test_kernel();
+    test_parse_split();
+    TEST_OK();
+    return 0;
+}
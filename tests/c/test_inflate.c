@@ -0,0 +1,177 @@
+/*
+ * permessage-deflate inflate, whole and streamed, bounded by MSSN_OPT_WS_INFLATE_MAX
+ */
+
+#include <zlib.h>
+#include "test_util.h"
+
+/// raw deflate with sync flush, tail 00 00 ff ff stripped, return length
+static size_t
+deflate_msg(z_stream *zs, const uint8_t *in, size_t in_len, uint8_t *out, size_t out_cap)
+{
+    zs->next_in = (Bytef *)in;
+    zs->avail_in = (uInt)in_len;
+    zs->next_out = out;
+    zs->avail_out = (uInt)out_cap;
+    CHECK(deflate(zs, Z_SYNC_FLUSH) == Z_OK);
+    CHECK(zs->avail_in == 0);
+    return out_cap - zs->avail_out - 4;
+}
+
+/// compressed message in two fragments fed in pieces, return total inflated or -1
+static long
+feed_msg(mssn_t *srv, const uint8_t *c, size_t clen, uint8_t *got, size_t got_cap)
+{
+    uint8_t *wire = malloc(clen + 64);
+    const size_t half = clen / 2;
+    int n = tu_frame(wire, 0, 0x4, 0x2, 1, c, half);
+    n += tu_frame(wire + n, 1, 0, 0x0, 1, c + half, clen - half);
+    long total = 0;
+    int fin = 0;
+    unsigned seed = 3;
+    for (int off = 0; off < n;)
+    {
+        seed = seed * 1103515245u + 12345u;
+        int len = 1 + (int)((seed >> 16) % 3000);
+        len = (len > n - off) ? (n - off) : len;
+        int ret = mssn_process(srv, wire + off, len);
+        if (ret < 0)
+        {
+            total = -1;
+            break;
+        }
+        CHECK(ret == len);
+        off += ret;
+        for (mssn_frame_t *fr = srv->frames; fr != NULL; fr = fr->next)
+        {
+            uint64_t o = fr->offset;
+            for (mssn_data_t *dt = fr->data_head; dt != NULL; dt = dt->next)
+            {
+                CHECK(o + dt->length <= got_cap);
+                memcpy(got + o, dt->data, dt->length);
+                o += dt->length;
+                total += dt->length;
+            }
+            fin += fr->fin;
+        }
+        mssn_reclaim(srv, NULL);
+    }
+    CHECK((total < 0) || (fin == 1));
+    free(wire);
+    return total;
+}
+
+static void
+run_roundtrip(int stream)
+{
+    mssn_t *srv = mssn_create(1);
+    mssn_setopt(srv, MSSN_OPT_WS_INFLATE, 1);
+    mssn_setopt(srv, MSSN_OPT_WS_STREAM, stream);
+    tu_feed(srv, tu_upgrade_req, strlen(tu_upgrade_req));
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    CHECK(deflateInit2(&zs, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+    for (int m = 0; m < 5; m++)
+    {
+        // context takeover across messages
+        const size_t sz = 1000 + m * 40000;
+        uint8_t *p = malloc(sz);
+        uint8_t *c = malloc(sz + 1024);
+        uint8_t *got = calloc(1, sz);
+        tu_fill(p, sz, m, 8);
+        size_t clen = deflate_msg(&zs, p, sz, c, sz + 1024);
+        CHECK(feed_msg(srv, c, clen, got, sz) == (long)sz);
+        CHECK(memcmp(got, p, sz) == 0);
+        free(p);
+        free(c);
+        free(got);
+    }
+
+    // uncompressed message passes through
+    uint8_t w[64];
+    uint8_t out[64];
+    int n = tu_frame(w, 1, 0, 0x1, 1, "plain", 5);
+    tu_feed(srv, w, n);
+    CHECK(tu_payload(srv->frames, out) == 5);
+    CHECK(memcmp(out, "plain", 5) == 0);
+    mssn_reclaim(srv, NULL);
+
+    // garbage compressed
+    n = tu_frame(w, 1, 0x4, 0x1, 1, "\xff\xff\xff\xff\xff", 5);
+    CHECK(mssn_process(srv, w, n) == -1);
+    CHECK(strcmp(srv->error_msg, "inflate error") == 0);
+
+    deflateEnd(&zs);
+    mssn_close(srv);
+}
+
+static void
+run_bomb(int stream)
+{
+    // 64 MB of zeros deflates to about 64 KB
+    const size_t sz = 64 * 1024 * 1024;
+    uint8_t *p = calloc(1, sz);
+    uint8_t *c = malloc(1024 * 1024);
+    uint8_t *got = malloc(sz);
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    CHECK(deflateInit2(&zs, 9, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+    size_t clen = deflate_msg(&zs, p, sz, c, 1024 * 1024);
+    deflateEnd(&zs);
+
+    // default limit
+    mssn_t *srv = mssn_create(1);
+    mssn_setopt(srv, MSSN_OPT_WS_INFLATE, 1);
+    mssn_setopt(srv, MSSN_OPT_WS_STREAM, stream);
+    tu_feed(srv, tu_upgrade_req, strlen(tu_upgrade_req));
+    CHECK(feed_msg(srv, c, clen, got, sz) == -1);
+    CHECK(strcmp(srv->error_msg, "message too big") == 0);
+    mssn_close(srv);
+
+    // small limit, exact size still accepted
+    CHECK(mssn_setopt(NULL, MSSN_OPT_WS_INFLATE_MAX, 1) == -1);
+    for (int round = 0; round < 2; round++)
+    {
+        const size_t msz = 100000;
+        memset(&zs, 0, sizeof(zs));
+        CHECK(deflateInit2(&zs, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+        clen = deflate_msg(&zs, p, msz, c, 1024 * 1024);
+        deflateEnd(&zs);
+        srv = mssn_create(1);
+        mssn_setopt(srv, MSSN_OPT_WS_INFLATE, 1);
+        mssn_setopt(srv, MSSN_OPT_WS_STREAM, stream);
+        CHECK(mssn_setopt(srv, MSSN_OPT_WS_INFLATE_MAX, -1) == -1);
+        CHECK(mssn_setopt(srv, MSSN_OPT_WS_INFLATE_MAX, (int)msz - round) == 0);
+        tu_feed(srv, tu_upgrade_req, strlen(tu_upgrade_req));
+        CHECK(feed_msg(srv, c, clen, got, sz) == (round ? -1 : (long)msz));
+        mssn_close(srv);
+    }
+
+    // unlimited
+    srv = mssn_create(1);
+    mssn_setopt(srv, MSSN_OPT_WS_INFLATE, 1);
+    mssn_setopt(srv, MSSN_OPT_WS_STREAM, stream);
+    mssn_setopt(srv, MSSN_OPT_WS_INFLATE_MAX, 0);
+    tu_feed(srv, tu_upgrade_req, strlen(tu_upgrade_req));
+    memset(&zs, 0, sizeof(zs));
+    CHECK(deflateInit2(&zs, 9, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+    clen = deflate_msg(&zs, p, sz, c, 1024 * 1024);
+    deflateEnd(&zs);
+    CHECK(feed_msg(srv, c, clen, got, sz) == (long)sz);
+    mssn_close(srv);
+
+    free(p);
+    free(c);
+    free(got);
+}
+
+int main(void)
+{
+    run_roundtrip(0);
+    run_roundtrip(1);
+    run_bomb(0);
+    run_bomb(1);
+    TEST_OK();
+    return 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * simd_mask against scalar reference for every kernel, alignments, lengths and key offsets
+ */
+
+#include "m_simd.h"
+#include "test_util.h"
+
+/// scalar reference
+static void
+ref_mask(uint8_t *dst, const uint8_t *src, size_t len, const uint8_t key[4], uint64_t offset)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        dst[i] = src[i] ^ key[(offset + i) & 3];
+    }
+}
+
+static void
+check_kernel(const char *name)
+{
+    if (simd_select(name) != 0)
+    {
+        // not supported by CPU
+        return;
+    }
+    CHECK(strcmp(simd_name(), name) == 0);
+    static uint8_t src[400];
+    static uint8_t dst[400];
+    static uint8_t want[400];
+    const uint8_t key[4] = {0x12, 0xA5, 0x7E, 0xC3};
+    tu_fill(src, sizeof(src), 13, 256);
+    for (size_t len = 0; len <= 300; len++)
+    {
+        for (uint64_t off = 0; off <= 8; off++)
+        {
+            for (size_t sa = 0; sa < 8; sa += (len > 64) ? 7 : 1)
+            {
+                ref_mask(want, src + sa, len, key, off);
+                // out of place with both alignments, guard bytes untouched
+                for (size_t da = 0; da < 8; da += 3)
+                {
+                    memset(dst, 0xEE, sizeof(dst));
+                    simd_mask(dst + da, src + sa, len, key, off);
+                    CHECK(memcmp(dst + da, want, len) == 0);
+                    CHECK((dst[da + len] == 0xEE) && ((da == 0) || (dst[da - 1] == 0xEE)));
+                }
+                // in place
+                memcpy(dst + sa, src + sa, len);
+                simd_mask(dst + sa, dst + sa, len, key, off);
+                CHECK(memcmp(dst + sa, want, len) == 0);
+            }
+        }
+    }
+    // key offset beyond 32 bits
+    ref_mask(want, src, 100, key, 0x100000003ull);
+    simd_mask(dst, src, 100, key, 0x100000003ull);
+    CHECK(memcmp(dst, want, 100) == 0);
+}
+
+int main(void)
+{
+    CHECK(simd_select("neon") == -1);
+    check_kernel("scalar");
+    check_kernel("sse2");
+    check_kernel("avx2");
+    CHECK(simd_select(NULL) == 0);
+    TEST_OK();
+    return 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * permessage-deflate offers and responses, policy options and end to end traffic
+ */
+
+#include "test_util.h"
+
+/// server response for offer under policy, NULL want for refused
+static void
+check_offer(const char *offer, const char *want, int bits, int no_takeover)
+{
+    mssn_t *srv = mssn_create(1);
+    if (bits)
+    {
+        CHECK(mssn_setopt(srv, MSSN_OPT_WS_WINDOW_BITS, bits) == 0);
+    }
+    if (no_takeover)
+    {
+        CHECK(mssn_setopt(srv, MSSN_OPT_WS_NO_CONTEXT_TAKEOVER, 1) == 0);
+    }
+    const char *resp = mssn_ws_negotiate(srv, offer, (int)strlen(offer));
+    if (want == NULL)
+    {
+        CHECK(resp == NULL);
+    }
+    else
+    {
+        CHECK((resp != NULL) && (strcmp(resp, want) == 0));
+    }
+    mssn_close(srv);
+}
+
+static void
+test_server_matrix(void)
+{
+    check_offer("permessage-deflate", "permessage-deflate", 0, 0);
+    check_offer("permessage-deflate; client_max_window_bits", "permessage-deflate", 0, 0);
+    check_offer("permessage-deflate; client_max_window_bits",
+                "permessage-deflate; client_max_window_bits=10", 10, 0);
+    check_offer("permessage-deflate; client_max_window_bits=12; server_max_window_bits=\"11\"",
+                "permessage-deflate; server_max_window_bits=10; client_max_window_bits=10", 10, 0);
+    check_offer("permessage-deflate; server_max_window_bits=8, permessage-deflate",
+                "permessage-deflate; server_no_context_takeover; client_no_context_takeover", 0, 1);
+    check_offer("x-webkit-deflate-frame, permessage-deflate; server_no_context_takeover",
+                "permessage-deflate; server_no_context_takeover", 0, 0);
+    check_offer("PerMessage-Deflate ;client_no_context_takeover ",
+                "permessage-deflate; client_no_context_takeover", 0, 0);
+    // refused offers
+    check_offer("permessage-deflate; server_max_window_bits", NULL, 0, 0);
+    check_offer("permessage-deflate; foo=1", NULL, 0, 0);
+    check_offer("permessage-deflate; client_no_context_takeover; client_no_context_takeover", NULL, 0, 0);
+    check_offer("permessage-deflate; client_max_window_bits=16", NULL, 0, 0);
+    check_offer("x-webkit-deflate-frame", NULL, 0, 0);
+}
+
+static void
+test_client_response(void)
+{
+    mssn_t *cli = tu_ws_client();
+    CHECK(mssn_ws_negotiate(cli, "permessage-deflate, permessage-deflate", 38) == NULL);
+    CHECK(cli->error_msg != NULL);
+    CHECK(mssn_ws_negotiate(cli, "permessage-deflate; client_max_window_bits=8", 44) == NULL);
+    CHECK(mssn_ws_negotiate(cli, "permessage-deflate; server_max_window_bits=10", 45) != NULL);
+    CHECK(mssn_setopt(cli, MSSN_OPT_WS_WINDOW_BITS, 8) == -1);
+    CHECK(mssn_setopt(cli, MSSN_OPT_WS_MEM_LEVEL, 10) == -1);
+    mssn_close(cli);
+}
+
+/// traffic both ways after negotiating offer under small window policy
+static void
+run_traffic(const char *offer)
+{
+    tu_alloc_t ta = {0};
+    mssn_allocator_t za = tu_allocator(&ta);
+    mssn_t *srv = mssn_create_ex(1, &za);
+    mssn_t *cli = mssn_create_ex(0, &za);
+    mssn_setopt(srv, MSSN_OPT_WS_WINDOW_BITS, 9);
+    mssn_setopt(srv, MSSN_OPT_WS_MEM_LEVEL, 2);
+    tu_feed(srv, tu_upgrade_req, strlen(tu_upgrade_req));
+    tu_feed(cli, tu_upgrade_resp, strlen(tu_upgrade_resp));
+    const char *resp = mssn_ws_negotiate(srv, offer, (int)strlen(offer));
+    CHECK(resp != NULL);
+    CHECK(mssn_ws_negotiate(cli, resp, (int)strlen(resp)) != NULL);
+
+    for (int dir = 0; dir < 2; dir++)
+    {
+        for (int m = 0; m < 20; m++)
+        {
+            mssn_t *tx = dir ? srv : cli;
+            mssn_t *rx = dir ? cli : srv;
+            const size_t sz = 100 + m * 3000;
+            uint8_t *p = malloc(sz);
+            uint8_t *got = malloc(sz);
+            for (size_t i = 0; i < sz; i++)
+            {
+                p[i] = "abcdefgh"[(i * 7 + m) % 8] ^ (i % 50 == 0);
+            }
+            mssn_data_t *dt = mssn_build(tx, WS_FRAME_BINARY, MSSN_BUILD_DEFLATE, 1000, p, sz);
+            CHECK(dt != NULL);
+            for (mssn_data_t *d = dt; d != NULL; d = d->next)
+            {
+                tu_feed(rx, d->data, d->length);
+            }
+            size_t total = 0;
+            for (mssn_frame_t *fr = rx->frames; fr != NULL; fr = fr->next)
+            {
+                total += tu_payload(fr, got + total);
+            }
+            CHECK((total == sz) && (memcmp(got, p, sz) == 0));
+            mssn_reclaim(rx, NULL);
+            mssn_reclaim(tx, dt);
+            free(p);
+            free(got);
+        }
+    }
+    mssn_close(srv);
+    mssn_close(cli);
+    CHECK(ta.live == 0);
+}
+
+int main(void)
+{
+    test_server_matrix();
+    test_client_response();
+    run_traffic("permessage-deflate; client_max_window_bits");
+    run_traffic("permessage-deflate; server_no_context_takeover; client_no_context_takeover");
+    run_traffic("permessage-deflate; client_max_window_bits=9; server_max_window_bits=9");
+    TEST_OK();
+    return 0;
+}
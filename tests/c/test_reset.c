@@ -0,0 +1,99 @@
+/*
+ * session pool and reset, negotiated state never leaks into next connection
+ */
+
+#include "test_util.h"
+
+static void
+test_pool_reuse(void)
+{
+    const char *get = "GET /a HTTP/1.1\r\nHost: b\r\n\r\n";
+    mssn_pool_t *pool = mssn_pool_create(1, 4, NULL);
+    CHECK(pool != NULL);
+    for (int i = 0; i < 100; i++)
+    {
+        mssn_t *ctx = mssn_pool_get(pool);
+        mssn_t *extra = (i % 3 == 0) ? mssn_pool_get(pool) : NULL;
+        CHECK((ctx->headers == NULL) && (ctx->path == NULL) && (ctx->frames == NULL));
+        CHECK((ctx->upgrade == 0) && (ctx->state == 0) && (ctx->error_msg == NULL));
+        if (i % 2)
+        {
+            tu_feed(ctx, tu_upgrade_req, strlen(tu_upgrade_req));
+            CHECK(ctx->upgrade == 1);
+            uint8_t fr[16];
+            int n = tu_frame(fr, 1, 0, 0x1, 1, "hi", 2);
+            tu_feed(ctx, fr, n);
+            CHECK((ctx->frames != NULL) && (ctx->frames->ftype == WS_FRAME_TEXT));
+        }
+        else
+        {
+            tu_feed(ctx, get, strlen(get));
+            CHECK(strcmp(ctx->path, "/a") == 0);
+        }
+        mssn_pool_put(pool, ctx);
+        if (extra != NULL)
+        {
+            mssn_pool_put(pool, extra);
+        }
+    }
+    mssn_pool_destroy(pool);
+}
+
+static void
+test_deflate_then_plain(void)
+{
+    static uint8_t payload[3000];
+    uint8_t out[4096];
+    tu_fill(payload, sizeof(payload), 3, 4);
+
+    mssn_t *srv = mssn_create(1);
+    mssn_t *cli = tu_ws_client();
+    tu_feed(srv, tu_upgrade_req, strlen(tu_upgrade_req));
+    const char *offer = "permessage-deflate; server_no_context_takeover";
+    const char *resp = mssn_ws_negotiate(srv, offer, (int)strlen(offer));
+    CHECK(resp != NULL);
+    CHECK(mssn_ws_negotiate(cli, resp, (int)strlen(resp)) != NULL);
+
+    mssn_data_t *dt = mssn_build(cli, WS_FRAME_BINARY, MSSN_BUILD_DEFLATE, 4096, payload, sizeof(payload));
+    CHECK((dt != NULL) && (dt->data[0] & 0x40));
+    for (mssn_data_t *d = dt; d != NULL; d = d->next)
+    {
+        tu_feed(srv, d->data, d->length);
+    }
+    CHECK(tu_payload(srv->frames, out) == sizeof(payload));
+    CHECK(memcmp(out, payload, sizeof(payload)) == 0);
+    mssn_reclaim(cli, dt);
+
+    mssn_bcast_t *b = mssn_bcast_create(WS_FRAME_TEXT, MSSN_BUILD_DEFLATE, 4096, payload, sizeof(payload), 15, NULL);
+    size_t len = 0;
+    CHECK((mssn_bcast_frames(srv, b, &len)[0] & 0x40) != 0);
+
+    // next connection negotiates nothing, rsv1 frame was not inflated
+    mssn_reset(srv);
+    tu_feed(srv, tu_upgrade_req, strlen(tu_upgrade_req));
+    uint8_t fr[16];
+    int n = tu_frame(fr, 1, 0x4, 0x2, 1, "plain", 5);
+    tu_feed(srv, fr, n);
+    CHECK(tu_payload(srv->frames, out) == 5);
+    CHECK(memcmp(out, "plain", 5) == 0);
+    CHECK((mssn_bcast_frames(srv, b, &len)[0] & 0x40) == 0);
+
+    // explicit option survives reset
+    mssn_reset(srv);
+    mssn_setopt(srv, MSSN_OPT_WS_INFLATE, 1);
+    mssn_reset(srv);
+    tu_feed(srv, tu_upgrade_req, strlen(tu_upgrade_req));
+    CHECK(mssn_process(srv, fr, n) == -1);
+
+    mssn_bcast_unref(b);
+    mssn_close(srv);
+    mssn_close(cli);
+}
+
+int main(void)
+{
+    test_pool_reuse();
+    test_deflate_then_plain();
+    TEST_OK();
+    return 0;
+}
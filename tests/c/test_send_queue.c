@@ -0,0 +1,131 @@
+/*
+ * outbound queue keeps byte order across responses, frames and broadcasts, coalescing small ones
+ */
+
+#include "test_util.h"
+
+static void
+test_order_partial_writes(void)
+{
+    mssn_t *srv = tu_ws_server();
+    const size_t ecap = 1 << 22;
+    uint8_t *want = malloc(ecap);
+    uint8_t *got = malloc(ecap);
+    const size_t rlen = strlen(tu_upgrade_resp);
+    CHECK(mssn_send_queue(srv, (const uint8_t *)tu_upgrade_resp, rlen) == 0);
+    memcpy(want, tu_upgrade_resp, rlen);
+    size_t wlen = rlen;
+
+    uint8_t *p = malloc(200000);
+    tu_fill(p, 200000, 9, 256);
+    mssn_bcast_t *big = mssn_bcast_create(WS_FRAME_BINARY, 0, 65536, p, 100000, 15, NULL);
+    mssn_bcast_t *small = mssn_bcast_create(WS_FRAME_TEXT, 0, 65536, p, 100, 15, NULL);
+    for (int i = 0; i < 300; i++)
+    {
+        const size_t n = (i % 10 == 9) ? (size_t)(5000 + i) : (size_t)(1 + i % 50);
+        mssn_data_t *dt = mssn_build(srv, WS_FRAME_BINARY, 0, 1000, p + i, n);
+        for (mssn_data_t *d = dt; d != NULL; d = d->next)
+        {
+            memcpy(want + wlen, d->data, d->length);
+            wlen += d->length;
+        }
+        CHECK(mssn_send_data(srv, dt) == 0);
+        if (i % 50 == 0)
+        {
+            mssn_bcast_t *bs[2] = {big, small};
+            for (int k = 0; k < 2; k++)
+            {
+                size_t len;
+                const uint8_t *fr = mssn_bcast_frames(srv, bs[k], &len);
+                memcpy(want + wlen, fr, len);
+                wlen += len;
+                CHECK(mssn_send_bcast(srv, bs[k]) == 0);
+            }
+        }
+    }
+    CHECK(mssn_send_pending(srv) == wlen);
+    mssn_bcast_unref(big);
+    mssn_bcast_unref(small);
+
+    // drain with partial writes ending anywhere inside entries
+    size_t glen = 0;
+    mssn_iovec_t iov[16];
+    for (int round = 0; mssn_send_pending(srv) > 0; round++)
+    {
+        const int cnt = mssn_send_iov(srv, iov, 16);
+        CHECK((cnt > 0) && (cnt <= 16));
+        size_t budget = 777 + round * 131;
+        size_t written = 0;
+        for (int k = 0; (k < cnt) && (budget > 0); k++)
+        {
+            const size_t n = (iov[k].iov_len < budget) ? iov[k].iov_len : budget;
+            memcpy(got + glen, iov[k].iov_base, n);
+            glen += n;
+            written += n;
+            budget -= n;
+        }
+        mssn_send_consume(srv, written);
+    }
+    CHECK((glen == wlen) && (memcmp(got, want, wlen) == 0));
+    CHECK(mssn_send_iov(srv, iov, 16) == 0);
+
+    mssn_close(srv);
+    free(p);
+    free(want);
+    free(got);
+}
+
+static void
+test_coalesce_and_reset(void)
+{
+    mssn_t *srv = tu_ws_server();
+    uint8_t p[5000];
+    tu_fill(p, sizeof(p), 10, 26);
+    mssn_iovec_t iov[16];
+    CHECK(mssn_send_queue(NULL, p, 1) == -1);
+    CHECK(mssn_send_queue(srv, NULL, 1) == -1);
+
+    // small frames share one page
+    for (int i = 0; i < 100; i++)
+    {
+        CHECK(mssn_send_data(srv, mssn_build(srv, WS_FRAME_TEXT, 0, 1000, p, 20)) == 0);
+    }
+    CHECK(mssn_send_iov(srv, iov, 16) == 1);
+    CHECK(iov[0].iov_len == 100 * 22);
+    mssn_send_consume(srv, 1000000);
+    CHECK(mssn_send_pending(srv) == 0);
+
+    // reclaim keeps queue, peer parses queued frame
+    CHECK(mssn_send_queue(srv, p, 10) == 0);
+    mssn_reclaim(srv, NULL);
+    CHECK(mssn_send_pending(srv) == 10);
+    mssn_send_consume(srv, 10);
+    CHECK(mssn_send_data(srv, mssn_build(srv, WS_FRAME_TEXT, 0, 100, (const uint8_t *)"hello", 5)) == 0);
+    mssn_t *cli = tu_ws_client();
+    CHECK(mssn_send_iov(srv, iov, 16) == 1);
+    tu_feed(cli, iov[0].iov_base, iov[0].iov_len);
+    uint8_t out[8];
+    CHECK((cli->frames != NULL) && (tu_payload(cli->frames, out) == 5) && (memcmp(out, "hello", 5) == 0));
+
+    // reset drops queue and broadcast references
+    mssn_bcast_t *b = mssn_bcast_create(WS_FRAME_BINARY, 0, 65536, p, sizeof(p), 15, NULL);
+    CHECK(mssn_send_bcast(srv, b) == 0);
+    mssn_bcast_stats_t st;
+    mssn_bcast_stats(b, &st);
+    CHECK(st.refs == 2);
+    mssn_reset(srv);
+    CHECK(mssn_send_pending(srv) == 0);
+    mssn_bcast_stats(b, &st);
+    CHECK(st.refs == 1);
+    mssn_bcast_unref(b);
+    mssn_close(srv);
+    mssn_close(cli);
+}
+
+int main(void)
+{
+    test_order_partial_writes();
+    test_coalesce_and_reset();
+    TEST_OK();
+    return 0;
+}
@@ -0,0 +1,128 @@
+/*
+ * simd_url_run against scalar scan, long urls split anywhere, invalid chars rejected
+ */
+
+#include "m_simd.h"
+#include "test_util.h"
+
+/// scalar reference
+static size_t
+ref_url_run(const uint8_t *buf, size_t len, int strict)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        const uint8_t c = buf[i];
+        if ((c == '\t') || (c == '\f'))
+        {
+            if (strict)
+            {
+                return i;
+            }
+        }
+        else if ((c <= ' ') || (c == '#') || (c == '?') || (c == 0x7F) || (strict && (c > 0x7F)))
+        {
+            return i;
+        }
+    }
+    return len;
+}
+
+static void
+test_kernel(void)
+{
+    uint8_t buf[300];
+    unsigned seed = 5;
+    for (int it = 0; it < 200000; it++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        const size_t n = (seed >> 16) % 300;
+        for (size_t i = 0; i < n; i++)
+        {
+            seed = seed * 1103515245u + 12345u;
+            const unsigned r = (seed >> 16) % 200;
+            buf[i] = (r < 190) ? (uint8_t) "abcXYZ019-._~%!$&'()*+,;=:@/"[r % 28] : (uint8_t)(seed >> 24);
+        }
+        const size_t off = (n < 8) ? n : (size_t)(it % 8);
+        for (int strict = 0; strict < 2; strict++)
+        {
+            CHECK(simd_url_run(buf + off, n - off, strict) == ref_url_run(buf + off, n - off, strict));
+        }
+    }
+    for (int c = 0; c < 256; c++)
+    {
+        for (size_t pos = 0; pos < 70; pos++)
+        {
+            memset(buf, 'a', 80);
+            buf[pos] = (uint8_t)c;
+            CHECK(simd_url_run(buf, 80, 0) == ref_url_run(buf, 80, 0));
+            CHECK(simd_url_run(buf, 80, 1) == ref_url_run(buf, 80, 1));
+        }
+    }
+}
+
+static void
+test_parse(void)
+{
+    char url[5000];
+    int ulen = sprintf(url, "/api/v1/objects/");
+    for (int i = 0; i < 1500; i++)
+    {
+        url[ulen++] = "abcXYZ019-._~%!$&'()*+,;=:@/"[i % 28];
+    }
+    url[ulen++] = '?';
+    for (int i = 0; i < 2000; i++)
+    {
+        url[ulen++] = "sig=AbCdEf0123&x-amz=%2F?/"[i % 26];
+    }
+    ulen += sprintf(url + ulen, "#frag?#x");
+    char req[8000];
+    const int rlen = snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: a\r\n\r\n", url);
+    for (int split = 1; split < rlen; split += 13)
+    {
+        mssn_t *srv = mssn_create(1);
+        CHECK(mssn_process(srv, (const uint8_t *)req, split) == split);
+        CHECK(mssn_process(srv, (const uint8_t *)req + split, rlen - split) == rlen - split);
+        CHECK(srv->state >= MSSN_STATE_HEADER);
+        CHECK((srv->path != NULL) && (strcmp(srv->path, url) == 0));
+        mssn_close(srv);
+    }
+
+    // zero copy span covers whole url
+    mssn_t *srv = mssn_create(1);
+    mssn_setopt(srv, MSSN_OPT_ZERO_COPY, 1);
+    tu_feed(srv, req, rlen);
+    CHECK((srv->path_span.offset == 4) && (srv->path_span.length == ulen));
+    mssn_close(srv);
+
+    const char *bad[] = {"GET /a\x7f"
+                         "b HTTP/1.1\r\n\r\n",
+                         "GET /aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\x01 HTTP/1.1\r\n\r\n",
+                         "GET /aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa?bbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbb\x80 HTTP/1.1\r\n\r\n",
+                         "GET /a\tb HTTP/1.1\r\n\r\n"};
+    for (int i = 0; i < 4; i++)
+    {
+        srv = mssn_create(1);
+        CHECK(mssn_process(srv, (const uint8_t *)bad[i], (int)strlen(bad[i])) == -1);
+        mssn_close(srv);
+    }
+
+    // header size limit still counts url bytes
+    const int big = 90000;
+    char *bu = malloc(big + 64);
+    int blen = sprintf(bu, "GET /");
+    memset(bu + blen, 'a', big);
+    blen += big;
+    blen += sprintf(bu + blen, " HTTP/1.1\r\n\r\n");
+    srv = mssn_create(1);
+    CHECK(mssn_process(srv, (const uint8_t *)bu, blen) == -1);
+    mssn_close(srv);
+    free(bu);
+}
+
+int main(void)
+{
+    test_kernel();
+    test_parse();
+    TEST_OK();
+    return 0;
+}
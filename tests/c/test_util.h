@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2024 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef _TEST_UTIL_H_
+#define _TEST_UTIL_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "http1_session.h"
+
+#define CHECK(cond)                                                                  \
+    do                                                                               \
+    {                                                                                \
+        if (!(cond))                                                                 \
+        {                                                                            \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1);                                                                 \
+        }                                                                            \
+    } while (0)
+
+#define TEST_OK() printf("%s ok\n", __FILE__)
+
+static const char *const tu_upgrade_req = "GET /ws HTTP/1.1\r\n"
+                                          "Host: localhost\r\n"
+                                          "Connection: Upgrade\r\n"
+                                          "Upgrade: websocket\r\n"
+                                          "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                                          "Sec-WebSocket-Version: 13\r\n"
+                                          "\r\n";
+
+static const char *const tu_upgrade_resp = "HTTP/1.1 101 Switching Protocols\r\n"
+                                           "Connection: Upgrade\r\n"
+                                           "Upgrade: websocket\r\n"
+                                           "\r\n";
+
+/// counting allocator, allocation over cap bytes live fails
+typedef struct
+{
+    size_t live;
+    size_t peak;
+    size_t cap;
+    size_t fails;
+} tu_alloc_t;
+
+static inline void *
+tu_alloc(void *ud, size_t size)
+{
+    tu_alloc_t *ta = (tu_alloc_t *)ud;
+    if ((ta->cap > 0) && (ta->live + size > ta->cap))
+    {
+        ta->fails++;
+        return NULL;
+    }
+    ta->live += size;
+    ta->peak = (ta->live > ta->peak) ? ta->live : ta->peak;
+    return malloc(size);
+}
+
+static inline void
+tu_free(void *ud, void *ptr, size_t size)
+{
+    ((tu_alloc_t *)ud)->live -= size;
+    free(ptr);
+}
+
+static inline mssn_allocator_t
+tu_allocator(tu_alloc_t *ta)
+{
+    mssn_allocator_t za = {tu_alloc, tu_free, ta};
+    return za;
+}
+
+/// process whole buffer, for handshake
+static inline void
+tu_feed(mssn_t *ctx, const void *buf, size_t len)
+{
+    CHECK(mssn_process(ctx, (const uint8_t *)buf, (int)len) == (int)len);
+}
+
+/// server context after upgrade request
+static inline mssn_t *
+tu_ws_server(void)
+{
+    mssn_t *ctx = mssn_create(1);
+    tu_feed(ctx, tu_upgrade_req, strlen(tu_upgrade_req));
+    CHECK(ctx->upgrade == 1);
+    return ctx;
+}
+
+/// client context after 101 response
+static inline mssn_t *
+tu_ws_client(void)
+{
+    mssn_t *ctx = mssn_create(0);
+    tu_feed(ctx, tu_upgrade_resp, strlen(tu_upgrade_resp));
+    CHECK(ctx->upgrade == 1);
+    return ctx;
+}
+
+/// encode one frame as client (masked) or server, return bytes written
+static inline int
+tu_frame(uint8_t *out, int fin, int rsv, int opcode, int masked, const void *payload, size_t plen)
+{
+    static const uint8_t key[4] = {0x37, 0xfa, 0x21, 0x3d};
+    const uint8_t *p = (const uint8_t *)payload;
+    int n = 0;
+    out[n++] = (uint8_t)((fin ? 0x80 : 0) | (rsv << 4) | opcode);
+    uint8_t mbit = masked ? 0x80 : 0;
+    if (plen < 126)
+    {
+        out[n++] = mbit | (uint8_t)plen;
+    }
+    else if (plen <= 0xFFFF)
+    {
+        out[n++] = mbit | 126;
+        out[n++] = (uint8_t)(plen >> 8);
+        out[n++] = (uint8_t)plen;
+    }
+    else
+    {
+        out[n++] = mbit | 127;
+        for (int i = 7; i >= 0; i--)
+        {
+            out[n++] = (uint8_t)((uint64_t)plen >> (i * 8));
+        }
+    }
+    if (masked)
+    {
+        memcpy(out + n, key, 4);
+        n += 4;
+    }
+    for (size_t i = 0; i < plen; i++)
+    {
+        out[n++] = masked ? (p[i] ^ key[i % 4]) : p[i];
+    }
+    return n;
+}
+
+/// concat payload of frame into out, return length
+static inline size_t
+tu_payload(const mssn_frame_t *fr, uint8_t *out)
+{
+    size_t n = 0;
+    for (const mssn_data_t *dt = fr->data_head; dt != NULL; dt = dt->next)
+    {
+        memcpy(out + n, dt->data, dt->length);
+        n += dt->length;
+    }
+    return n;
+}
+
+/// concat data chain into out, return length
+static inline size_t
+tu_concat(const mssn_data_t *dt, uint8_t *out)
+{
+    size_t n = 0;
+    for (; dt != NULL; dt = dt->next)
+    {
+        memcpy(out + n, dt->data, dt->length);
+        n += dt->length;
+    }
+    return n;
+}
+
+/// pseudo random bytes, compressible with small alphabet
+static inline void
+tu_fill(uint8_t *buf, size_t len, unsigned seed, int alphabet)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        buf[i] = (uint8_t)('a' + (seed >> 16) % (unsigned)alphabet);
+    }
+}
+
+#endif // _TEST_UTIL_H_
@@ -0,0 +1,153 @@
+/*
+ * every complete frame in one process call, protocol errors stop session
+ */
+
+#include "test_util.h"
+
+static const char *want[] = {"msg0",  "msg1",  "msg2",  "msg3",  "msg4",  "msg5",       "msg6", "msg7",
+                             "msg8",  "msg9",  "msg10", "msg11", "msg12", "msg13",      "msg14", "msg15",
+                             "msg16", "msg17", "msg18", "msg19", "",      "fragmented", "tail"};
+
+/// upgrade request, 20 messages, fragmented message with ping between, tail message
+static int
+build_stream(uint8_t *buf)
+{
+    int n = (int)strlen(tu_upgrade_req);
+    memcpy(buf, tu_upgrade_req, n);
+    for (int i = 0; i < 20; i++)
+    {
+        char t[16];
+        sprintf(t, "msg%d", i);
+        n += tu_frame(buf + n, 1, 0, 0x1, 1, t, strlen(t));
+    }
+    n += tu_frame(buf + n, 0, 0, 0x1, 1, "frag", 4);
+    n += tu_frame(buf + n, 1, 0, 0x9, 1, "", 0);
+    n += tu_frame(buf + n, 0, 0, 0x0, 1, "ment", 4);
+    n += tu_frame(buf + n, 1, 0, 0x0, 1, "ed", 2);
+    n += tu_frame(buf + n, 1, 0, 0x1, 1, "tail", 4);
+    return n;
+}
+
+static void
+test_every_step(void)
+{
+    uint8_t buf[4096];
+    const int n = build_stream(buf);
+    for (int step = 1; step <= n; step++)
+    {
+        mssn_t *ctx = mssn_create(1);
+        uint8_t tmp[8192];
+        int off = 0;
+        int pend = 0;
+        int cnt = 0;
+        while (off < n)
+        {
+            int len = (n - off < step) ? (n - off) : step;
+            memcpy(tmp + pend, buf + off, len);
+            off += len;
+            int tot = pend + len;
+            int ret = mssn_process(ctx, tmp, tot);
+            CHECK(ret >= 0);
+            memmove(tmp, tmp + ret, tot - ret);
+            pend = tot - ret;
+            for (mssn_frame_t *fr = ctx->frames; fr != NULL; fr = fr->next, cnt++)
+            {
+                char out[64];
+                out[tu_payload(fr, (uint8_t *)out)] = '\0';
+                CHECK(cnt < 23);
+                CHECK(strcmp(out, want[cnt]) == 0);
+                CHECK(fr->ftype == ((cnt == 20) ? WS_FRAME_PING : WS_FRAME_TEXT));
+            }
+            if (ctx->frames != NULL)
+            {
+                mssn_reclaim(ctx, NULL);
+            }
+        }
+        CHECK((cnt == 23) && (pend == 0));
+        mssn_close(ctx);
+    }
+}
+
+/// feed bad bytes after valid prefix, then more frames after error
+static void
+check_error(const uint8_t *bad, int bad_len, int split)
+{
+    uint8_t good[64];
+    const int good_len = tu_frame(good, 1, 0, 0x1, 1, "ok", 2);
+
+    mssn_t *ctx = tu_ws_server();
+    uint8_t pre[64];
+    int n = tu_frame(pre, 0, 0, 0x1, 1, "part", 4);
+    tu_feed(ctx, pre, n);
+
+    int ret = 0;
+    for (int off = 0; (off < bad_len) && (ret >= 0); off += split)
+    {
+        ret = mssn_process(ctx, bad + off, (bad_len - off < split) ? (bad_len - off) : split);
+    }
+    CHECK(ret == -1);
+    CHECK(ctx->error_msg != NULL);
+    CHECK(ctx->state == MSSN_STATE_ERROR);
+    const char *msg = ctx->error_msg;
+
+    // refused without touching frame state
+    for (int i = 0; i < 3; i++)
+    {
+        CHECK(mssn_process(ctx, good, good_len) == -1);
+        CHECK(ctx->error_msg == msg);
+        CHECK(mssn_process(ctx, good, 1) == -1);
+        mssn_reclaim(ctx, NULL);
+        CHECK(ctx->state == MSSN_STATE_ERROR);
+    }
+
+    // reset for next connection
+    mssn_reset(ctx);
+    CHECK(ctx->state == MSSN_STATE_INIT);
+    tu_feed(ctx, tu_upgrade_req, strlen(tu_upgrade_req));
+    tu_feed(ctx, good, good_len);
+    CHECK((ctx->frames != NULL) && (ctx->frames->ftype == WS_FRAME_TEXT));
+    mssn_close(ctx);
+}
+
+static void
+test_error_state(void)
+{
+    uint8_t bad[256];
+    char big[200];
+    memset(big, 'x', sizeof(big));
+    for (int split = 1; split <= 8; split++)
+    {
+        // reserved opcode
+        check_error(bad, tu_frame(bad, 1, 0, 0x3, 1, "abc", 3), split);
+        // new message before fin of fragmented one
+        check_error(bad, tu_frame(bad, 1, 0, 0x2, 1, "abc", 3), split);
+        // control frame too long
+        check_error(bad, tu_frame(bad, 1, 0, 0x9, 1, big, sizeof(big)), split);
+        // unmasked frame to server
+        check_error(bad, tu_frame(bad, 1, 0, 0x0, 0, "abc", 3), split);
+    }
+
+    // continuation without message
+    mssn_t *ctx = tu_ws_server();
+    int n = tu_frame(bad, 1, 0, 0x0, 1, "abc", 3);
+    CHECK(mssn_process(ctx, bad, n) == -1);
+    CHECK(mssn_process(ctx, bad, n) == -1);
+    mssn_close(ctx);
+
+    // HTTP error is sticky too
+    ctx = mssn_create(1);
+    const char *garbage = "GET / HTTP/1.1\r\nHost\x01: x\r\n\r\n";
+    CHECK(mssn_process(ctx, (const uint8_t *)garbage, (int)strlen(garbage)) == -1);
+    CHECK(ctx->state == MSSN_STATE_ERROR);
+    mssn_reclaim(ctx, NULL);
+    CHECK(mssn_process(ctx, (const uint8_t *)tu_upgrade_req, (int)strlen(tu_upgrade_req)) == -1);
+    mssn_close(ctx);
+}
+
+int main(void)
+{
+    test_every_step();
+    test_error_state();
+    TEST_OK();
+    return 0;
+}
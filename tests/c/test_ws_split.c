@@ -0,0 +1,98 @@
+/*
+ * frame header split at every byte offset, never rebuffered by caller
+ */
+
+#include "test_util.h"
+
+/// feed wire split at cut, then at cut2, check single message
+static void
+check_split(int server, const uint8_t *wire, int wire_len, int cut, int cut2, const uint8_t *payload, size_t plen)
+{
+    static uint8_t out[70000];
+    mssn_t *ctx = server ? tu_ws_server() : tu_ws_client();
+    const int cuts[3] = {cut, cut2, wire_len};
+    int off = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        if (cuts[i] > off)
+        {
+            CHECK(mssn_process(ctx, wire + off, cuts[i] - off) == cuts[i] - off);
+            CHECK((ctx->frames == NULL) || (cuts[i] == wire_len));
+            off = cuts[i];
+        }
+    }
+    CHECK((ctx->frames != NULL) && (ctx->frames->next == NULL));
+    CHECK(ctx->frames->ftype == WS_FRAME_BINARY);
+    CHECK(tu_payload(ctx->frames, out) == plen);
+    CHECK(memcmp(out, payload, plen) == 0);
+    mssn_close(ctx);
+}
+
+static void
+test_every_offset(void)
+{
+    static uint8_t payload[70000];
+    static uint8_t wire[70100];
+    tu_fill(payload, sizeof(payload), 1, 26);
+    const size_t lens[4] = {0, 100, 300, 70000}; // 7 bits, 16 bits, 64 bits length
+    for (int server = 0; server <= 1; server++)
+    {
+        for (int li = 0; li < 4; li++)
+        {
+            int n = tu_frame(wire, 1, 0, 0x2, server, payload, lens[li]);
+            const int hlen = n - (int)lens[li];
+            // header cut anywhere, alone and with a second cut inside header or payload
+            for (int cut = 1; cut <= hlen; cut++)
+            {
+                check_split(server, wire, n, cut, cut, payload, lens[li]);
+                for (int cut2 = cut + 1; cut2 <= hlen + 2 && cut2 < n; cut2++)
+                {
+                    check_split(server, wire, n, cut, cut2, payload, lens[li]);
+                }
+            }
+        }
+    }
+}
+
+static void
+test_byte_by_byte(void)
+{
+    uint8_t payload[300];
+    uint8_t wire[1024];
+    tu_fill(payload, sizeof(payload), 2, 26);
+    int n = tu_frame(wire, 0, 0, 0x2, 1, payload, 200);
+    n += tu_frame(wire + n, 1, 0, 0x9, 1, "ping", 4);
+    n += tu_frame(wire + n, 1, 0, 0x0, 1, payload + 200, 100);
+
+    mssn_t *ctx = tu_ws_server();
+    int pings = 0;
+    uint8_t out[300];
+    size_t got = 0;
+    for (int i = 0; i < n; i++)
+    {
+        CHECK(mssn_process(ctx, wire + i, 1) == 1);
+        for (mssn_frame_t *fr = ctx->frames; fr != NULL; fr = fr->next)
+        {
+            if (fr->ftype == WS_FRAME_PING)
+            {
+                pings++;
+            }
+            else
+            {
+                got = tu_payload(fr, out);
+            }
+        }
+        mssn_reclaim(ctx, NULL);
+    }
+    CHECK(pings == 1);
+    CHECK((got == sizeof(payload)) && (memcmp(out, payload, got) == 0));
+    mssn_close(ctx);
+}
+
+int main(void)
+{
+    test_every_offset();
+    test_byte_by_byte();
+    TEST_OK();
+    return 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * partial message delivered with MSSN_OPT_WS_STREAM, offsets cover whole payload
+ */
+
+#include "test_util.h"
+
+/// feed wire in pieces, copy streamed parts at offsets, return fin count
+static int
+feed_stream(mssn_t *srv, const uint8_t *wire, int wire_len, uint8_t *got, size_t got_cap, int *parts, int *pings)
+{
+    int fin = 0;
+    unsigned seed = 11;
+    for (int off = 0; off < wire_len;)
+    {
+        seed = seed * 1103515245u + 12345u;
+        int n = 1000 + (int)((seed >> 16) % 9000);
+        n = (n > wire_len - off) ? (wire_len - off) : n;
+        CHECK(mssn_process(srv, wire + off, n) == n);
+        off += n;
+        for (mssn_frame_t *fr = srv->frames; fr != NULL; fr = fr->next)
+        {
+            if (fr->ftype == WS_FRAME_PING)
+            {
+                *pings += 1;
+                continue;
+            }
+            CHECK(fr->ftype == WS_FRAME_BINARY);
+            uint64_t o = fr->offset;
+            for (mssn_data_t *dt = fr->data_head; dt != NULL; dt = dt->next)
+            {
+                CHECK(o + dt->length <= got_cap);
+                memcpy(got + o, dt->data, dt->length);
+                o += dt->length;
+            }
+            fin += fr->fin;
+            *parts += 1;
+        }
+        mssn_reclaim(srv, NULL);
+    }
+    return fin;
+}
+
+static void
+test_single_frame(void)
+{
+    const size_t sz = 300000;
+    uint8_t *payload = malloc(sz);
+    uint8_t *got = calloc(1, sz);
+    tu_fill(payload, sz, 5, 26);
+
+    mssn_t *cli = tu_ws_client();
+    mssn_t *srv = mssn_create(1);
+    mssn_setopt(srv, MSSN_OPT_WS_STREAM, 1);
+    tu_feed(srv, tu_upgrade_req, strlen(tu_upgrade_req));
+
+    mssn_data_t *dt = mssn_build(cli, WS_FRAME_BINARY, 0, sz + 16, payload, sz);
+    CHECK((dt != NULL) && (dt->next == NULL));
+    int parts = 0;
+    int pings = 0;
+    CHECK(feed_stream(srv, dt->data, dt->length, got, sz, &parts, &pings) == 1);
+    CHECK(parts >= 10);
+    CHECK(memcmp(payload, got, sz) == 0);
+
+    mssn_reclaim(cli, dt);
+    mssn_close(cli);
+    mssn_close(srv);
+    free(payload);
+    free(got);
+}
+
+static void
+test_fragments_with_ping(void)
+{
+    const size_t sz = 100000;
+    uint8_t *payload = malloc(sz);
+    uint8_t *got = calloc(1, sz);
+    uint8_t *wire = malloc(sz + 1024);
+    tu_fill(payload, sz, 9, 26);
+
+    // 4 fragments, ping after each of first three
+    int n = 0;
+    const size_t flen = sz / 4;
+    for (int i = 0; i < 4; i++)
+    {
+        n += tu_frame(wire + n, i == 3, 0, (i == 0) ? 0x2 : 0x0, 1, payload + i * flen, flen);
+        if (i < 3)
+        {
+            n += tu_frame(wire + n, 1, 0, 0x9, 1, "p", 1);
+        }
+    }
+
+    mssn_t *srv = mssn_create(1);
+    mssn_setopt(srv, MSSN_OPT_WS_STREAM, 1);
+    tu_feed(srv, tu_upgrade_req, strlen(tu_upgrade_req));
+    int parts = 0;
+    int pings = 0;
+    CHECK(feed_stream(srv, wire, n, got, sz, &parts, &pings) == 1);
+    CHECK(pings == 3);
+    CHECK(memcmp(payload, got, sz) == 0);
+
+    // next message starts at offset 0
+    uint8_t fr[32];
+    n = tu_frame(fr, 1, 0, 0x2, 1, "next", 4);
+    tu_feed(srv, fr, n);
+    CHECK((srv->frames != NULL) && (srv->frames->offset == 0) && srv->frames->fin);
+
+    mssn_close(srv);
+    free(payload);
+    free(got);
+    free(wire);
+}
+
+int main(void)
+{
+    test_single_frame();
+    test_fragments_with_ping();
+    TEST_OK();
+    return 0;
+}
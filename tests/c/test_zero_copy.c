@@ -0,0 +1,81 @@
+/*
+ * MSSN_OPT_ZERO_COPY spans into input buffer, tokens split across calls copied
+ */
+
+#include "test_util.h"
+
+static const char *req = "GET /some/long/path?query=1 HTTP/1.1\r\n"
+                         "Host: example.com\r\n"
+                         "X-Empty:\r\n"
+                         "sec-websocket-version: 13\r\n"
+                         "Connection: Upgrade\r\n"
+                         "Upgrade: websocket\r\n\r\n";
+
+static void
+check_tokens(mssn_t *ctx, const char *buf, int zc)
+{
+    static const char *names[] = {"Host", "X-Empty", "sec-websocket-version", "Connection", "Upgrade"};
+    static const char *values[] = {"example.com", "", "13", "Upgrade", "websocket"};
+
+    CHECK(ctx->path_span.length == 23);
+    CHECK(memcmp(ctx->path, "/some/long/path?query=1", 23) == 0);
+    if (zc && (ctx->path_span.offset >= 0))
+    {
+        CHECK(ctx->path == buf + ctx->path_span.offset);
+    }
+
+    int i = 0;
+    for (mssn_header_t *h = ctx->headers; h != NULL; h = h->next, i++)
+    {
+        CHECK(h->key_span.length == (int)strlen(names[i]));
+        CHECK(memcmp(h->key, names[i], h->key_span.length) == 0);
+        CHECK(h->value_span.length == (int)strlen(values[i]));
+        CHECK(memcmp(h->value, values[i], h->value_span.length) == 0);
+        if (zc && (h->key_span.offset >= 0))
+        {
+            CHECK(h->key == buf + h->key_span.offset);
+        }
+        if (!zc)
+        {
+            CHECK((h->key_span.offset == -1) && (h->key[h->key_span.length] == '\0'));
+        }
+    }
+    CHECK(i == 5);
+    CHECK(ctx->upgrade == 1);
+}
+
+int main(void)
+{
+    int n = (int)strlen(req);
+    for (int zc = 0; zc < 2; zc++)
+    {
+        for (int split = 0; split < n; split++)
+        {
+            mssn_t *ctx = mssn_create(1);
+            CHECK(mssn_setopt(ctx, MSSN_OPT_ZERO_COPY, zc) == 0);
+            char *b1 = strndup(req, split);
+            char *b2 = strdup(req + split);
+            if (split > 0)
+            {
+                tu_feed(ctx, b1, split);
+            }
+            memset(b1, 'Z', split); // first buffer gone
+            tu_feed(ctx, b2, n - split);
+            if (zc && (split == 0))
+            {
+                // single buffer, nothing copied
+                CHECK(ctx->path_span.offset == 4);
+                for (mssn_header_t *h = ctx->headers; h != NULL; h = h->next)
+                {
+                    CHECK((h->key_span.offset >= 0) && (h->value_span.offset >= 0));
+                }
+            }
+            check_tokens(ctx, b2, zc);
+            mssn_close(ctx);
+            free(b1);
+            free(b2);
+        }
+    }
+    TEST_OK();
+    return 0;
+}
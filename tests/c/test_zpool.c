@@ -0,0 +1,178 @@
+/*
+ * zlib stream pool shared by contexts without context takeover
+ */
+
+#include "test_util.h"
+
+#define NCTX 50
+
+static void
+test_borrow_return(void)
+{
+    tu_alloc_t ta = {0};
+    mssn_allocator_t za = tu_allocator(&ta);
+    mssn_zpool_t *zp = mssn_zpool_create(10, 4, 2, &za);
+    CHECK(zp != NULL);
+    CHECK(mssn_zpool_create(8, 4, 2, &za) == NULL);
+
+    mssn_t *srv[NCTX];
+    mssn_t *cli[NCTX];
+    const char *offer = "permessage-deflate; client_no_context_takeover; server_no_context_takeover; "
+                        "client_max_window_bits=10; server_max_window_bits=10";
+    for (int i = 0; i < NCTX; i++)
+    {
+        srv[i] = tu_ws_server();
+        cli[i] = tu_ws_client();
+        CHECK(mssn_zpool_attach(srv[i], zp) == 0);
+        CHECK(mssn_zpool_attach(cli[i], zp) == 0);
+        const char *resp = mssn_ws_negotiate(srv[i], offer, (int)strlen(offer));
+        CHECK(resp != NULL);
+        CHECK(mssn_ws_negotiate(cli[i], resp, (int)strlen(resp)) != NULL);
+    }
+
+    const size_t sz = 20000;
+    uint8_t *p = malloc(sz);
+    uint8_t *got = malloc(sz);
+    size_t base = 0;
+    for (int round = 0; round < 3; round++)
+    {
+        for (int i = 0; i < NCTX; i++)
+        {
+            for (int dir = 0; dir < 2; dir++)
+            {
+                mssn_t *tx = dir ? srv[i] : cli[i];
+                mssn_t *rx = dir ? cli[i] : srv[i];
+                for (size_t k = 0; k < sz; k++)
+                {
+                    p[k] = "websocket "[(k + i + round) % 10] ^ (k % 97 == 0);
+                }
+                mssn_data_t *dt = mssn_build(tx, WS_FRAME_TEXT, MSSN_BUILD_DEFLATE, 4096, p, sz);
+                CHECK((dt != NULL) && (dt->data[0] & 0x40));
+                for (mssn_data_t *d = dt; d != NULL; d = d->next)
+                {
+                    tu_feed(rx, d->data, d->length);
+                }
+                size_t total = 0;
+                for (mssn_frame_t *fr = rx->frames; fr != NULL; fr = fr->next)
+                {
+                    total += tu_payload(fr, got + total);
+                }
+                CHECK((total == sz) && (memcmp(p, got, sz) == 0));
+                mssn_reclaim(rx, NULL);
+                mssn_reclaim(tx, dt);
+                if ((round == 0) && (i == 0) && (dir == 1))
+                {
+                    // inflate window allocated on first use
+                    base = ta.live;
+                }
+            }
+        }
+    }
+    // every stream back in pool, or destroyed when pool was full
+    CHECK(ta.live == base);
+
+    // partial messages hold streams across calls, more than idle ones, reset returns them
+    for (int i = 0; i < 3; i++)
+    {
+        mssn_setopt(srv[i], MSSN_OPT_WS_STREAM, 1);
+        mssn_data_t *dt = mssn_build(cli[i], WS_FRAME_TEXT, MSSN_BUILD_DEFLATE, 4096, p, sz);
+        CHECK(dt != NULL);
+        tu_feed(srv[i], dt->data, dt->length / 2);
+        CHECK(srv[i]->frames != NULL);
+        mssn_reclaim(srv[i], NULL);
+        mssn_reclaim(cli[i], dt);
+    }
+    const size_t held = ta.live;
+    CHECK(held > base);
+    for (int i = 0; i < 3; i++)
+    {
+        mssn_reset(srv[i]);
+    }
+    // stream beyond capacity destroyed, idle ones may keep inflate window
+    CHECK(ta.live < held);
+
+    for (int i = 0; i < NCTX; i++)
+    {
+        mssn_close(srv[i]);
+        mssn_close(cli[i]);
+    }
+    mssn_zpool_destroy(zp);
+    CHECK(ta.live == 0);
+    free(p);
+    free(got);
+}
+
+static void
+test_takeover_keeps_own(void)
+{
+    // context takeover never borrows from pool
+    tu_alloc_t ta = {0};
+    mssn_allocator_t za = tu_allocator(&ta);
+    mssn_zpool_t *zp = mssn_zpool_create(15, 8, 1, &za);
+    const size_t idle = ta.live;
+    mssn_t *srv = tu_ws_server();
+    mssn_t *cli = tu_ws_client();
+    mssn_zpool_attach(srv, zp);
+    const char *resp = mssn_ws_negotiate(srv, "permessage-deflate", 18);
+    CHECK(mssn_ws_negotiate(cli, resp, (int)strlen(resp)) != NULL);
+    uint8_t p[2000];
+    tu_fill(p, sizeof(p), 4, 4);
+    for (int i = 0; i < 3; i++)
+    {
+        mssn_data_t *dt = mssn_build(cli, WS_FRAME_BINARY, MSSN_BUILD_DEFLATE, 4096, p, sizeof(p));
+        tu_feed(srv, dt->data, dt->length);
+        mssn_reclaim(cli, dt);
+        mssn_reclaim(srv, NULL);
+        CHECK(ta.live == idle);
+    }
+    mssn_close(srv);
+    mssn_close(cli);
+    mssn_zpool_destroy(zp);
+    CHECK(ta.live == 0);
+}
+
+static void
+test_size_query(void)
+{
+    // querying size of mssn_build_into borrows no stream, other context reuses idle one
+    tu_alloc_t ta = {0};
+    mssn_allocator_t za = tu_allocator(&ta);
+    mssn_zpool_t *zp = mssn_zpool_create(15, 8, 1, &za);
+    const char *offer = "permessage-deflate; client_no_context_takeover";
+    mssn_t *srv = tu_ws_server();
+    mssn_t *cli[2];
+    for (int i = 0; i < 2; i++)
+    {
+        cli[i] = tu_ws_client();
+        mssn_zpool_attach(cli[i], zp);
+        const char *resp = mssn_ws_negotiate(srv, offer, (int)strlen(offer));
+        CHECK(mssn_ws_negotiate(cli[i], resp, (int)strlen(resp)) != NULL);
+    }
+    uint8_t p[2000];
+    uint8_t out[4096];
+    tu_fill(p, sizeof(p), 5, 4);
+    CHECK(mssn_build_into(cli[0], WS_FRAME_TEXT, MSSN_BUILD_DEFLATE, 4096, p, sizeof(p), out, sizeof(out)) > 0);
+    const size_t idle = ta.live;
+    CHECK(idle > 0);
+
+    const int64_t need = mssn_build_into(cli[0], WS_FRAME_TEXT, MSSN_BUILD_DEFLATE, 4096, p, sizeof(p), NULL, 0);
+    CHECK(need > (int64_t)sizeof(p));
+    CHECK(mssn_build_into(cli[0], WS_FRAME_TEXT, MSSN_BUILD_DEFLATE, 4096, p, sizeof(p), out, 16) == need);
+    CHECK(mssn_build_into(cli[1], WS_FRAME_TEXT, MSSN_BUILD_DEFLATE, 4096, p, sizeof(p), out, sizeof(out)) > 0);
+    CHECK(ta.live == idle);
+
+    mssn_close(srv);
+    mssn_close(cli[0]);
+    mssn_close(cli[1]);
+    mssn_zpool_destroy(zp);
+    CHECK(ta.live == 0);
+}
+
+int main(void)
+{
+    test_borrow_return();
+    test_takeover_keeps_own();
+    test_size_query();
+    TEST_OK();
+    return 0;
+}
@@ -0,0 +1,22 @@
+#
+# build and run C tests in tests/c with sanitizers, from repo root
+
+CC=${CC:-gcc}
+CFLAGS=${CFLAGS:-"-Wall -Wextra -Wno-unused-parameter -g -O1 -fsanitize=address,undefined"}
+OUT=tests/c/build
+mkdir -p $OUT
+
+FAILED=0
+for src in tests/c/test_*.c; do
+    name=$(basename $src .c)
+    if ! $CC $CFLAGS -I./src -I./tests/c src/*.c $src -o $OUT/$name -lz -lpthread; then
+        echo "> build $name failed"
+        FAILED=1
+        continue
+    fi
+    if ! ./$OUT/$name; then
+        echo "> $name failed"
+        FAILED=1
+    fi
+done
+exit $FAILED